@@ -7,6 +7,7 @@
 #include "parse-options.h"
 #include "unpack-trees.h"
 #include "dir.h"
+#include "sha1-array.h"
 
 static char const * const archive_usage[] = {
 	N_("git archive [<options>] <tree-ish> [<path>...]"),
@@ -71,7 +72,7 @@ void *sha1_file_to_archive(const struct archiver_args *args,
 	const struct commit *commit = args->convert ? args->commit : NULL;
 
 	path += args->baselen;
-	buffer = read_sha1_file(sha1, type, sizep);
+	buffer = read_object_batch(args->objects, sha1, type, sizep);
 	if (buffer && S_ISREG(mode)) {
 		struct strbuf buf = STRBUF_INIT;
 		size_t size = 0;
@@ -214,6 +215,28 @@ static int queue_or_write_archive_entry(const unsigned char *sha1,
 				   stage, context);
 }
 
+/*
+ * Once the tree has been read into the index, the blobs to archive are
+ * all known, and can be read as a batch.
+ */
+static struct object_batch *prepare_archive_blobs(struct archiver_args *args)
+{
+	struct oid_array blobs = OID_ARRAY_INIT;
+	struct object_batch *batch;
+	int i;
+
+	for (i = 0; i < the_index.cache_nr; i++) {
+		const struct cache_entry *ce = the_index.cache[i];
+
+		if (!S_ISGITLINK(ce->ce_mode) &&
+		    ce_path_match(ce, &args->pathspec, NULL))
+			oid_array_append(&blobs, &ce->oid);
+	}
+	batch = prepare_object_batch(&blobs);
+	oid_array_clear(&blobs);
+	return batch;
+}
+
 int write_archive_entries(struct archiver_args *args,
 		write_archive_entry_fn_t write_entry)
 {
@@ -253,6 +276,7 @@ int write_archive_entries(struct archiver_args *args,
 		if (unpack_trees(1, &t, &opts))
 			return -1;
 		git_attr_set_direction(GIT_ATTR_INDEX, &the_index);
+		args->objects = prepare_archive_blobs(args);
 	}
 
 	err = read_tree_recursive(args->tree, "", 0, 0, &args->pathspec,
@@ -262,6 +286,8 @@ int write_archive_entries(struct archiver_args *args,
 				  &context);
 	if (err == READ_TREE_RECURSIVE)
 		err = 0;
+	free_object_batch(args->objects);
+	args->objects = NULL;
 	while (context.bottom) {
 		struct directory *next = context.bottom->up;
 		free(context.bottom);
@@ -487,6 +513,7 @@ static int parse_archive_args(int argc, const char **argv,
 	args->base = base;
 	args->baselen = strlen(base);
 	args->worktree_attributes = worktree_attributes;
+	args->objects = NULL;
 
 	return argc;
 }
@@ -15,6 +15,8 @@ struct archiver_args {
 	unsigned int worktree_attributes : 1;
 	unsigned int convert : 1;
 	int compression_level;
+	/* the blobs to archive, if they could be listed up front */
+	struct object_batch *objects;
 };
 
 #define ARCHIVER_WANT_COMPRESSION_LEVELS 1
@@ -0,0 +1,88 @@
+/*
+ * arena.c - allocate many small things, and free them all at once
+ */
+#include "git-compat-util.h"
+#include "arena.h"
+
+#define ARENA_DEFAULT_BLOCK (1024 * 1024 - sizeof(struct arena_block))
+
+struct arena_block {
+	struct arena_block *next;
+	char *next_free;
+	char *end;
+	uintmax_t space[FLEX_ARRAY];
+};
+
+static struct arena_block *new_block(struct arena *arena, size_t len)
+{
+	struct arena_block *b;
+	size_t size = arena->block_size ? arena->block_size : ARENA_DEFAULT_BLOCK;
+
+	if (size < len)
+		size = len;
+	b = xmalloc(st_add(sizeof(*b), size));
+	b->next_free = (char *)b->space;
+	b->end = b->next_free + size;
+	arena->total += size;
+	return b;
+}
+
+void *arena_alloc(struct arena *arena, size_t len)
+{
+	struct arena_block *b = arena->blocks;
+	void *p;
+
+	/* round up to the alignment of the block's space[] */
+	len = st_add(len, sizeof(uintmax_t) - 1) & ~(sizeof(uintmax_t) - 1);
+
+	if (!b || b->end - b->next_free < len) {
+		b = new_block(arena, len);
+		/*
+		 * Keep allocating from the current block if the new one
+		 * is used up by this request anyway.
+		 */
+		if (arena->blocks && b->end - b->next_free == len) {
+			b->next = arena->blocks->next;
+			arena->blocks->next = b;
+		} else {
+			b->next = arena->blocks;
+			arena->blocks = b;
+		}
+	}
+	p = b->next_free;
+	b->next_free += len;
+	return p;
+}
+
+void *arena_calloc(struct arena *arena, size_t count, size_t size)
+{
+	size_t len = st_mult(count, size);
+	void *p = arena_alloc(arena, len);
+
+	memset(p, 0, len);
+	return p;
+}
+
+int arena_contains(const struct arena *arena, const void *p)
+{
+	const struct arena_block *b;
+
+	for (b = arena->blocks; b; b = b->next)
+		if ((const char *)b->space <= (const char *)p &&
+		    (const char *)p < b->end)
+			return 1;
+	return 0;
+}
+
+void arena_release(struct arena *arena)
+{
+	struct arena_block *b = arena->blocks;
+
+	while (b) {
+		struct arena_block *next = b->next;
+		free(b);
+		b = next;
+	}
+	arena->blocks = NULL;
+	arena->total = 0;
+}
@@ -0,0 +1,43 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+/**
+ * A simple arena (or memory pool): memory is handed out from large
+ * blocks, and cannot be freed piecemeal; all of it is released at
+ * once with arena_release().
+ *
+ * Usage is roughly:
+ *
+ *   // Zero-initialization gives an arena with the default block size.
+ *   struct arena arena = ARENA_INIT;
+ *   arena.block_size = expected_total;  // optional
+ *
+ *   struct foo *foo = arena_alloc(&arena, sizeof(*foo));
+ *   ...
+ *   arena_release(&arena);
+ *
+ * All allocations are aligned suitably for any type.
+ */
+
+struct arena_block;
+
+struct arena {
+	struct arena_block *blocks;
+	/* size of the next block to allocate, 0 for the default */
+	size_t block_size;
+	/* total amount of memory obtained from the system */
+	size_t total;
+};
+
+#define ARENA_INIT { NULL, 0, 0 }
+
+void *arena_alloc(struct arena *arena, size_t len);
+void *arena_calloc(struct arena *arena, size_t count, size_t size);
+
+/* Does the memory at "p" belong to the arena? */
+int arena_contains(const struct arena *arena, const void *p);
+
+/* Release all memory of the arena, leaving it ready for reuse. */
+void arena_release(struct arena *arena);
+
+#endif
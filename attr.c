@@ -486,6 +486,44 @@ static void drop_attr_stack(struct attr_stack **stack)
 	}
 }
 
+/*
+ * The rules from an attr_stack that can match a path in one directory,
+ * in the order fill() tries them (from the top of the stack down, and
+ * from the last rule of each file to the first), and the macros
+ * defined by the stack.  Checkout, add and archive look up the
+ * attributes of all the paths of a directory in a row, which then
+ * need neither rebuild the stack nor test the rules that are out of
+ * reach from the directory for every path.
+ */
+struct attr_rule {
+	const struct match_attr *a;
+	const char *base;
+	int baselen;
+	unsigned always:1;	/* matches any file, e.g. "*" */
+};
+
+struct attr_dir_rules {
+	struct strbuf dir;
+	struct attr_rule *rules;
+	int nr, alloc;
+	struct attr_macro {
+		int attr_nr;
+		const struct match_attr *macro;
+	} *macros;
+	int macros_nr, macros_alloc;
+};
+
+static void drop_attr_dir_rules(struct attr_dir_rules **rules)
+{
+	if (!*rules)
+		return;
+	strbuf_release(&(*rules)->dir);
+	free((*rules)->rules);
+	free((*rules)->macros);
+	free(*rules);
+	*rules = NULL;
+}
+
 /* List of all attr_check structs; access should be surrounded by mutex */
 static struct check_vector {
 	size_t nr;
@@ -554,6 +592,7 @@ static void drop_all_attr_stacks(void)
 
 	for (i = 0; i < check_vector.nr; i++) {
 		drop_attr_stack(&check_vector.checks[i]->stack);
+		drop_attr_dir_rules(&check_vector.checks[i]->dir_rules);
 	}
 
 	vector_unlock();
@@ -648,6 +687,7 @@ void attr_check_clear(struct attr_check *check)
 	check->all_attrs_nr = 0;
 
 	drop_attr_stack(&check->stack);
+	drop_attr_dir_rules(&check->dir_rules);
 }
 
 void attr_check_free(struct attr_check *check)
@@ -1036,21 +1076,18 @@ static int fill_one(const char *what, struct all_attrs_item *all_attrs,
 }
 
 static int fill(const char *path, int pathlen, int basename_offset,
-		const struct attr_stack *stack,
+		const struct attr_dir_rules *dir_rules,
 		struct all_attrs_item *all_attrs, int rem)
 {
-	for (; rem > 0 && stack; stack = stack->prev) {
-		int i;
-		const char *base = stack->origin ? stack->origin : "";
+	int i;
 
-		for (i = stack->num_matches - 1; 0 < rem && 0 <= i; i--) {
-			const struct match_attr *a = stack->attrs[i];
-			if (a->is_macro)
-				continue;
-			if (path_matches(path, pathlen, basename_offset,
-					 &a->u.pat, base, stack->originlen))
-				rem = fill_one("fill", all_attrs, a, rem);
-		}
+	for (i = 0; 0 < rem && i < dir_rules->nr; i++) {
+		const struct attr_rule *r = &dir_rules->rules[i];
+
+		if (r->always ||
+		    path_matches(path, pathlen, basename_offset,
+				 &r->a->u.pat, r->base, r->baselen))
+			rem = fill_one("fill", all_attrs, r->a, rem);
 	}
 
 	return rem;
@@ -1088,6 +1125,111 @@ static void determine_macros(struct all_attrs_item *all_attrs,
 	}
 }
 
+/*
+ * Can the pattern "pat" from the .gitattributes file in "base" match
+ * a path in the directory "dir"?  A pattern with a slash matches the
+ * whole path relative to base, so its literal leading part must match
+ * the part of the directory below base, and unless it has "**" (or a
+ * bracket expression, to be safe) it must have as many slashes as the
+ * path, since its wildcards do not match a slash.
+ */
+static int rule_reaches_dir(const struct pattern *pat,
+			    int baselen, const char *dir, int dirlen)
+{
+	const char *pattern = pat->pattern, *rel;
+	int patternlen = pat->patternlen, prefix = pat->nowildcardlen;
+	int rellen, len, i, slashes = 0;
+
+	if (pat->flags & EXC_FLAG_NODIR)
+		return 1;
+
+	if (*pattern == '/') {
+		pattern++;
+		patternlen--;
+		prefix--;
+	}
+
+	/* the directory part of the path, relative to base, with a slash */
+	if (!baselen) {
+		rel = dir;
+		rellen = dirlen;
+	} else if (baselen < dirlen) {
+		rel = dir + baselen + 1;
+		rellen = dirlen - baselen - 1;
+	} else {
+		rel = "";
+		rellen = 0;
+	}
+
+	len = prefix < rellen ? prefix : rellen;
+	if (fspathncmp(pattern, rel, len) ||
+	    (rellen && len == rellen && len < prefix && pattern[len] != '/'))
+		return 0;
+
+	if (memmem(pattern, patternlen, "**", 2) ||
+	    memchr(pattern, '[', patternlen))
+		return 1;
+	for (i = 0; i < patternlen; i++)
+		if (pattern[i] == '/')
+			slashes++;
+	for (i = 0; i < rellen; i++)
+		if (rel[i] == '/')
+			slashes--;
+	return slashes == !!rellen;
+}
+
+static void prepare_attr_dir_rules(struct attr_check *check,
+				   const char *path, int dirlen)
+{
+	struct attr_dir_rules *dir_rules = check->dir_rules;
+	const struct attr_stack *stack;
+	int i;
+
+	if (!dir_rules) {
+		dir_rules = check->dir_rules = xcalloc(1, sizeof(*dir_rules));
+		strbuf_init(&dir_rules->dir, 0);
+	}
+	strbuf_reset(&dir_rules->dir);
+	strbuf_add(&dir_rules->dir, path, dirlen);
+	dir_rules->nr = 0;
+	dir_rules->macros_nr = 0;
+
+	for (stack = check->stack; stack; stack = stack->prev) {
+		const char *base = stack->origin ? stack->origin : "";
+
+		for (i = stack->num_matches - 1; 0 <= i; i--) {
+			const struct match_attr *a = stack->attrs[i];
+			const struct pattern *pat = &a->u.pat;
+			struct attr_rule *r;
+
+			if (a->is_macro ||
+			    !rule_reaches_dir(pat, stack->originlen,
+					      path, dirlen))
+				continue;
+			ALLOC_GROW(dir_rules->rules, dir_rules->nr + 1,
+				   dir_rules->alloc);
+			r = &dir_rules->rules[dir_rules->nr++];
+			r->a = a;
+			r->base = base;
+			r->baselen = stack->originlen;
+			r->always = pat->patternlen == 1 && *pat->pattern == '*' &&
+				    !(pat->flags & EXC_FLAG_MUSTBEDIR);
+		}
+	}
+
+	for (i = 0; i < check->all_attrs_nr; i++) {
+		struct attr_macro *m;
+
+		if (!check->all_attrs[i].macro)
+			continue;
+		ALLOC_GROW(dir_rules->macros, dir_rules->macros_nr + 1,
+			   dir_rules->macros_alloc);
+		m = &dir_rules->macros[dir_rules->macros_nr++];
+		m->attr_nr = i;
+		m->macro = check->all_attrs[i].macro;
+	}
+}
+
 /*
  * Collect attributes for path into the array pointed to by check->all_attrs.
  * If check->check_nr is non-zero, only attributes in check[] are collected.
@@ -1112,9 +1254,19 @@ static void collect_some_attrs(const char *path, struct attr_check *check)
 		dirlen = 0;
 	}
 
-	prepare_attr_stack(path, dirlen, &check->stack);
-	all_attrs_init(&g_attr_hashmap, check);
-	determine_macros(check->all_attrs, check->stack);
+	if (check->dir_rules && check->dir_rules->dir.len == dirlen &&
+	    !strncmp(check->dir_rules->dir.buf, path, dirlen)) {
+		all_attrs_init(&g_attr_hashmap, check);
+		for (i = 0; i < check->dir_rules->macros_nr; i++) {
+			struct attr_macro *m = &check->dir_rules->macros[i];
+			check->all_attrs[m->attr_nr].macro = m->macro;
+		}
+	} else {
+		prepare_attr_stack(path, dirlen, &check->stack);
+		all_attrs_init(&g_attr_hashmap, check);
+		determine_macros(check->all_attrs, check->stack);
+		prepare_attr_dir_rules(check, path, dirlen);
+	}
 
 	if (check->nr) {
 		rem = 0;
@@ -1131,7 +1283,8 @@ static void collect_some_attrs(const char *path, struct attr_check *check)
 	}
 
 	rem = check->all_attrs_nr;
-	fill(path, pathlen, basename_offset, check->stack, check->all_attrs, rem);
+	fill(path, pathlen, basename_offset, check->dir_rules,
+	     check->all_attrs, rem);
 }
 
 int git_check_attr(const char *path, struct attr_check *check)
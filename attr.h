@@ -7,6 +7,7 @@ struct git_attr;
 /* opaque structures used internally for attribute collection */
 struct all_attrs_item;
 struct attr_stack;
+struct attr_dir_rules;
 
 /*
  * Given a string, return the gitattribute object that
@@ -40,6 +41,7 @@ struct attr_check {
 	int all_attrs_nr;
 	struct all_attrs_item *all_attrs;
 	struct attr_stack *stack;
+	struct attr_dir_rules *dir_rules;
 };
 
 extern struct attr_check *attr_check_alloc(void);
@@ -29,6 +29,7 @@
 #include "line-log.h"
 #include "dir.h"
 #include "progress.h"
+#include "thread-utils.h"
 
 static char blame_usage[] = N_("git blame [<options>] [<rev-opts>] [<rev>] [--] <file>");
 
@@ -52,6 +53,7 @@ static int xdl_opts;
 static int abbrev = -1;
 static int no_whole_file_rename;
 static int show_progress;
+static int num_threads;
 
 static struct date_mode blame_date_mode = { DATE_ISO8601 };
 static size_t blame_date_width;
@@ -1071,60 +1073,193 @@ static void handle_split(struct scoreboard *sb,
 	}
 }
 
-struct handle_split_cb_data {
-	struct scoreboard *sb;
+struct blame_list {
 	struct blame_entry *ent;
-	struct origin *parent;
-	struct blame_entry *split;
-	long plno;
-	long tlno;
+	struct blame_entry split[3];
+};
+
+/*
+ * Count the number of entries the target is suspected for,
+ * and prepare a list of entry and the best split.
+ */
+static struct blame_list *setup_blame_list(struct blame_entry *unblamed,
+					   int *num_ents_p)
+{
+	struct blame_entry *e;
+	int num_ents, i;
+	struct blame_list *blame_list = NULL;
+
+	for (e = unblamed, num_ents = 0; e; e = e->next)
+		num_ents++;
+	if (num_ents) {
+		blame_list = xcalloc(num_ents, sizeof(struct blame_list));
+		for (e = unblamed, i = 0; e; e = e->next)
+			blame_list[i++].ent = e;
+	}
+	*num_ents_p = num_ents;
+	return blame_list;
+}
+
+/*
+ * One hunk of a diff between a parent blob and a part of the final
+ * image, recorded so that it can be computed away from the thread that
+ * owns the scoreboard and replayed there later.
+ */
+struct blame_hunk {
+	long start_a, count_a;
+	long start_b, count_b;
 };
 
-static int handle_split_cb(long start_a, long count_a,
-			   long start_b, long count_b, void *data)
+/*
+ * The diff between the parent blob file_p and the lines of the final
+ * image covered by one blame_entry.  Computing the hunks only reads
+ * the two buffers, so many of these can be run concurrently.
+ */
+struct copy_diff_job {
+	mmfile_t *file_p;
+	mmfile_t file_o;
+	struct blame_hunk *hunks;
+	int nr, alloc;
+	int err;
+};
+
+static int record_hunk_cb(long start_a, long count_a,
+			  long start_b, long count_b, void *data)
 {
-	struct handle_split_cb_data *d = data;
-	handle_split(d->sb, d->ent, d->tlno, d->plno, start_b, d->parent,
-		     d->split);
-	d->plno = start_a + count_a;
-	d->tlno = start_b + count_b;
+	struct copy_diff_job *job = data;
+	struct blame_hunk *h;
+
+	ALLOC_GROW(job->hunks, job->nr + 1, job->alloc);
+	h = &job->hunks[job->nr++];
+	h->start_a = start_a;
+	h->count_a = count_a;
+	h->start_b = start_b;
+	h->count_b = count_b;
 	return 0;
 }
 
+static void run_copy_diff_job(struct copy_diff_job *job)
+{
+	job->nr = 0;
+	job->err = diff_hunks(job->file_p, &job->file_o, record_hunk_cb, job);
+}
+
+/* Below this many entries per thread, threading is not worth it. */
+#define MIN_JOBS_PER_THREAD 2
+
+#ifndef NO_PTHREADS
+struct copy_diff_thread {
+	pthread_t thread;
+	struct copy_diff_job *jobs;
+	int nr, step;
+};
+
+static void *run_copy_diff_thread(void *data)
+{
+	struct copy_diff_thread *t = data;
+	int i;
+
+	for (i = 0; i < t->nr; i += t->step)
+		run_copy_diff_job(&t->jobs[i]);
+	return NULL;
+}
+#endif
+
+/*
+ * Compute the hunks for all jobs.  The jobs are independent of each
+ * other, and the results are consumed by the caller in job order, so
+ * the outcome does not depend on how they were distributed.
+ */
+static void run_copy_diff_jobs(struct copy_diff_job *jobs, int nr)
+{
+	int i;
+#ifndef NO_PTHREADS
+	int nr_threads = num_threads;
+
+	if (nr_threads > nr / MIN_JOBS_PER_THREAD)
+		nr_threads = nr / MIN_JOBS_PER_THREAD;
+	if (nr_threads > 1) {
+		struct copy_diff_thread *t = xcalloc(nr_threads, sizeof(*t));
+
+		for (i = 0; i < nr_threads; i++) {
+			int err;
+
+			t[i].jobs = jobs + i;
+			t[i].nr = nr - i;
+			t[i].step = nr_threads;
+			err = pthread_create(&t[i].thread, NULL,
+					     run_copy_diff_thread, &t[i]);
+			if (err)
+				die(_("blame: failed to create thread: %s"),
+				    strerror(err));
+		}
+		for (i = 0; i < nr_threads; i++)
+			pthread_join(t[i].thread, NULL);
+		free(t);
+		return;
+	}
+#endif
+	for (i = 0; i < nr; i++)
+		run_copy_diff_job(&jobs[i]);
+}
+
 /*
- * Find the lines from parent that are the same as ent so that
- * we can pass blames to it.  file_p has the blob contents for
- * the parent.
+ * Find the lines from parent that are the same as the lines of each
+ * entry in blame_list so that we can pass blames to it.  file_p has
+ * the blob contents for the parent.  The best split for the j-th entry
+ * is stored in splits[j].
  */
 static void find_copy_in_blob(struct scoreboard *sb,
-			      struct blame_entry *ent,
+			      struct blame_list *blame_list, int num_ents,
 			      struct origin *parent,
-			      struct blame_entry *split,
+			      struct blame_entry (*splits)[3],
 			      mmfile_t *file_p)
 {
-	const char *cp;
-	mmfile_t file_o;
-	struct handle_split_cb_data d;
+	struct copy_diff_job *jobs;
+	int i, j;
 
-	memset(&d, 0, sizeof(d));
-	d.sb = sb; d.ent = ent; d.parent = parent; d.split = split;
-	/*
-	 * Prepare mmfile that contains only the lines in ent.
-	 */
-	cp = nth_line(sb, ent->lno);
-	file_o.ptr = (char *) cp;
-	file_o.size = nth_line(sb, ent->lno + ent->num_lines) - cp;
+	if (!num_ents)
+		return;
+	jobs = xcalloc(num_ents, sizeof(*jobs));
+	for (i = 0; i < num_ents; i++) {
+		struct blame_entry *ent = blame_list[i].ent;
+		const char *cp;
 
-	/*
-	 * file_o is a part of final image we are annotating.
-	 * file_p partially may match that image.
-	 */
-	memset(split, 0, sizeof(struct blame_entry [3]));
-	if (diff_hunks(file_p, &file_o, handle_split_cb, &d))
-		die("unable to generate diff (%s)",
-		    oid_to_hex(&parent->commit->object.oid));
-	/* remainder, if any, all match the preimage */
-	handle_split(sb, ent, d.tlno, d.plno, ent->num_lines, parent, split);
+		/*
+		 * Prepare mmfile that contains only the lines in ent.
+		 * file_o is a part of final image we are annotating.
+		 * file_p partially may match that image.
+		 */
+		cp = nth_line(sb, ent->lno);
+		jobs[i].file_p = file_p;
+		jobs[i].file_o.ptr = (char *) cp;
+		jobs[i].file_o.size = nth_line(sb, ent->lno + ent->num_lines) - cp;
+	}
+
+	run_copy_diff_jobs(jobs, num_ents);
+
+	for (i = 0; i < num_ents; i++) {
+		struct blame_entry *ent = blame_list[i].ent;
+		struct blame_entry *split = splits[i];
+		long plno = 0, tlno = 0;
+
+		if (jobs[i].err)
+			die("unable to generate diff (%s)",
+			    oid_to_hex(&parent->commit->object.oid));
+
+		memset(split, 0, sizeof(struct blame_entry [3]));
+		for (j = 0; j < jobs[i].nr; j++) {
+			struct blame_hunk *h = &jobs[i].hunks[j];
+			handle_split(sb, ent, tlno, plno, h->start_b,
+				     parent, split);
+			plno = h->start_a + h->count_a;
+			tlno = h->start_b + h->count_b;
+		}
+		/* remainder, if any, all match the preimage */
+		handle_split(sb, ent, tlno, plno, ent->num_lines, parent, split);
+		free(jobs[i].hunks);
+	}
+	free(jobs);
 }
 
 /* Move all blame entries from list *source that have a score smaller
@@ -1165,7 +1300,6 @@ static void find_move_in_parent(struct scoreboard *sb,
 				struct origin *target,
 				struct origin *parent)
 {
-	struct blame_entry *e, split[3];
 	struct blame_entry *unblamed = target->suspects;
 	struct blame_entry *leftover = NULL;
 	mmfile_t file_p;
@@ -1184,52 +1318,34 @@ static void find_move_in_parent(struct scoreboard *sb,
 	 */
 	do {
 		struct blame_entry **unblamedtail = &unblamed;
-		struct blame_entry *next;
-		for (e = unblamed; e; e = next) {
-			next = e->next;
-			find_copy_in_blob(sb, e, parent, split, &file_p);
-			if (split[1].suspect &&
-			    blame_move_score < ent_score(sb, &split[1])) {
-				split_blame(blamed, &unblamedtail, split, e);
+		struct blame_entry (*split)[3];
+		struct blame_list *blame_list;
+		int num_ents, j;
+
+		blame_list = setup_blame_list(unblamed, &num_ents);
+		split = xcalloc(num_ents, sizeof(*split));
+		find_copy_in_blob(sb, blame_list, num_ents, parent, split,
+				  &file_p);
+		for (j = 0; j < num_ents; j++) {
+			struct blame_entry *e = blame_list[j].ent;
+
+			if (split[j][1].suspect &&
+			    blame_move_score < ent_score(sb, &split[j][1])) {
+				split_blame(blamed, &unblamedtail, split[j], e);
 			} else {
 				e->next = leftover;
 				leftover = e;
 			}
-			decref_split(split);
+			decref_split(split[j]);
 		}
+		free(split);
+		free(blame_list);
 		*unblamedtail = NULL;
 		toosmall = filter_small(sb, toosmall, &unblamed, blame_move_score);
 	} while (unblamed);
 	target->suspects = reverse_blame(leftover, NULL);
 }
 
-struct blame_list {
-	struct blame_entry *ent;
-	struct blame_entry split[3];
-};
-
-/*
- * Count the number of entries the target is suspected for,
- * and prepare a list of entry and the best split.
- */
-static struct blame_list *setup_blame_list(struct blame_entry *unblamed,
-					   int *num_ents_p)
-{
-	struct blame_entry *e;
-	int num_ents, i;
-	struct blame_list *blame_list = NULL;
-
-	for (e = unblamed, num_ents = 0; e; e = e->next)
-		num_ents++;
-	if (num_ents) {
-		blame_list = xcalloc(num_ents, sizeof(struct blame_list));
-		for (e = unblamed, i = 0; e; e = e->next)
-			blame_list[i++].ent = e;
-	}
-	*num_ents_p = num_ents;
-	return blame_list;
-}
-
 /*
  * For lines target is suspected for, see if we can find code movement
  * across file boundary from the parent commit.  porigin is the path
@@ -1283,13 +1399,15 @@ static void find_copy_in_parent(struct scoreboard *sb,
 
 	do {
 		struct blame_entry **unblamedtail = &unblamed;
+		struct blame_entry (*this)[3];
+
 		blame_list = setup_blame_list(unblamed, &num_ents);
+		this = xcalloc(num_ents, sizeof(*this));
 
 		for (i = 0; i < diff_queued_diff.nr; i++) {
 			struct diff_filepair *p = diff_queued_diff.queue[i];
 			struct origin *norigin;
 			mmfile_t file_p;
-			struct blame_entry this[3];
 
 			if (!DIFF_FILE_VALID(p->one))
 				continue; /* does not exist in parent */
@@ -1306,12 +1424,12 @@ static void find_copy_in_parent(struct scoreboard *sb,
 			if (!file_p.ptr)
 				continue;
 
+			find_copy_in_blob(sb, blame_list, num_ents, norigin,
+					  this, &file_p);
 			for (j = 0; j < num_ents; j++) {
-				find_copy_in_blob(sb, blame_list[j].ent,
-						  norigin, this, &file_p);
 				copy_split_if_better(sb, blame_list[j].split,
-						     this);
-				decref_split(this);
+						     this[j]);
+				decref_split(this[j]);
 			}
 			origin_decref(norigin);
 		}
@@ -1328,6 +1446,7 @@ static void find_copy_in_parent(struct scoreboard *sb,
 			}
 			decref_split(split);
 		}
+		free(this);
 		free(blame_list);
 		*unblamedtail = NULL;
 		toosmall = filter_small(sb, toosmall, &unblamed, blame_copy_score);
@@ -2209,6 +2328,17 @@ static int git_blame_config(const char *var, const char *value, void *cb)
 			*output_option &= ~OUTPUT_SHOW_EMAIL;
 		return 0;
 	}
+	if (!strcmp(var, "blame.threads")) {
+		num_threads = git_config_int(var, value);
+		if (num_threads < 0)
+			die(_("invalid number of threads specified (%d) for %s"),
+			    num_threads, var);
+#ifdef NO_PTHREADS
+		if (num_threads != 1)
+			warning(_("no threads support, ignoring %s"), var);
+#endif
+		return 0;
+	}
 	if (!strcmp(var, "blame.date")) {
 		if (!value)
 			return config_error_nonbool(var);
@@ -2600,6 +2730,7 @@ int cmd_blame(int argc, const char **argv, const char *prefix)
 		{ OPTION_CALLBACK, 'C', NULL, &opt, N_("score"), N_("Find line copies within and across files"), PARSE_OPT_OPTARG, blame_copy_callback },
 		{ OPTION_CALLBACK, 'M', NULL, &opt, N_("score"), N_("Find line movements within and across files"), PARSE_OPT_OPTARG, blame_move_callback },
 		OPT_STRING_LIST('L', NULL, &range_list, N_("n,m"), N_("Process only line range n,m, counting from 1")),
+		OPT_INTEGER(0, "threads", &num_threads, N_("use <n> threads to find copies and moves")),
 		OPT__ABBREV(&abbrev),
 		OPT_END()
 	};
@@ -2644,6 +2775,15 @@ int cmd_blame(int argc, const char **argv, const char *prefix)
 	DIFF_OPT_CLR(&revs.diffopt, FOLLOW_RENAMES);
 	argc = parse_options_end(&ctx);
 
+	if (num_threads < 0)
+		die(_("invalid number of threads specified (%d)"), num_threads);
+	if (!num_threads)	/* --threads=0 means autodetect */
+		num_threads = online_cpus();
+#ifdef NO_PTHREADS
+	if (num_threads != 1)
+		warning(_("no threads support, ignoring --threads"));
+#endif
+
 	if (incremental || (output_option & OUTPUT_PORCELAIN)) {
 		if (show_progress > 0)
 			die(_("--progress can't be used with --incremental or porcelain formats"));
@@ -17,8 +17,11 @@ struct batch_options {
 	int print_contents;
 	int buffer_output;
 	int all_objects;
+	int unordered;
 	int cmdmode; /* may be 'w' or 'c' for --filters or --textconv */
 	const char *format;
+	/* contents of the objects read with --batch-all-objects --unordered */
+	struct object_batch *objects;
 };
 
 static const char *force_path;
@@ -278,7 +281,9 @@ static void print_object_or_die(struct batch_options *opt, struct expand_data *d
 
 	assert(data->info.typep);
 
-	if (data->type == OBJ_BLOB) {
+	/* blobs read in a batch are only streamed when they are large */
+	if (data->type == OBJ_BLOB &&
+	    !(opt->objects && data->size <= big_file_threshold)) {
 		if (opt->buffer_output)
 			fflush(stdout);
 		if (opt->cmdmode) {
@@ -314,7 +319,8 @@ static void print_object_or_die(struct batch_options *opt, struct expand_data *d
 		unsigned long size;
 		void *contents;
 
-		contents = read_sha1_file(oid->hash, &type, &size);
+		contents = read_object_batch(opt->objects, oid->hash,
+					     &type, &size);
 		if (!contents)
 			die("object %s disappeared", oid_to_hex(oid));
 		if (type != data->type)
@@ -458,8 +464,11 @@ static int batch_objects(struct batch_options *opt)
 	 * If we are printing out the object, then always fill in the type,
 	 * since we will want to decide whether or not to stream.
 	 */
-	if (opt->print_contents)
+	if (opt->print_contents) {
 		data.info.typep = &data.type;
+		if (opt->unordered)
+			data.info.sizep = &data.size;
+	}
 
 	if (opt->all_objects) {
 		struct oid_array sa = OID_ARRAY_INIT;
@@ -470,7 +479,16 @@ static int batch_objects(struct batch_options *opt)
 
 		cb.opt = opt;
 		cb.expand = &data;
-		oid_array_for_each_unique(&sa, batch_object_cb, &cb);
+		if (opt->unordered && opt->print_contents) {
+			opt->objects = prepare_object_batch(&sa);
+			for_each_object_in_batch(opt->objects,
+						 batch_object_cb, &cb);
+			free_object_batch(opt->objects);
+			opt->objects = NULL;
+		} else if (opt->unordered)
+			for_each_object_in_pack_order(&sa, batch_object_cb, &cb);
+		else
+			oid_array_for_each_unique(&sa, batch_object_cb, &cb);
 
 		oid_array_clear(&sa);
 		return 0;
@@ -573,6 +591,8 @@ int cmd_cat_file(int argc, const char **argv, const char *prefix)
 			 N_("follow in-tree symlinks (used with --batch or --batch-check)")),
 		OPT_BOOL(0, "batch-all-objects", &batch.all_objects,
 			 N_("show all objects with --batch or --batch-check")),
+		OPT_BOOL(0, "unordered", &batch.unordered,
+			 N_("do not order --batch-all-objects output")),
 		OPT_END()
 	};
 
@@ -604,7 +624,8 @@ int cmd_cat_file(int argc, const char **argv, const char *prefix)
 			    "--textconv nor with --filters");
 	}
 
-	if ((batch.follow_symlinks || batch.all_objects) && !batch.enabled) {
+	if ((batch.follow_symlinks || batch.all_objects || batch.unordered) &&
+	    !batch.enabled) {
 		usage_with_options(cat_file_usage, options);
 	}
 
@@ -20,6 +20,7 @@
 #include "quote.h"
 #include "remote.h"
 #include "blob.h"
+#include "sha1-array.h"
 
 static const char *fast_export_usage[] = {
 	N_("git fast-export [rev-list-opts]"),
@@ -212,7 +213,8 @@ static char *anonymize_blob(unsigned long *size)
 	return strbuf_detach(&out, NULL);
 }
 
-static void export_blob(const struct object_id *oid)
+static void export_blob(const struct object_id *oid,
+			struct object_batch *batch)
 {
 	unsigned long size;
 	enum object_type type;
@@ -235,7 +237,7 @@ static void export_blob(const struct object_id *oid)
 		object = (struct object *)lookup_blob(oid->hash);
 		eaten = 0;
 	} else {
-		buf = read_sha1_file(oid->hash, &type, &size);
+		buf = read_object_batch(batch, oid->hash, &type, &size);
 		if (!buf)
 			die ("Could not read blob %s", oid_to_hex(oid));
 		if (check_sha1_signature(oid->hash, buf, size, typename(type)) < 0)
@@ -535,6 +537,8 @@ static void handle_commit(struct commit *commit, struct rev_info *rev)
 	char *reencoded = NULL;
 	struct commit_list *p;
 	const char *refname;
+	struct oid_array blobs = OID_ARRAY_INIT;
+	struct object_batch *batch = NULL;
 	int i;
 
 	rev->diffopt.output_format = DIFF_FORMAT_CALLBACK;
@@ -569,10 +573,29 @@ static void handle_commit(struct commit *commit, struct rev_info *rev)
 		diff_root_tree_sha1(commit->tree->object.oid.hash,
 				    "", &rev->diffopt);
 
-	/* Export the referenced blobs, and remember the marks. */
+	/*
+	 * Export the referenced blobs, and remember the marks. Reading
+	 * them as a batch applies the deltas they share only once.
+	 */
+	if (!no_data && !anonymize) {
+		for (i = 0; i < diff_queued_diff.nr; i++) {
+			struct diff_filespec *spec;
+			struct object *object;
+
+			spec = diff_queued_diff.queue[i]->two;
+			if (S_ISGITLINK(spec->mode) || is_null_oid(&spec->oid))
+				continue;
+			object = lookup_object(spec->oid.hash);
+			if (!object || !(object->flags & SHOWN))
+				oid_array_append(&blobs, &spec->oid);
+		}
+		batch = prepare_object_batch(&blobs);
+	}
 	for (i = 0; i < diff_queued_diff.nr; i++)
 		if (!S_ISGITLINK(diff_queued_diff.queue[i]->two->mode))
-			export_blob(&diff_queued_diff.queue[i]->two->oid);
+			export_blob(&diff_queued_diff.queue[i]->two->oid, batch);
+	free_object_batch(batch);
+	oid_array_clear(&blobs);
 
 	refname = commit->util;
 	if (anonymize) {
@@ -828,7 +851,7 @@ static void get_tags_and_duplicates(struct rev_cmdline_info *info)
 		case OBJ_COMMIT:
 			break;
 		case OBJ_BLOB:
-			export_blob(&commit->object.oid);
+			export_blob(&commit->object.oid, NULL);
 			continue;
 		default: /* OBJ_TAG (nested tags) is already handled */
 			warning("Tag points to object of unexpected type %s, skipping.",
@@ -16,6 +16,7 @@
 #include "connected.h"
 #include "argv-array.h"
 #include "utf8.h"
+#include "sha1-array.h"
 
 static const char * const builtin_fetch_usage[] = {
 	N_("git fetch [<options>] [<repository> [<refspec>...]]"),
@@ -220,6 +221,35 @@ static int will_fetch(struct ref **head, const unsigned char *sha1)
 	return 0;
 }
 
+/*
+ * Collect the objects of the tags advertised by the remote that we
+ * already have, checking them all in one go rather than one by one.
+ */
+static void find_local_tag_objects(const struct ref *refs,
+				   struct oid_array *local)
+{
+	struct oid_array tags = OID_ARRAY_INIT;
+	const struct ref *ref;
+	char *exists;
+	int i;
+
+	for (ref = refs; ref; ref = ref->next)
+		if (starts_with(ref->name, "refs/tags/"))
+			oid_array_append(&tags, &ref->old_oid);
+	exists = xmalloc(tags.nr);
+	has_object_files(&tags, exists, HAS_SHA1_QUICK);
+	for (i = 0; i < tags.nr; i++)
+		if (exists[i])
+			oid_array_append(local, &tags.oid[i]);
+	free(exists);
+	oid_array_clear(&tags);
+}
+
+static int have_tag_object(struct oid_array *local, const void *oid)
+{
+	return oid_array_lookup(local, oid) >= 0;
+}
+
 static void find_non_local_tags(struct transport *transport,
 			struct ref **head,
 			struct ref ***tail)
@@ -228,8 +258,11 @@ static void find_non_local_tags(struct transport *transport,
 	struct string_list remote_refs = STRING_LIST_INIT_NODUP;
 	const struct ref *ref;
 	struct string_list_item *item = NULL;
+	struct oid_array local_tags = OID_ARRAY_INIT;
 
 	for_each_ref(add_existing, &existing_refs);
+	find_local_tag_objects(transport_get_remote_refs(transport),
+			       &local_tags);
 	for (ref = transport_get_remote_refs(transport); ref; ref = ref->next) {
 		if (!starts_with(ref->name, "refs/tags/"))
 			continue;
@@ -242,9 +275,9 @@ static void find_non_local_tags(struct transport *transport,
 		 */
 		if (ends_with(ref->name, "^{}")) {
 			if (item &&
-			    !has_object_file_with_flags(&ref->old_oid, HAS_SHA1_QUICK) &&
+			    !have_tag_object(&local_tags, &ref->old_oid) &&
 			    !will_fetch(head, ref->old_oid.hash) &&
-			    !has_sha1_file_with_flags(item->util, HAS_SHA1_QUICK) &&
+			    !have_tag_object(&local_tags, item->util) &&
 			    !will_fetch(head, item->util))
 				item->util = NULL;
 			item = NULL;
@@ -258,7 +291,7 @@ static void find_non_local_tags(struct transport *transport,
 		 * fetch.
 		 */
 		if (item &&
-		    !has_sha1_file_with_flags(item->util, HAS_SHA1_QUICK) &&
+		    !have_tag_object(&local_tags, item->util) &&
 		    !will_fetch(head, item->util))
 			item->util = NULL;
 
@@ -279,9 +312,10 @@ static void find_non_local_tags(struct transport *transport,
 	 * checked to see if it needs fetching.
 	 */
 	if (item &&
-	    !has_sha1_file_with_flags(item->util, HAS_SHA1_QUICK) &&
+	    !have_tag_object(&local_tags, item->util) &&
 	    !will_fetch(head, item->util))
 		item->util = NULL;
+	oid_array_clear(&local_tags);
 
 	/*
 	 * For all the tags in the remote_refs string list,
@@ -18,6 +18,7 @@
 #include "sigchain.h"
 #include "argv-array.h"
 #include "commit.h"
+#include "grep-index.h"
 
 #define FAILED_RUN "failed to run %s"
 
@@ -466,11 +467,16 @@ int cmd_gc(int argc, const char **argv, const char *prefix)
 	if (run_command_v_opt(rerere.argv, RUN_GIT_CMD))
 		return error(FAILED_RUN, rerere.argv[0]);
 
+	if (!is_bare_repository() && rewrite_shared_index(get_index_file()))
+		warning(_("failed to rewrite the shared index"));
+
 	report_garbage = report_pack_garbage;
 	reprepare_packed_git();
 	if (pack_garbage.nr > 0)
 		clean_pack_garbage();
 
+	prune_grep_indexes();
+
 	if (auto_gc && too_many_loose_objects())
 		warning(_("There are too many unreachable loose objects; "
 			"run 'git prune' to remove them."));
@@ -15,6 +15,7 @@
 #include "run-command.h"
 #include "userdiff.h"
 #include "grep.h"
+#include "grep-index.h"
 #include "quote.h"
 #include "dir.h"
 #include "pathspec.h"
@@ -676,6 +677,7 @@ static int grep_cache(struct grep_opt *opt, const struct pathspec *pathspec,
 		strbuf_addstr(&name, super_prefix);
 	}
 
+	the_index.read_only = 1;
 	read_cache();
 
 	for (nr = 0; nr < active_nr; nr++) {
@@ -725,7 +727,7 @@ static int grep_cache(struct grep_opt *opt, const struct pathspec *pathspec,
 
 static int grep_tree(struct grep_opt *opt, const struct pathspec *pathspec,
 		     struct tree_desc *tree, struct strbuf *base, int tn_len,
-		     int check_attr)
+		     int check_attr, struct grep_index *gi)
 {
 	int hit = 0;
 	enum interesting match = entry_not_interesting;
@@ -756,8 +758,9 @@ static int grep_tree(struct grep_opt *opt, const struct pathspec *pathspec,
 		strbuf_add(base, entry.path, te_len);
 
 		if (S_ISREG(entry.mode)) {
-			hit |= grep_oid(opt, entry.oid, base->buf, tn_len,
-					 check_attr ? base->buf + tn_len : NULL);
+			if (!gi || grep_index_may_match(gi, entry.oid))
+				hit |= grep_oid(opt, entry.oid, base->buf, tn_len,
+						check_attr ? base->buf + tn_len : NULL);
 		} else if (S_ISDIR(entry.mode)) {
 			enum object_type type;
 			struct tree_desc sub;
@@ -772,7 +775,7 @@ static int grep_tree(struct grep_opt *opt, const struct pathspec *pathspec,
 			strbuf_addch(base, '/');
 			init_tree_desc(&sub, data, size);
 			hit |= grep_tree(opt, pathspec, &sub, base, tn_len,
-					 check_attr);
+					 check_attr, gi);
 			free(data);
 		} else if (recurse_submodules && S_ISGITLINK(entry.mode)) {
 			hit |= grep_submodule(opt, entry.oid->hash, base->buf,
@@ -796,6 +799,8 @@ static int grep_object(struct grep_opt *opt, const struct pathspec *pathspec,
 		return grep_oid(opt, &obj->oid, name, 0, path);
 	if (obj->type == OBJ_COMMIT || obj->type == OBJ_TREE) {
 		struct tree_desc tree;
+		struct object_id tree_oid;
+		struct grep_index *gi;
 		void *data;
 		unsigned long size;
 		struct strbuf base;
@@ -803,7 +808,7 @@ static int grep_object(struct grep_opt *opt, const struct pathspec *pathspec,
 
 		grep_read_lock();
 		data = read_object_with_reference(obj->oid.hash, tree_type,
-						  &size, NULL);
+						  &size, tree_oid.hash);
 		grep_read_unlock();
 
 		if (!data)
@@ -820,8 +825,10 @@ static int grep_object(struct grep_opt *opt, const struct pathspec *pathspec,
 			strbuf_addch(&base, ':');
 		}
 		init_tree_desc(&tree, data, size);
+		gi = prepare_grep_index(&tree_oid, opt);
 		hit = grep_tree(opt, pathspec, &tree, &base, base.len,
-				obj->type == OBJ_COMMIT);
+				obj->type == OBJ_COMMIT, gi);
+		free_grep_index(gi);
 		strbuf_release(&base);
 		free(data);
 		return hit;
@@ -829,6 +836,26 @@ static int grep_object(struct grep_opt *opt, const struct pathspec *pathspec,
 	die(_("unable to grep from object of type %s"), typename(obj->type));
 }
 
+static int build_grep_indexes(int argc, const char **argv)
+{
+	static const char *head[] = { "HEAD", NULL };
+	int i, ret = 0;
+
+	if (!argc) {
+		argv = head;
+		argc = 1;
+	}
+	for (i = 0; i < argc; i++) {
+		struct object_id oid;
+
+		if (get_oid(argv[i], &oid))
+			die(_("unable to resolve revision: %s"), argv[i]);
+		if (write_grep_index(&oid))
+			ret = 1;
+	}
+	return ret;
+}
+
 static int grep_objects(struct grep_opt *opt, const struct pathspec *pathspec,
 			const struct object_array *list)
 {
@@ -972,6 +999,7 @@ int cmd_grep(int argc, const char **argv, const char *prefix)
 	int i;
 	int dummy;
 	int use_index = 1;
+	int build_index = 0;
 	int pattern_type_arg = GREP_PATTERN_TYPE_UNSPECIFIED;
 	int allow_revs;
 
@@ -1085,6 +1113,8 @@ int cmd_grep(int argc, const char **argv, const char *prefix)
 		{ OPTION_STRING, 'O', "open-files-in-pager", &show_in_pager,
 			N_("pager"), N_("show matching files in the pager"),
 			PARSE_OPT_OPTARG, NULL, (intptr_t)default_pager },
+		OPT_BOOL(0, "build-index", &build_index,
+			 N_("write trigram indexes for the given trees instead of searching")),
 		OPT_BOOL(0, "ext-grep", &external_grep_allowed__ignored,
 			 N_("allow calling of grep(1) (ignored by this build)")),
 		OPT_END()
@@ -1120,6 +1150,16 @@ int cmd_grep(int argc, const char **argv, const char *prefix)
 			setup_git_directory();
 	}
 
+	if (build_index) {
+		if (!use_index || cached || untracked)
+			die(_("--build-index only works on trees"));
+		if (argc > 0 && !strcmp(argv[0], "--")) {
+			argv++;
+			argc--;
+		}
+		return build_grep_indexes(argc, argv);
+	}
+
 	/*
 	 * skip a -- separator; we know it cannot be
 	 * separating revisions from pathnames if
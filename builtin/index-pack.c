@@ -13,7 +13,7 @@
 #include "thread-utils.h"
 
 static const char index_pack_usage[] =
-"git index-pack [-v] [-o <index-file>] [--keep | --keep=<msg>] [--verify] [--strict] (<pack-file> | --stdin [--fix-thin] [<pack-file>])";
+"git index-pack [-v] [-o <index-file>] [--keep | --keep=<msg>] [--verify] [--strict] [--[no-]rev-index] (<pack-file> | --stdin [--fix-thin] [<pack-file>])";
 
 struct object_entry {
 	struct pack_idx_entry idx;
@@ -1385,12 +1385,14 @@ static void fix_unresolved_deltas(struct sha1file *f)
 
 static void final(const char *final_pack_name, const char *curr_pack_name,
 		  const char *final_index_name, const char *curr_index_name,
+		  const char *final_rev_index_name, const char *curr_rev_index_name,
 		  const char *keep_name, const char *keep_msg,
 		  unsigned char *sha1)
 {
 	const char *report = "pack";
 	struct strbuf pack_name = STRBUF_INIT;
 	struct strbuf index_name = STRBUF_INIT;
+	struct strbuf rev_index_name = STRBUF_INIT;
 	struct strbuf keep_name_buf = STRBUF_INIT;
 	int err;
 
@@ -1434,6 +1436,16 @@ static void final(const char *final_pack_name, const char *curr_pack_name,
 	} else if (from_stdin)
 		chmod(final_pack_name, 0444);
 
+	if (curr_rev_index_name) {
+		if (final_rev_index_name != curr_rev_index_name) {
+			if (!final_rev_index_name)
+				final_rev_index_name = odb_pack_name(&rev_index_name, sha1, "rev");
+			if (finalize_object_file(curr_rev_index_name, final_rev_index_name))
+				die(_("cannot store reverse index file"));
+		} else
+			chmod(final_rev_index_name, 0444);
+	}
+
 	if (final_index_name != curr_index_name) {
 		if (!final_index_name)
 			final_index_name = odb_pack_name(&index_name, sha1, "idx");
@@ -1465,6 +1477,7 @@ static void final(const char *final_pack_name, const char *curr_pack_name,
 	}
 
 	strbuf_release(&index_name);
+	strbuf_release(&rev_index_name);
 	strbuf_release(&pack_name);
 	strbuf_release(&keep_name_buf);
 }
@@ -1473,6 +1486,13 @@ static int git_index_pack_config(const char *k, const char *v, void *cb)
 {
 	struct pack_idx_option *opts = cb;
 
+	if (!strcmp(k, "pack.writereverseindex")) {
+		if (git_config_bool(k, v))
+			opts->flags |= WRITE_REV;
+		else
+			opts->flags &= ~WRITE_REV;
+		return 0;
+	}
 	if (!strcmp(k, "pack.indexversion")) {
 		opts->version = git_config_int(k, v);
 		if (opts->version > 2)
@@ -1608,14 +1628,14 @@ static void show_pack_info(int stat_only)
 	}
 }
 
-static const char *derive_filename(const char *pack_name, const char *suffix,
-				   struct strbuf *buf)
+static const char *derive_filename(const char *name, const char *strip,
+				   const char *suffix, struct strbuf *buf)
 {
 	size_t len;
-	if (!strip_suffix(pack_name, ".pack", &len))
-		die(_("packfile name '%s' does not end with '.pack'"),
-		    pack_name);
-	strbuf_add(buf, pack_name, len);
+	if (!strip_suffix(name, strip, &len))
+		die(_("packfile name '%s' does not end with '%s'"),
+		    name, strip);
+	strbuf_add(buf, name, len);
 	strbuf_addstr(buf, suffix);
 	return buf->buf;
 }
@@ -1623,10 +1643,12 @@ static const char *derive_filename(const char *pack_name, const char *suffix,
 int cmd_index_pack(int argc, const char **argv, const char *prefix)
 {
 	int i, fix_thin_pack = 0, verify = 0, stat_only = 0;
-	const char *curr_index;
+	const char *curr_index, *curr_rev_index = NULL;
 	const char *index_name = NULL, *pack_name = NULL;
+	const char *rev_index_name = NULL;
 	const char *keep_name = NULL, *keep_msg = NULL;
 	struct strbuf index_name_buf = STRBUF_INIT,
+		      rev_index_name_buf = STRBUF_INIT,
 		      keep_name_buf = STRBUF_INIT;
 	struct pack_idx_entry **idx_objects;
 	struct pack_idx_option opts;
@@ -1663,6 +1685,10 @@ int cmd_index_pack(int argc, const char **argv, const char *prefix)
 			} else if (!strcmp(arg, "--check-self-contained-and-connected")) {
 				strict = 1;
 				check_self_contained_and_connected = 1;
+			} else if (!strcmp(arg, "--rev-index")) {
+				opts.flags |= WRITE_REV;
+			} else if (!strcmp(arg, "--no-rev-index")) {
+				opts.flags &= ~WRITE_REV;
 			} else if (!strcmp(arg, "--verify")) {
 				verify = 1;
 			} else if (!strcmp(arg, "--verify-stat")) {
@@ -1738,9 +1764,21 @@ int cmd_index_pack(int argc, const char **argv, const char *prefix)
 	if (from_stdin && !startup_info->have_repository)
 		die(_("--stdin requires a git repository"));
 	if (!index_name && pack_name)
-		index_name = derive_filename(pack_name, ".idx", &index_name_buf);
+		index_name = derive_filename(pack_name, ".pack", ".idx", &index_name_buf);
 	if (keep_msg && !keep_name && pack_name)
-		keep_name = derive_filename(pack_name, ".keep", &keep_name_buf);
+		keep_name = derive_filename(pack_name, ".pack", ".keep", &keep_name_buf);
+	/*
+	 * The .rev file is looked for next to the pack, wherever "-o"
+	 * puts the .idx; without a pack name, final() puts both pack
+	 * and .rev into the object directory.
+	 */
+	if ((opts.flags & WRITE_REV) && pack_name) {
+		if (ends_with(pack_name, ".pack"))
+			rev_index_name = derive_filename(pack_name, ".pack", ".rev",
+							 &rev_index_name_buf);
+		else
+			opts.flags &= ~WRITE_REV;
+	}
 
 	if (verify) {
 		if (!index_name)
@@ -1783,22 +1821,29 @@ int cmd_index_pack(int argc, const char **argv, const char *prefix)
 	for (i = 0; i < nr_objects; i++)
 		idx_objects[i] = &objects[i].idx;
 	curr_index = write_idx_file(index_name, idx_objects, nr_objects, &opts, pack_sha1);
+	if ((opts.flags & WRITE_REV) && !verify)
+		curr_rev_index = write_rev_file(rev_index_name, idx_objects,
+						nr_objects, pack_sha1);
 	free(idx_objects);
 
 	if (!verify)
 		final(pack_name, curr_pack,
 		      index_name, curr_index,
+		      rev_index_name, curr_rev_index,
 		      keep_name, keep_msg,
 		      pack_sha1);
 	else
 		close(input_fd);
 	free(objects);
 	strbuf_release(&index_name_buf);
+	strbuf_release(&rev_index_name_buf);
 	strbuf_release(&keep_name_buf);
 	if (pack_name == NULL)
 		free((void *) curr_pack);
 	if (index_name == NULL)
 		free((void *) curr_index);
+	if (rev_index_name == NULL)
+		free((void *) curr_rev_index);
 
 	/*
 	 * Let the caller know this pack is not self contained
@@ -26,6 +26,8 @@
 #include "version.h"
 #include "mailmap.h"
 #include "gpg-interface.h"
+#include "notes-cache.h"
+#include "tree-diff-cache.h"
 
 /* Set a default date-time format for git log ("log.date" config variable) */
 static const char *default_date_mode = NULL;
@@ -34,6 +36,7 @@ static int default_abbrev_commit;
 static int default_show_root = 1;
 static int default_follow;
 static int default_show_signature;
+static int default_diff_cache;
 static int decoration_style;
 static int decoration_given;
 static int use_mailmap_config;
@@ -208,6 +211,9 @@ static void cmd_log_init_finish(int argc, const char **argv, const char *prefix,
 	if (rev->line_level_traverse)
 		line_log_init(rev, line_cb.prefix, &line_cb.args);
 
+	if (default_diff_cache && rev->diff)
+		rev->tree_diff_cache = init_tree_diff_cache();
+
 	setup_pager();
 }
 
@@ -383,6 +389,9 @@ static int cmd_log_walk(struct rev_info *rev)
 	rev->diffopt.needed_rename_limit = saved_nrl;
 	if (close_file)
 		fclose(rev->diffopt.file);
+	if (rev->tree_diff_cache &&
+	    notes_cache_write(rev->tree_diff_cache))
+		warning(_("unable to write the tree diff cache"));
 
 	if (rev->diffopt.output_format & DIFF_FORMAT_CHECKDIFF &&
 	    DIFF_OPT_TST(&rev->diffopt, CHECK_FAILED)) {
@@ -431,6 +440,10 @@ static int git_log_config(const char *var, const char *value, void *cb)
 		default_show_signature = git_config_bool(var, value);
 		return 0;
 	}
+	if (!strcmp(var, "log.diffcache")) {
+		default_diff_cache = git_config_bool(var, value);
+		return 0;
+	}
 
 	if (grep_config(var, value, cb) < 0)
 		return -1;
@@ -578,6 +578,7 @@ int cmd_ls_files(int argc, const char **argv, const char *cmd_prefix)
 	super_prefix = get_super_prefix();
 	git_config(git_default_config, NULL);
 
+	the_index.read_only = 1;
 	if (read_cache() < 0)
 		die("index file corrupt");
 
@@ -350,7 +350,7 @@ static off_t write_reuse_object(struct sha1file *f, struct object_entry *entry,
 {
 	struct packed_git *p = entry->in_pack;
 	struct pack_window *w_curs = NULL;
-	struct revindex_entry *revidx;
+	int pos;
 	off_t offset;
 	enum object_type type = entry->type;
 	off_t datalen;
@@ -365,10 +365,14 @@ static off_t write_reuse_object(struct sha1file *f, struct object_entry *entry,
 					      type, entry->size);
 
 	offset = entry->in_pack_offset;
-	revidx = find_pack_revindex(p, offset);
-	datalen = revidx[1].offset - offset;
+	pos = find_revindex_position(p, offset);
+	if (pos < 0)
+		die("BUG: no object at the offset of %s in its pack",
+		    sha1_to_hex(entry->idx.sha1));
+	datalen = pack_pos_to_offset(p, pos + 1) - offset;
 	if (!pack_to_stdout && p->index_version > 1 &&
-	    check_pack_crc(p, &w_curs, offset, datalen, revidx->nr)) {
+	    check_pack_crc(p, &w_curs, offset, datalen,
+			   pack_pos_to_index(p, pos))) {
 		error("bad packed object CRC for %s", sha1_to_hex(entry->idx.sha1));
 		unuse_pack(&w_curs);
 		return write_no_reuse_object(f, entry, limit, usable_delta);
@@ -1445,11 +1449,11 @@ static void check_object(struct object_entry *entry)
 				goto give_up;
 			}
 			if (reuse_delta && !entry->preferred_base) {
-				struct revindex_entry *revidx;
-				revidx = find_pack_revindex(p, ofs);
-				if (!revidx)
+				int pos = find_revindex_position(p, ofs);
+				if (pos < 0)
 					goto give_up;
-				base_ref = nth_packed_object_sha1(p, revidx->nr);
+				base_ref = nth_packed_object_sha1(p,
+						pack_pos_to_index(p, pos));
 			}
 			entry->in_pack_header_size = used + used_0;
 			break;
@@ -2462,6 +2466,12 @@ static int git_pack_config(const char *k, const char *v, void *cb)
 		else
 			write_bitmap_options &= ~BITMAP_OPT_HASH_CACHE;
 	}
+	if (!strcmp(k, "pack.writebitmaplookuptable")) {
+		if (git_config_bool(k, v))
+			write_bitmap_options |= BITMAP_OPT_LOOKUP_TABLE;
+		else
+			write_bitmap_options &= ~BITMAP_OPT_LOOKUP_TABLE;
+	}
 	if (!strcmp(k, "pack.usebitmaps")) {
 		use_bitmap_index_default = git_config_bool(k, v);
 		return 0;
@@ -2477,6 +2487,13 @@ static int git_pack_config(const char *k, const char *v, void *cb)
 #endif
 		return 0;
 	}
+	if (!strcmp(k, "pack.writereverseindex")) {
+		if (git_config_bool(k, v))
+			pack_idx_opts.flags |= WRITE_REV;
+		else
+			pack_idx_opts.flags &= ~WRITE_REV;
+		return 0;
+	}
 	if (!strcmp(k, "pack.indexversion")) {
 		pack_idx_opts.version = git_config_int(k, v);
 		if (pack_idx_opts.version > 2)
@@ -110,7 +110,7 @@ static void get_non_kept_pack_filenames(struct string_list *fname_list)
 
 static void remove_redundant_pack(const char *dir_name, const char *base_name)
 {
-	const char *exts[] = {".pack", ".idx", ".keep", ".bitmap"};
+	const char *exts[] = {".pack", ".idx", ".keep", ".bitmap", ".rev"};
 	int i;
 	struct strbuf buf = STRBUF_INIT;
 	size_t plen;
@@ -136,6 +136,7 @@ int cmd_repack(int argc, const char **argv, const char *prefix)
 		unsigned optional:1;
 	} exts[] = {
 		{".pack"},
+		{".rev", 1},
 		{".idx"},
 		{".bitmap", 1},
 	};
@@ -44,6 +44,7 @@ static const char rev_list_usage[] =
 "    --abbrev-commit\n"
 "    --left-right\n"
 "    --count\n"
+"    --disk-usage\n"
 "  special purpose:\n"
 "    --bisect\n"
 "    --bisect-vars\n"
@@ -53,6 +54,19 @@ static const char rev_list_usage[] =
 static struct progress *progress;
 static unsigned progress_counter;
 
+static int show_disk_usage;
+static off_t total_disk_usage;
+
+static off_t get_object_disk_usage(struct object *obj)
+{
+	off_t size;
+	struct object_info oi = OBJECT_INFO_INIT;
+	oi.disk_sizep = &size;
+	if (sha1_object_info_extended(obj->oid.hash, &oi, 0) < 0)
+		die(_("unable to get disk usage of %s"), oid_to_hex(&obj->oid));
+	return size;
+}
+
 static void finish_commit(struct commit *commit, void *data);
 static void show_commit(struct commit *commit, void *data)
 {
@@ -61,6 +75,9 @@ static void show_commit(struct commit *commit, void *data)
 
 	display_progress(progress, ++progress_counter);
 
+	if (show_disk_usage)
+		total_disk_usage += get_object_disk_usage(&commit->object);
+
 	if (info->flags & REV_LIST_QUIET) {
 		finish_commit(commit, data);
 		return;
@@ -187,10 +204,25 @@ static void finish_object(struct object *obj, const char *name, void *cb_data)
 static void show_object(struct object *obj, const char *name, void *cb_data)
 {
 	struct rev_list_info *info = cb_data;
+	struct rev_info *revs = info->revs;
+
 	finish_object(obj, name, cb_data);
 	display_progress(progress, ++progress_counter);
+	if (show_disk_usage)
+		total_disk_usage += get_object_disk_usage(obj);
 	if (info->flags & REV_LIST_QUIET)
 		return;
+
+	if (revs->count) {
+		/*
+		 * Objects are only counted without --left-right and
+		 * --cherry-mark (see cmd_rev_list()), so they all go
+		 * to count_right, like the commits do.
+		 */
+		revs->count_right++;
+		return;
+	}
+
 	show_object_with_name(stdout, obj, name);
 }
 
@@ -266,6 +298,114 @@ static int show_object_fast(
 	return 1;
 }
 
+/*
+ * The bitmap walk yields all the objects that are reachable from the
+ * positive tips and not from the negative ones; it knows nothing of the
+ * options that drop individual commits from that set.
+ */
+static int bitmap_walk_is_exact(struct rev_info *revs)
+{
+	return !revs->prune &&
+		!revs->no_walk &&
+		revs->max_age == -1 &&
+		revs->min_age == -1 &&
+		revs->skip_count <= 0 &&
+		revs->min_parents == 0 &&
+		revs->max_parents == -1 &&
+		!revs->first_parent_only &&
+		!revs->ancestry_path &&
+		!revs->bisect &&
+		!revs->unpacked &&
+		!revs->left_only &&
+		!revs->right_only &&
+		!revs->cherry_pick &&
+		!revs->boundary &&
+		!revs->reflog_info &&
+		!revs->grep_filter.pattern_list &&
+		!revs->grep_filter.header_list;
+}
+
+static int try_bitmap_count(struct rev_info *revs)
+{
+	uint32_t commit_count = 0, tag_count = 0, tree_count = 0, blob_count = 0;
+	int max_count;
+
+	/* This function only handles counting, not general traversal. */
+	if (!revs->count)
+		return -1;
+
+	/*
+	 * A bitmap result can't know left/right, etc, because we don't
+	 * actually traverse.
+	 */
+	if (revs->left_right || revs->cherry_mark)
+		return -1;
+
+	/*
+	 * If we're counting reachable objects, we can't handle a max count
+	 * of commits to traverse, since we don't know which objects go with
+	 * which commit.
+	 */
+	if (revs->max_count >= 0 &&
+	    (revs->tag_objects || revs->tree_objects || revs->blob_objects))
+		return -1;
+
+	/*
+	 * This must be saved before doing any walking, since the revision
+	 * machinery will count it down to zero while traversing.
+	 */
+	max_count = revs->max_count;
+
+	if (prepare_bitmap_walk(revs) < 0)
+		return -1;
+
+	count_bitmap_commit_list(&commit_count,
+				 revs->tree_objects ? &tree_count : NULL,
+				 revs->blob_objects ? &blob_count : NULL,
+				 revs->tag_objects ? &tag_count : NULL);
+	if (max_count >= 0 && max_count < commit_count)
+		commit_count = max_count;
+
+	printf("%d\n", commit_count + tree_count + blob_count + tag_count);
+	return 0;
+}
+
+static int try_bitmap_disk_usage(struct rev_info *revs)
+{
+	if (!show_disk_usage || revs->max_count >= 0)
+		return -1;
+
+	if (prepare_bitmap_walk(revs) < 0)
+		return -1;
+
+	printf("%"PRIuMAX"\n",
+	       (uintmax_t)get_disk_usage_from_bitmap(revs));
+	return 0;
+}
+
+static int try_bitmap_traversal(struct rev_info *revs)
+{
+	/*
+	 * We can't use a bitmap result with a traversal limit, since the
+	 * set of commits we'd get would be essentially random.
+	 */
+	if (revs->max_count >= 0)
+		return -1;
+
+	/*
+	 * Our bitmap result will return all objects, and we're not
+	 * yet prepared to show only particular types.
+	 */
+	if (!revs->tag_objects || !revs->tree_objects || !revs->blob_objects)
+		return -1;
+
+	if (prepare_bitmap_walk(revs) < 0)
+		return -1;
+
+	traverse_bitmap_commit_list(&show_object_fast);
+	return 0;
+}
+
 int cmd_rev_list(int argc, const char **argv, const char *prefix)
 {
 	struct rev_info revs;
@@ -317,6 +457,11 @@ int cmd_rev_list(int argc, const char **argv, const char *prefix)
 			bisect_show_vars = 1;
 			continue;
 		}
+		if (!strcmp(arg, "--disk-usage")) {
+			show_disk_usage = 1;
+			info.flags |= REV_LIST_QUIET;
+			continue;
+		}
 		if (!strcmp(arg, "--use-bitmap-index")) {
 			use_bitmap_index = 1;
 			continue;
@@ -353,6 +498,14 @@ int cmd_rev_list(int argc, const char **argv, const char *prefix)
 	if (revs.show_notes)
 		die(_("rev-list does not support display of notes"));
 
+	if (revs.count &&
+	    (revs.tag_objects || revs.tree_objects || revs.blob_objects) &&
+	    (revs.left_right || revs.cherry_mark))
+		die(_("marked counting is incompatible with --objects"));
+
+	if (revs.count && show_disk_usage)
+		die(_("--count cannot be combined with --disk-usage"));
+
 	save_commit_buffer = (revs.verbose_header ||
 			      revs.grep_filter.pattern_list ||
 			      revs.grep_filter.header_list);
@@ -362,24 +515,19 @@ int cmd_rev_list(int argc, const char **argv, const char *prefix)
 	if (show_progress)
 		progress = start_progress_delay(show_progress, 0, 0, 2);
 
-	if (use_bitmap_index && !revs.prune) {
-		if (revs.count && !revs.left_right && !revs.cherry_mark) {
-			uint32_t commit_count;
-			int max_count = revs.max_count;
-			if (!prepare_bitmap_walk(&revs)) {
-				count_bitmap_commit_list(&commit_count, NULL, NULL, NULL);
-				if (max_count >= 0 && max_count < commit_count)
-					commit_count = max_count;
-				printf("%d\n", commit_count);
-				return 0;
-			}
-		} else if (revs.max_count < 0 &&
-			   revs.tag_objects && revs.tree_objects && revs.blob_objects) {
-			if (!prepare_bitmap_walk(&revs)) {
-				traverse_bitmap_commit_list(&show_object_fast);
-				return 0;
-			}
-		}
+	/*
+	 * Only one of these may get as far as prepare_bitmap_walk(), which
+	 * cannot be undone once it succeeds: --count excludes the other
+	 * two, and --disk-usage is quiet.  Bisection needs the commits.
+	 */
+	if (use_bitmap_index && !bisect_list && bitmap_walk_is_exact(&revs)) {
+		if (!try_bitmap_count(&revs))
+			return 0;
+		if (!revs.count && !try_bitmap_disk_usage(&revs))
+			return 0;
+		if (!revs.count && !show_disk_usage &&
+		    !try_bitmap_traversal(&revs))
+			return 0;
 	}
 
 	if (prepare_revision_walk(&revs))
@@ -412,5 +560,8 @@ int cmd_rev_list(int argc, const char **argv, const char *prefix)
 			printf("%d\n", revs.count_left + revs.count_right);
 	}
 
+	if (show_disk_usage)
+		printf("%"PRIuMAX"\n", (uintmax_t)total_disk_usage);
+
 	return 0;
 }
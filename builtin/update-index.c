@@ -914,6 +914,7 @@ int cmd_update_index(int argc, const char **argv, const char *prefix)
 	struct refresh_params refresh_args = {0, &has_errors};
 	int lock_error = 0;
 	int split_index = -1;
+	int rewrite_shared = 0;
 	struct lock_file *lock_file;
 	struct parse_opt_ctx_t ctx;
 	strbuf_getline_fn getline_fn;
@@ -999,6 +1000,8 @@ int cmd_update_index(int argc, const char **argv, const char *prefix)
 			N_("write index in this format")),
 		OPT_BOOL(0, "split-index", &split_index,
 			N_("enable or disable split index")),
+		OPT_BOOL(0, "rewrite-shared-index", &rewrite_shared,
+			N_("move the changes of a split index to a new shared index")),
 		OPT_BOOL(0, "untracked-cache", &untracked_cache,
 			N_("enable/disable untracked cache")),
 		OPT_SET_INT(0, "test-untracked-cache", &untracked_cache,
@@ -1007,12 +1010,33 @@ int cmd_update_index(int argc, const char **argv, const char *prefix)
 			    N_("enable untracked cache without testing the filesystem"), UC_FORCE),
 		OPT_END()
 	};
+	struct option rewrite_options[] = {
+		OPT_BOOL(0, "rewrite-shared-index", &rewrite_shared,
+			N_("move the changes of a split index to a new shared index")),
+		OPT_END()
+	};
 
 	if (argc == 2 && !strcmp(argv[1], "-h"))
 		usage_with_options(update_index_usage, options);
 
 	git_config(git_default_config, NULL);
 
+	/*
+	 * --rewrite-shared-index must not hold the index lock while it
+	 * writes the shared index, and takes it only at the end, so it
+	 * is picked out and done before we lock the index for the rest.
+	 */
+	argc = parse_options(argc, argv, prefix, rewrite_options,
+			     update_index_usage,
+			     PARSE_OPT_KEEP_ARGV0 | PARSE_OPT_KEEP_UNKNOWN |
+			     PARSE_OPT_KEEP_DASHDASH | PARSE_OPT_NO_INTERNAL_HELP);
+	if (rewrite_shared) {
+		if (rewrite_shared_index(get_index_file()))
+			return 1;
+		if (argc == 1)
+			return 0;
+	}
+
 	/* We can't free this memory, it becomes part of a linked list parsed atexit() */
 	lock_file = xcalloc(1, sizeof(struct lock_file));
 
@@ -97,6 +97,28 @@ struct cache_tree_sub *cache_tree_sub(struct cache_tree *it, const char *path)
 	return find_subtree(it, path, pathlen, 1);
 }
 
+struct cache_tree *cache_tree_path(struct cache_tree *it,
+				   const char *path, int pathlen, int create)
+{
+	const char *end = path + pathlen;
+
+	while (it && path < end) {
+		const char *slash = memchr(path, '/', end - path);
+		struct cache_tree_sub *sub;
+
+		if (!slash)
+			slash = end;
+		sub = find_subtree(it, path, slash - path, create);
+		if (!sub)
+			return NULL;
+		if (!sub->cache_tree && create)
+			sub->cache_tree = cache_tree();
+		it = sub->cache_tree;
+		path = slash + 1;
+	}
+	return it;
+}
+
 static int do_invalidate_path(struct cache_tree *it, const char *path)
 {
 	/* a/b/c
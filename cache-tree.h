@@ -26,6 +26,14 @@ void cache_tree_free(struct cache_tree **);
 void cache_tree_invalidate_path(struct index_state *, const char *);
 struct cache_tree_sub *cache_tree_sub(struct cache_tree *, const char *);
 
+/*
+ * Return the node for the directory "path" (pathlen bytes, without a
+ * trailing slash) below "it", or NULL if there is none.  With
+ * "create", missing nodes are added as invalid ones instead.
+ */
+struct cache_tree *cache_tree_path(struct cache_tree *it,
+				   const char *path, int pathlen, int create);
+
 void cache_tree_write(struct strbuf *, struct cache_tree *root);
 struct cache_tree *cache_tree_read(const char *buffer, unsigned long size);
 
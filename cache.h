@@ -327,6 +327,7 @@ static inline unsigned int canon_mode(unsigned int mode)
 
 struct split_index;
 struct untracked_cache;
+struct arena;
 
 struct index_state {
 	struct cache_entry **cache;
@@ -337,11 +338,21 @@ struct index_state {
 	struct split_index *split_index;
 	struct cache_time timestamp;
 	unsigned name_hash_initialized : 1,
-		 initialized : 1;
+		 initialized : 1,
+		 read_only : 1,
+		 ce_arena_only : 1;
 	struct hashmap name_hash;
 	struct hashmap dir_hash;
 	unsigned char sha1[20];
 	struct untracked_cache *untracked;
+	/*
+	 * When read_only is set before the index is read, its entries
+	 * are allocated from ce_arena in bulk.  The caller promises
+	 * not to free() them; the index API releases them through
+	 * free_cache_entry(), and discard_index() all at once.
+	 * ce_arena_only is set as long as all entries come from it.
+	 */
+	struct arena *ce_arena;
 };
 
 extern struct index_state the_index;
@@ -596,7 +607,14 @@ extern int read_index_unmerged(struct index_state *);
 #define COMMIT_LOCK		(1 << 0)
 #define CLOSE_LOCK		(1 << 1)
 extern int write_locked_index(struct index_state *, struct lock_file *lock, unsigned flags);
+/*
+ * If the index at path is a split index with entries of its own, move
+ * them all to a new shared index.  The index is only locked briefly at
+ * the end, and is left alone if it has been written in the meantime.
+ */
+extern int rewrite_shared_index(const char *path);
 extern int discard_index(struct index_state *);
+extern void free_cache_entry(struct cache_entry *ce);
 extern int unmerged_index(const struct index_state *);
 extern int verify_path(const char *path);
 extern int strcmp_offset(const char *s1, const char *s2, size_t *first_change);
@@ -760,6 +778,7 @@ extern int check_replace_refs;
 extern char *git_replace_ref_base;
 
 extern int fsync_object_files;
+extern int use_loose_object_cache;
 extern int core_preload_index;
 extern int core_apply_sparse_checkout;
 extern int precomposed_unicode;
@@ -1213,6 +1232,38 @@ static inline void *read_sha1_file(const unsigned char *sha1, enum object_type *
 	return read_sha1_file_extended(sha1, type, size, LOOKUP_REPLACE_OBJECT);
 }
 
+/*
+ * Read many objects whose names are known in advance. Reading the
+ * objects of a batch one by one resolves each delta chain separately,
+ * and only the delta base cache avoids applying the same deltas over
+ * and over. prepare_object_batch() instead looks at the delta chains of
+ * all the packed objects up front, so that a base shared by several of
+ * them is reconstructed once and kept (up to core.deltaBaseCacheLimit
+ * bytes) only until the last of them has been read.
+ *
+ * read_object_batch() behaves like read_sha1_file(), in whatever order
+ * the objects are asked for; names outside of the batch, or a NULL
+ * batch, are simply read with read_sha1_file(). When the order does not
+ * matter, for_each_object_in_batch() calls fn for each distinct object
+ * of the batch in the order they are stored in the packs, which avoids
+ * seeking back and forth, and stops early when fn returns non-zero.
+ * for_each_object_in_pack_order() does the same for the distinct names
+ * in oids without preparing to read them, for callers that only look
+ * at the type or size of the objects.
+ */
+struct oid_array;
+struct object_batch;
+extern struct object_batch *prepare_object_batch(const struct oid_array *oids);
+extern void *read_object_batch(struct object_batch *batch,
+			       const unsigned char *sha1,
+			       enum object_type *type, unsigned long *size);
+typedef int each_batch_object_fn(const struct object_id *oid, void *data);
+extern int for_each_object_in_batch(struct object_batch *batch,
+				    each_batch_object_fn fn, void *data);
+extern int for_each_object_in_pack_order(const struct oid_array *oids,
+					 each_batch_object_fn fn, void *data);
+extern void free_object_batch(struct object_batch *batch);
+
 /*
  * This internal function is only declared here for the benefit of
  * lookup_replace_object().  Please do not call it directly.
@@ -1294,6 +1345,17 @@ static inline int has_sha1_file(const unsigned char *sha1)
 extern int has_object_file(const struct object_id *oid);
 extern int has_object_file_with_flags(const struct object_id *oid, int flags);
 
+/*
+ * Check the existence of many objects at once, setting exists[i] to
+ * true iff has_object_file_with_flags(&oids->oid[i], flags) would
+ * return true. This sorts a copy of the batch and walks each pack index
+ * and each loose object directory once, which is much cheaper than
+ * looking the objects up one by one when there are many of them.
+ */
+struct oid_array;
+extern void has_object_files(const struct oid_array *oids, char *exists,
+			     int flags);
+
 /*
  * Return true iff an alternate object database has a loose object
  * with the specified name.  This function does not respect replace
@@ -1579,6 +1641,9 @@ extern struct alternate_object_database {
 	struct strbuf scratch;
 	size_t base_len;
 
+	/* see struct loose_object_cache in sha1_file.c */
+	struct loose_object_cache *loose_cache;
+
 	char path[FLEX_ARRAY];
 } *alt_odb_list;
 extern void prepare_alt_odb(void);
@@ -1641,6 +1706,12 @@ extern struct packed_git {
 		 do_not_close:1;
 	unsigned char sha1[20];
 	struct revindex_entry *revindex;
+	/* the mapped .rev file, and its table of index positions */
+	const void *revindex_map;
+	size_t revindex_size;
+	const uint32_t *revindex_data;
+	/* for GIT_TRACE_DELTA_BASE_CACHE */
+	unsigned long delta_base_hits, delta_base_misses;
 	/* something like ".git/objects/pack/xxxxx.pack" */
 	char pack_name[FLEX_ARRAY]; /* more */
 } *packed_git;
@@ -1668,6 +1739,13 @@ extern void (*report_garbage)(unsigned seen_bits, const char *path);
 
 extern void prepare_packed_git(void);
 extern void reprepare_packed_git(void);
+
+/*
+ * Forget the loose object directories read for core.looseObjectCache, for
+ * when another process may have written loose objects.
+ */
+extern void invalidate_loose_object_cache(void);
+
 extern void install_packed_git(struct packed_git *pack);
 
 /*
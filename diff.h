@@ -17,6 +17,7 @@ struct userdiff_driver;
 struct oid_array;
 struct commit;
 struct combine_diff_path;
+struct rename_cache;
 
 typedef int (*pathchange_fn_t)(struct diff_options *options,
 		 struct combine_diff_path *path);
@@ -143,6 +144,8 @@ struct diff_options {
 	int needed_rename_limit;
 	int degraded_cc_to_c;
 	int show_rename_progress;
+	/* inexact renames found before, see rename-cache.h */
+	struct rename_cache *rename_cache;
 	int dirstat_permille;
 	int setup;
 	int abbrev;
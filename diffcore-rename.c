@@ -6,6 +6,7 @@
 #include "diffcore.h"
 #include "hashmap.h"
 #include "progress.h"
+#include "rename-cache.h"
 
 /* Table of rename/copy destinations */
 
@@ -129,7 +130,8 @@ struct diff_score {
 
 static int estimate_similarity(struct diff_filespec *src,
 			       struct diff_filespec *dst,
-			       int minimum_score)
+			       int minimum_score,
+			       struct rename_cache *cache)
 {
 	/* src points at a file that existed in the original tree (or
 	 * optionally a file in the destination tree) and dst points
@@ -143,6 +145,8 @@ static int estimate_similarity(struct diff_filespec *src,
 	 * When there is an exact match, it is considered a better
 	 * match than anything else; the destination does not even
 	 * call into this function in that case.
+	 *
+	 * A score found in the cache is as good as one computed here.
 	 */
 	unsigned long max_size, delta_size, base_size, src_copied, literal_added;
 	int score;
@@ -154,6 +158,12 @@ static int estimate_similarity(struct diff_filespec *src,
 	if (!S_ISREG(src->mode) || !S_ISREG(dst->mode))
 		return 0;
 
+	if (cache && src->oid_valid && dst->oid_valid) {
+		score = rename_cache_lookup(cache, &dst->oid, &src->oid);
+		if (score >= 0)
+			return score;
+	}
+
 	/*
 	 * Need to check that source and destination sizes are
 	 * filled in before comparing them.
@@ -202,6 +212,8 @@ static int estimate_similarity(struct diff_filespec *src,
 		score = 0; /* should not happen */
 	else
 		score = (int)(src_copied * MAX_SCORE / max_size);
+	if (cache && src->oid_valid && dst->oid_valid)
+		rename_cache_add(cache, &dst->oid, &src->oid, score);
 	return score;
 }
 
@@ -448,6 +460,7 @@ void diffcore_rename(struct diff_options *options)
 	struct diff_queue_struct *q = &diff_queued_diff;
 	struct diff_queue_struct outq;
 	struct diff_score *mx;
+	struct rename_cache *cache = NULL;
 	int i, j, rename_count, skip_unmodified = 0;
 	int num_create, dst_cnt;
 	struct progress *progress = NULL;
@@ -537,6 +550,9 @@ void diffcore_rename(struct diff_options *options)
 				rename_dst_nr * rename_src_nr, 50, 1);
 	}
 
+	if (detect_rename == DIFF_DETECT_RENAME)
+		cache = options->rename_cache;
+
 	mx = xcalloc(st_mult(NUM_CANDIDATE_PER_DST, num_create), sizeof(*mx));
 	for (dst_cnt = i = 0; i < rename_dst_nr; i++) {
 		struct diff_filespec *two = rename_dst[i].two;
@@ -558,7 +574,8 @@ void diffcore_rename(struct diff_options *options)
 				continue;
 
 			this_src.score = estimate_similarity(one, two,
-							     minimum_score);
+							     minimum_score,
+							     cache);
 			this_src.name_score = basename_same(one, two);
 			this_src.dst = i;
 			this_src.src = j;
@@ -16,6 +16,7 @@
 #include "utf8.h"
 #include "varint.h"
 #include "ewah/ewok.h"
+#include "thread-utils.h"
 
 /*
  * Tells read_directory_recursive how a file or directory should be treated.
@@ -44,10 +45,39 @@ struct cached_dir {
 	struct untracked_cache_dir *ucd;
 };
 
+struct subdir_jobs;
+
 static enum path_treatment read_directory_recursive(struct dir_struct *dir,
 	const char *path, int len, struct untracked_cache_dir *untracked,
-	int check_only, const struct pathspec *pathspec);
+	int check_only, const struct pathspec *pathspec,
+	struct subdir_jobs *defer);
 static int get_dtype(struct dirent *de, const char *path, int len);
+static void free_exclude_matcher(struct exclude_matcher *m);
+
+#ifndef NO_PTHREADS
+/*
+ * Serializes the parts of the traversal that touch global state (the
+ * object store, the submodule ref caches) while subdirectories are
+ * scanned by several threads; see read_directory_parallel().
+ */
+static int read_dir_use_threads;
+static pthread_mutex_t read_dir_mutex;
+
+static inline void read_dir_lock(void)
+{
+	if (read_dir_use_threads)
+		pthread_mutex_lock(&read_dir_mutex);
+}
+
+static inline void read_dir_unlock(void)
+{
+	if (read_dir_use_threads)
+		pthread_mutex_unlock(&read_dir_mutex);
+}
+#else
+#define read_dir_lock()
+#define read_dir_unlock()
+#endif
 
 int fspathcmp(const char *a, const char *b)
 {
@@ -601,7 +631,9 @@ static void *read_skip_worktree_file_from_index(const char *path, size_t *size,
 		return NULL;
 	if (!ce_skip_worktree(active_cache[pos]))
 		return NULL;
+	read_dir_lock();
 	data = read_sha1_file(active_cache[pos]->oid.hash, &type, &sz);
+	read_dir_unlock();
 	if (!data || type != OBJ_BLOB) {
 		free(data);
 		return NULL;
@@ -626,6 +658,7 @@ void clear_exclude_list(struct exclude_list *el)
 		free(el->excludes[i]);
 	free(el->excludes);
 	free(el->filebuf);
+	free_exclude_matcher(el->matcher);
 
 	memset(el, 0, sizeof(*el));
 }
@@ -948,6 +981,369 @@ int match_pathname(const char *pathname, int pathlen,
 				 WM_PATHNAME) == 0;
 }
 
+static int exclude_matches(struct exclude *x, const char *pathname,
+			   int pathlen, const char *basename, int *dtype)
+{
+	if (x->flags & EXC_FLAG_MUSTBEDIR) {
+		if (*dtype == DT_UNKNOWN)
+			*dtype = get_dtype(NULL, pathname, pathlen);
+		if (*dtype != DT_DIR)
+			return 0;
+	}
+
+	if (x->flags & EXC_FLAG_NODIR)
+		return match_basename(basename,
+				      pathlen - (basename - pathname),
+				      x->pattern, x->nowildcardlen,
+				      x->patternlen, x->flags);
+
+	assert(x->baselen == 0 || x->base[x->baselen - 1] == '/');
+	return match_pathname(pathname, pathlen,
+			      x->base, x->baselen ? x->baselen - 1 : 0,
+			      x->pattern, x->nowildcardlen, x->patternlen,
+			      x->flags);
+}
+
+/*
+ * Lists shorter than this are simply scanned, which is cheaper than
+ * the lookups below.
+ */
+#define EXCLUDE_MATCHER_MIN 16
+
+/*
+ * Patterns that can only match one string (a literal basename, a
+ * literal path, or a literal suffix of the basename for "*.o") are
+ * kept in hash tables, keyed by that string.  The others are kept in
+ * a trie keyed by their literal leading part (including the base
+ * directory for those that match against the full path), so that
+ * only the ones whose leading part matches the path are tried with
+ * wildmatch().  Each table entry and trie node lists the positions
+ * of its patterns in the exclude_list in ascending order.
+ */
+struct exclude_positions {
+	int *pos;
+	int nr, alloc;
+};
+
+struct exclude_literal {
+	struct hashmap_entry ent;
+	const char *str;
+	int len;
+	struct exclude_positions positions;
+};
+
+struct exclude_trie {
+	unsigned char c;
+	int nr_children, alloc_children;
+	struct exclude_trie **children;
+	struct exclude_positions positions;
+};
+
+struct exclude_matcher {
+	int nr;			/* number of patterns compiled */
+	int ignore_case;	/* value of ignore_case when compiled */
+	struct hashmap basenames;
+	struct hashmap pathnames;
+	struct hashmap suffixes;
+	int *suffix_lens;	/* the distinct lengths of the suffixes */
+	int nr_suffix_lens, alloc_suffix_lens;
+	struct exclude_trie trie;
+	struct strbuf keys;	/* storage for the keys of "pathnames" */
+};
+
+static unsigned int exclude_hash(const char *str, int len)
+{
+	return ignore_case ? memihash(str, len) : memhash(str, len);
+}
+
+static int exclude_literal_cmp(const void *entry, const void *entry_or_key,
+			       const void *keydata)
+{
+	const struct exclude_literal *a = entry, *b = entry_or_key;
+
+	return a->len != b->len || fspathncmp(a->str, b->str, a->len);
+}
+
+static void add_exclude_position(struct exclude_positions *p, int pos)
+{
+	ALLOC_GROW(p->pos, p->nr + 1, p->alloc);
+	p->pos[p->nr++] = pos;
+}
+
+static struct exclude_literal *find_exclude_literal(struct hashmap *map,
+						    const char *str, int len)
+{
+	struct exclude_literal key;
+
+	hashmap_entry_init(&key, exclude_hash(str, len));
+	key.str = str;
+	key.len = len;
+	return hashmap_get(map, &key, NULL);
+}
+
+static void add_exclude_literal(struct hashmap *map, const char *str, int len,
+				int pos)
+{
+	struct exclude_literal *e = find_exclude_literal(map, str, len);
+
+	if (!e) {
+		e = xcalloc(1, sizeof(*e));
+		hashmap_entry_init(e, exclude_hash(str, len));
+		e->str = str;
+		e->len = len;
+		hashmap_add(map, e);
+	}
+	add_exclude_position(&e->positions, pos);
+}
+
+static inline unsigned char exclude_trie_char(unsigned char c)
+{
+	return ignore_case ? tolower(c) : c;
+}
+
+static struct exclude_trie *exclude_trie_child(struct exclude_trie *node,
+					       unsigned char c)
+{
+	int i;
+
+	for (i = 0; i < node->nr_children; i++)
+		if (node->children[i]->c == c)
+			return node->children[i];
+	return NULL;
+}
+
+static void add_exclude_trie(struct exclude_trie *node, const char *key,
+			     int len, int pos)
+{
+	int i;
+
+	for (i = 0; i < len; i++) {
+		unsigned char c = exclude_trie_char(key[i]);
+		struct exclude_trie *child = exclude_trie_child(node, c);
+
+		if (!child) {
+			child = xcalloc(1, sizeof(*child));
+			child->c = c;
+			ALLOC_GROW(node->children, node->nr_children + 1,
+				   node->alloc_children);
+			node->children[node->nr_children++] = child;
+		}
+		node = child;
+	}
+	add_exclude_position(&node->positions, pos);
+}
+
+static void free_exclude_trie(struct exclude_trie *node)
+{
+	int i;
+
+	for (i = 0; i < node->nr_children; i++) {
+		free_exclude_trie(node->children[i]);
+		free(node->children[i]);
+	}
+	free(node->children);
+	free(node->positions.pos);
+}
+
+static void free_exclude_literals(struct hashmap *map)
+{
+	struct hashmap_iter iter;
+	struct exclude_literal *e;
+
+	hashmap_iter_init(map, &iter);
+	while ((e = hashmap_iter_next(&iter)))
+		free(e->positions.pos);
+	hashmap_free(map, 1);
+}
+
+static void free_exclude_matcher(struct exclude_matcher *m)
+{
+	if (!m)
+		return;
+	free_exclude_literals(&m->basenames);
+	free_exclude_literals(&m->pathnames);
+	free_exclude_literals(&m->suffixes);
+	free(m->suffix_lens);
+	free_exclude_trie(&m->trie);
+	strbuf_release(&m->keys);
+	free(m);
+}
+
+static void add_exclude_suffix(struct exclude_matcher *m, struct exclude *x,
+			       int pos)
+{
+	int i, len = x->patternlen - 1;
+
+	add_exclude_literal(&m->suffixes, x->pattern + 1, len, pos);
+	for (i = 0; i < m->nr_suffix_lens; i++)
+		if (m->suffix_lens[i] == len)
+			return;
+	ALLOC_GROW(m->suffix_lens, m->nr_suffix_lens + 1, m->alloc_suffix_lens);
+	m->suffix_lens[m->nr_suffix_lens++] = len;
+}
+
+static struct exclude_matcher *compile_exclude_list(struct exclude_list *el)
+{
+	struct exclude_matcher *m = xcalloc(1, sizeof(*m));
+	size_t *key_offset;
+	int i;
+
+	m->nr = el->nr;
+	m->ignore_case = ignore_case;
+	hashmap_init(&m->basenames, exclude_literal_cmp, 0);
+	hashmap_init(&m->pathnames, exclude_literal_cmp, 0);
+	hashmap_init(&m->suffixes, exclude_literal_cmp, 0);
+	strbuf_init(&m->keys, 0);
+
+	/*
+	 * The keys of literal paths are the base directory followed by
+	 * the pattern, which are not contiguous in memory; build them
+	 * all first, as "keys" may be reallocated while doing so.
+	 */
+	ALLOC_ARRAY(key_offset, el->nr);
+	for (i = 0; i < el->nr; i++) {
+		struct exclude *x = el->excludes[i];
+
+		key_offset[i] = m->keys.len;
+		if (x->flags & EXC_FLAG_NODIR)
+			continue;
+		strbuf_add(&m->keys, x->base, x->baselen);
+		if (*x->pattern == '/')
+			strbuf_add(&m->keys, x->pattern + 1, x->patternlen - 1);
+		else
+			strbuf_add(&m->keys, x->pattern, x->patternlen);
+	}
+
+	for (i = 0; i < el->nr; i++) {
+		struct exclude *x = el->excludes[i];
+		const char *key = m->keys.buf + key_offset[i];
+		int prefix = x->nowildcardlen;
+
+		if (x->flags & EXC_FLAG_NODIR) {
+			if (prefix == x->patternlen)
+				add_exclude_literal(&m->basenames, x->pattern,
+						    x->patternlen, i);
+			else if (x->flags & EXC_FLAG_ENDSWITH)
+				add_exclude_suffix(m, x, i);
+			else
+				add_exclude_trie(&m->trie, NULL, 0, i);
+			continue;
+		}
+
+		if (*x->pattern == '/')
+			prefix--;
+		if (prefix == x->patternlen - (*x->pattern == '/') && prefix)
+			add_exclude_literal(&m->pathnames, key,
+					    x->baselen + prefix, i);
+		else
+			add_exclude_trie(&m->trie, key, x->baselen + prefix, i);
+	}
+	free(key_offset);
+	return m;
+}
+
+/*
+ * Returns the last position in "p" greater than "best" whose pattern
+ * matches, or "best" if there is none.  With "literal" set, the
+ * patterns are known to match the name, and only the ones that must
+ * match a directory are checked further.
+ */
+static int last_matching_position(struct exclude_list *el,
+				  struct exclude_positions *p, int best,
+				  int literal, const char *pathname,
+				  int pathlen, const char *basename,
+				  int *dtype)
+{
+	int i;
+
+	for (i = p->nr - 1; i >= 0 && p->pos[i] > best; i--) {
+		struct exclude *x = el->excludes[p->pos[i]];
+
+		if (!literal) {
+			if (exclude_matches(x, pathname, pathlen,
+					    basename, dtype))
+				return p->pos[i];
+			continue;
+		}
+		if (x->flags & EXC_FLAG_MUSTBEDIR) {
+			if (*dtype == DT_UNKNOWN)
+				*dtype = get_dtype(NULL, pathname, pathlen);
+			if (*dtype != DT_DIR)
+				continue;
+		}
+		return p->pos[i];
+	}
+	return best;
+}
+
+static int last_literal_match(struct exclude_list *el, struct hashmap *map,
+			      const char *str, int len, int best,
+			      const char *pathname, int pathlen,
+			      const char *basename, int *dtype)
+{
+	struct exclude_literal *e = find_exclude_literal(map, str, len);
+
+	if (!e)
+		return best;
+	return last_matching_position(el, &e->positions, best, 1,
+				      pathname, pathlen, basename, dtype);
+}
+
+static struct exclude *last_exclude_matching_compiled(const char *pathname,
+						      int pathlen,
+						      const char *basename,
+						      int *dtype,
+						      struct exclude_list *el)
+{
+	struct exclude_matcher *m = el->matcher;
+	struct exclude_trie *node = &m->trie;
+	int basenamelen = pathlen - (basename - pathname);
+	int best = -1;
+	int i;
+
+	best = last_literal_match(el, &m->basenames, basename, basenamelen,
+				  best, pathname, pathlen, basename, dtype);
+	best = last_literal_match(el, &m->pathnames, pathname, pathlen,
+				  best, pathname, pathlen, basename, dtype);
+	for (i = 0; i < m->nr_suffix_lens; i++) {
+		int len = m->suffix_lens[i];
+
+		if (len > basenamelen)
+			continue;
+		best = last_literal_match(el, &m->suffixes,
+					  basename + basenamelen - len, len,
+					  best, pathname, pathlen, basename,
+					  dtype);
+	}
+
+	for (i = 0; node; i++) {
+		best = last_matching_position(el, &node->positions, best, 0,
+					      pathname, pathlen, basename,
+					      dtype);
+		if (i == pathlen)
+			break;
+		node = exclude_trie_child(node,
+					  exclude_trie_char(pathname[i]));
+	}
+
+	return best < 0 ? NULL : el->excludes[best];
+}
+
+/*
+ * Build the lookup tables for "el" if it is long enough to be worth
+ * it, or rebuild them if patterns were added since.
+ */
+static void prepare_exclude_matcher(struct exclude_list *el)
+{
+	if (el->nr < EXCLUDE_MATCHER_MIN)
+		return;
+	if (el->matcher && el->matcher->nr == el->nr &&
+	    el->matcher->ignore_case == ignore_case)
+		return;
+	free_exclude_matcher(el->matcher);
+	el->matcher = compile_exclude_list(el);
+}
+
 /*
  * Scan the given exclude list in reverse to see whether pathname
  * should be ignored.  The first match (i.e. the last on the list), if
@@ -960,44 +1356,23 @@ static struct exclude *last_exclude_matching_from_list(const char *pathname,
 						       int *dtype,
 						       struct exclude_list *el)
 {
-	struct exclude *exc = NULL; /* undecided */
 	int i;
 
 	if (!el->nr)
 		return NULL;	/* undefined */
 
+	prepare_exclude_matcher(el);
+	if (el->matcher)
+		return last_exclude_matching_compiled(pathname, pathlen,
+						      basename, dtype, el);
+
 	for (i = el->nr - 1; 0 <= i; i--) {
 		struct exclude *x = el->excludes[i];
-		const char *exclude = x->pattern;
-		int prefix = x->nowildcardlen;
 
-		if (x->flags & EXC_FLAG_MUSTBEDIR) {
-			if (*dtype == DT_UNKNOWN)
-				*dtype = get_dtype(NULL, pathname, pathlen);
-			if (*dtype != DT_DIR)
-				continue;
-		}
-
-		if (x->flags & EXC_FLAG_NODIR) {
-			if (match_basename(basename,
-					   pathlen - (basename - pathname),
-					   exclude, prefix, x->patternlen,
-					   x->flags)) {
-				exc = x;
-				break;
-			}
-			continue;
-		}
-
-		assert(x->baselen == 0 || x->base[x->baselen - 1] == '/');
-		if (match_pathname(pathname, pathlen,
-				   x->base, x->baselen ? x->baselen - 1 : 0,
-				   exclude, prefix, x->patternlen, x->flags)) {
-			exc = x;
-			break;
-		}
+		if (exclude_matches(x, pathname, pathlen, basename, dtype))
+			return x;
 	}
-	return exc;
+	return NULL;
 }
 
 /*
@@ -1361,7 +1736,12 @@ static enum path_treatment treat_directory(struct dir_struct *dir,
 			break;
 		if (!(dir->flags & DIR_NO_GITLINKS)) {
 			unsigned char sha1[20];
-			if (resolve_gitlink_ref(dirname, "HEAD", sha1) == 0)
+			int is_gitlink;
+
+			read_dir_lock();
+			is_gitlink = !resolve_gitlink_ref(dirname, "HEAD", sha1);
+			read_dir_unlock();
+			if (is_gitlink)
 				return path_untracked;
 		}
 		return path_recurse;
@@ -1375,7 +1755,7 @@ static enum path_treatment treat_directory(struct dir_struct *dir,
 	untracked = lookup_untracked(dir->untracked, untracked,
 				     dirname + baselen, len - baselen);
 	return read_directory_recursive(dir, dirname, len,
-					untracked, 1, pathspec);
+					untracked, 1, pathspec, NULL);
 }
 
 /*
@@ -1599,7 +1979,7 @@ static enum path_treatment treat_path_fast(struct dir_struct *dir,
 		 * with check_only set.
 		 */
 		return read_directory_recursive(dir, path->buf, path->len,
-						cdir->ucd, 1, pathspec);
+						cdir->ucd, 1, pathspec, NULL);
 	/*
 	 * We get path_recurse in the first run when
 	 * directory_exists_in_index() returns index_nonexistent. We
@@ -1747,6 +2127,22 @@ static void close_cached_dir(struct cached_dir *cdir)
 	}
 }
 
+struct subdir_jobs {
+	struct subdir_job {
+		char *path;
+		int len;
+	} *job;
+	int nr, alloc;
+};
+
+static void add_subdir_job(struct subdir_jobs *jobs, const char *path, int len)
+{
+	ALLOC_GROW(jobs->job, jobs->nr + 1, jobs->alloc);
+	jobs->job[jobs->nr].path = xmemdupz(path, len);
+	jobs->job[jobs->nr].len = len;
+	jobs->nr++;
+}
+
 /*
  * Read a directory tree. We currently ignore anything but
  * directories, regular files and symlinks. That's because git
@@ -1757,11 +2153,15 @@ static void close_cached_dir(struct cached_dir *cdir)
  * That likely will not change.
  *
  * Returns the most significant path_treatment value encountered in the scan.
+ *
+ * If "defer" is given, the subdirectories are not recursed into, but
+ * added to it, to be scanned later.
  */
 static enum path_treatment read_directory_recursive(struct dir_struct *dir,
 				    const char *base, int baselen,
 				    struct untracked_cache_dir *untracked, int check_only,
-				    const struct pathspec *pathspec)
+				    const struct pathspec *pathspec,
+				    struct subdir_jobs *defer)
 {
 	struct cached_dir cdir;
 	enum path_treatment state, subdir_state, dir_state = path_none;
@@ -1784,7 +2184,10 @@ static enum path_treatment read_directory_recursive(struct dir_struct *dir,
 			dir_state = state;
 
 		/* recurse into subdir if instructed by treat_path */
-		if (state == path_recurse) {
+		if (state == path_recurse && defer) {
+			add_subdir_job(defer, path.buf, path.len);
+			continue;
+		} else if (state == path_recurse) {
 			struct untracked_cache_dir *ud;
 			ud = lookup_untracked(dir->untracked, untracked,
 					      path.buf + baselen,
@@ -1792,7 +2195,8 @@ static enum path_treatment read_directory_recursive(struct dir_struct *dir,
 			subdir_state =
 				read_directory_recursive(dir, path.buf,
 							 path.len, ud,
-							 check_only, pathspec);
+							 check_only, pathspec,
+							 NULL);
 			if (subdir_state > dir_state)
 				dir_state = subdir_state;
 		}
@@ -2043,6 +2447,201 @@ static struct untracked_cache_dir *validate_untracked_cache(struct dir_struct *d
 	return root;
 }
 
+static void clear_exclude_list_group(struct dir_struct *dir, int group_type)
+{
+	struct exclude_list_group *group = &dir->exclude_list_group[group_type];
+	int j;
+
+	for (j = 0; j < group->nr; j++) {
+		struct exclude_list *el = &group->el[j];
+		if (group_type == EXC_DIRS)
+			free((char *)el->src);
+		clear_exclude_list(el);
+	}
+	free(group->el);
+}
+
+static void clear_exclude_stack(struct dir_struct *dir)
+{
+	struct exclude_stack *stk = dir->exclude_stack;
+
+	while (stk) {
+		struct exclude_stack *prev = stk->prev;
+		free(stk);
+		stk = prev;
+	}
+	strbuf_release(&dir->basebuf);
+}
+
+#ifndef NO_PTHREADS
+#define MAX_READ_DIR_THREADS 16
+
+struct read_dir_thread {
+	pthread_t pthread;
+	struct dir_struct dir;
+	struct subdir_jobs *jobs;
+	const struct pathspec *pathspec;
+};
+
+static int read_dir_next_job;
+
+static void *read_dir_thread_proc(void *_data)
+{
+	struct read_dir_thread *p = _data;
+
+	for (;;) {
+		struct subdir_job *job = NULL;
+
+		read_dir_lock();
+		if (read_dir_next_job < p->jobs->nr)
+			job = &p->jobs->job[read_dir_next_job++];
+		read_dir_unlock();
+		if (!job)
+			break;
+		read_directory_recursive(&p->dir, job->path, job->len,
+					 NULL, 0, p->pathspec, NULL);
+	}
+	return NULL;
+}
+
+static void add_dir_entries(struct dir_entry ***entries, int *nr, int *alloc,
+			    struct dir_entry **more, int more_nr)
+{
+	ALLOC_GROW(*entries, *nr + more_nr, *alloc);
+	COPY_ARRAY(*entries + *nr, more, more_nr);
+	*nr += more_nr;
+	free(more);
+}
+
+/*
+ * Scan the subdirectories in "jobs" with "nr_threads" threads.  Each
+ * of them gets its own copy of "dir" with its own stack of
+ * per-directory exclude lists; the exclude lists from the command
+ * line and the exclude files are shared, as they are not modified
+ * during the traversal.  The entries they find are added to "dir",
+ * and sorted by the caller.
+ */
+static void read_directory_parallel(struct dir_struct *dir,
+				    struct subdir_jobs *jobs, int nr_threads,
+				    const struct pathspec *pathspec)
+{
+	struct read_dir_thread *threads;
+	int i;
+
+	/*
+	 * The name hash and the exclude matchers are set up lazily; do
+	 * it before the threads look at them.
+	 */
+	cache_file_exists("", 0, ignore_case);
+	for (i = EXC_CMDL; i <= EXC_FILE; i++) {
+		struct exclude_list_group *group = &dir->exclude_list_group[i];
+		int j;
+
+		if (i == EXC_DIRS)
+			continue;
+		for (j = 0; j < group->nr; j++)
+			prepare_exclude_matcher(&group->el[j]);
+	}
+
+	threads = xcalloc(nr_threads, sizeof(*threads));
+	pthread_mutex_init(&read_dir_mutex, NULL);
+	read_dir_use_threads = 1;
+	read_dir_next_job = 0;
+	for (i = 0; i < nr_threads; i++) {
+		struct read_dir_thread *p = &threads[i];
+
+		p->dir = *dir;
+		p->dir.nr = p->dir.alloc = 0;
+		p->dir.entries = NULL;
+		p->dir.ignored_nr = p->dir.ignored_alloc = 0;
+		p->dir.ignored = NULL;
+		memset(&p->dir.exclude_list_group[EXC_DIRS], 0,
+		       sizeof(p->dir.exclude_list_group[EXC_DIRS]));
+		p->dir.exclude_stack = NULL;
+		p->dir.exclude = NULL;
+		strbuf_init(&p->dir.basebuf, PATH_MAX);
+		p->jobs = jobs;
+		p->pathspec = pathspec;
+		if (pthread_create(&p->pthread, NULL, read_dir_thread_proc, p))
+			die("unable to create threaded read_directory");
+	}
+	for (i = 0; i < nr_threads; i++) {
+		struct read_dir_thread *p = &threads[i];
+
+		if (pthread_join(p->pthread, NULL))
+			die("unable to join threaded read_directory");
+		add_dir_entries(&dir->entries, &dir->nr, &dir->alloc,
+				p->dir.entries, p->dir.nr);
+		add_dir_entries(&dir->ignored, &dir->ignored_nr,
+				&dir->ignored_alloc,
+				p->dir.ignored, p->dir.ignored_nr);
+		clear_exclude_list_group(&p->dir, EXC_DIRS);
+		clear_exclude_stack(&p->dir);
+	}
+	read_dir_use_threads = 0;
+	pthread_mutex_destroy(&read_dir_mutex);
+	free(threads);
+}
+
+static int read_directory_threads(void)
+{
+	int nr_threads;
+
+	if (git_config_get_int("core.untrackedthreads", &nr_threads) ||
+	    nr_threads <= 0)
+		nr_threads = online_cpus();
+	return nr_threads < MAX_READ_DIR_THREADS ?
+		nr_threads : MAX_READ_DIR_THREADS;
+}
+#else
+static void read_directory_parallel(struct dir_struct *dir,
+				    struct subdir_jobs *jobs, int nr_threads,
+				    const struct pathspec *pathspec)
+{
+	die("BUG: read_directory_parallel() without threads");
+}
+
+static int read_directory_threads(void)
+{
+	return 1;
+}
+#endif
+
+/*
+ * Read the directory "path" (relative to the top of the work tree).
+ * When the untracked cache is not in use, its subdirectories are
+ * scanned in parallel, as scanning a big work tree on a cold cache
+ * or over the network is mostly waiting for the file system.
+ */
+static void read_directory_top(struct dir_struct *dir, const char *path,
+			       int len, struct untracked_cache_dir *untracked,
+			       const struct pathspec *pathspec)
+{
+	struct subdir_jobs jobs = { NULL, 0, 0 };
+	int i, nr_threads;
+
+	if (dir->untracked || (nr_threads = read_directory_threads()) < 2) {
+		read_directory_recursive(dir, path, len, untracked, 0,
+					 pathspec, NULL);
+		return;
+	}
+
+	read_directory_recursive(dir, path, len, NULL, 0, pathspec, &jobs);
+	if (nr_threads > jobs.nr)
+		nr_threads = jobs.nr;
+	if (nr_threads > 1)
+		read_directory_parallel(dir, &jobs, nr_threads, pathspec);
+	else
+		for (i = 0; i < jobs.nr; i++)
+			read_directory_recursive(dir, jobs.job[i].path,
+						 jobs.job[i].len, NULL, 0,
+						 pathspec, NULL);
+
+	for (i = 0; i < jobs.nr; i++)
+		free(jobs.job[i].path);
+	free(jobs.job);
+}
+
 int read_directory(struct dir_struct *dir, const char *path,
 		   int len, const struct pathspec *pathspec)
 {
@@ -2059,7 +2658,7 @@ int read_directory(struct dir_struct *dir, const char *path,
 		 */
 		dir->untracked = NULL;
 	if (!len || treat_leading_path(dir, path, len, pathspec))
-		read_directory_recursive(dir, path, len, untracked, 0, pathspec);
+		read_directory_top(dir, path, len, untracked, pathspec);
 	QSORT(dir->entries, dir->nr, cmp_name);
 	QSORT(dir->ignored, dir->ignored_nr, cmp_name);
 	if (dir->untracked) {
@@ -2293,29 +2892,11 @@ int remove_path(const char *name)
  */
 void clear_directory(struct dir_struct *dir)
 {
-	int i, j;
-	struct exclude_list_group *group;
-	struct exclude_list *el;
-	struct exclude_stack *stk;
-
-	for (i = EXC_CMDL; i <= EXC_FILE; i++) {
-		group = &dir->exclude_list_group[i];
-		for (j = 0; j < group->nr; j++) {
-			el = &group->el[j];
-			if (i == EXC_DIRS)
-				free((char *)el->src);
-			clear_exclude_list(el);
-		}
-		free(group->el);
-	}
+	int i;
 
-	stk = dir->exclude_stack;
-	while (stk) {
-		struct exclude_stack *prev = stk->prev;
-		free(stk);
-		stk = prev;
-	}
-	strbuf_release(&dir->basebuf);
+	for (i = EXC_CMDL; i <= EXC_FILE; i++)
+		clear_exclude_list_group(dir, i);
+	clear_exclude_stack(dir);
 }
 
 struct ondisk_untracked_cache {
@@ -5,6 +5,8 @@
 
 #include "strbuf.h"
 
+struct exclude_matcher;
+
 struct dir_entry {
 	unsigned int len;
 	char name[FLEX_ARRAY]; /* more */
@@ -54,6 +56,12 @@ struct exclude_list {
 	const char *src;
 
 	struct exclude **excludes;
+
+	/*
+	 * Lookup tables for the patterns above, built on first use by
+	 * long lists; see last_exclude_matching_from_list().
+	 */
+	struct exclude_matcher *matcher;
 };
 
 /*
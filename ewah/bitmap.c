@@ -19,6 +19,7 @@
  */
 #include "cache.h"
 #include "ewok.h"
+#include "ewok_rlw.h"
 
 #define EWAH_MASK(x) ((eword_t)1 << (x % BITS_IN_EWORD))
 #define EWAH_BLOCK(x) (x / BITS_IN_EWORD)
@@ -91,18 +92,7 @@ struct ewah_bitmap *bitmap_to_ewah(struct bitmap *bitmap)
 struct bitmap *ewah_to_bitmap(struct ewah_bitmap *ewah)
 {
 	struct bitmap *bitmap = bitmap_new();
-	struct ewah_iterator it;
-	eword_t blowup;
-	size_t i = 0;
-
-	ewah_iterator_init(&it, ewah);
-
-	while (ewah_iterator_next(&blowup, &it)) {
-		ALLOC_GROW(bitmap->words, i + 1, bitmap->word_alloc);
-		bitmap->words[i++] = blowup;
-	}
-
-	bitmap->word_alloc = i;
+	bitmap_or_ewah(bitmap, ewah);
 	return bitmap;
 }
 
@@ -111,19 +101,15 @@ void bitmap_and_not(struct bitmap *self, struct bitmap *other)
 	const size_t count = (self->word_alloc < other->word_alloc) ?
 		self->word_alloc : other->word_alloc;
 
-	size_t i;
-
-	for (i = 0; i < count; ++i)
-		self->words[i] &= ~other->words[i];
+	ewah_combine_words(self->words, self->words, other->words,
+			   count, EWAH_OP_AND_NOT);
 }
 
 void bitmap_or_ewah(struct bitmap *self, struct ewah_bitmap *other)
 {
 	size_t original_size = self->word_alloc;
 	size_t other_final = (other->bit_size / BITS_IN_EWORD) + 1;
-	size_t i = 0;
-	struct ewah_iterator it;
-	eword_t word;
+	size_t pointer = 0, i = 0;
 
 	if (self->word_alloc < other_final) {
 		self->word_alloc = other_final;
@@ -132,10 +118,30 @@ void bitmap_or_ewah(struct bitmap *self, struct ewah_bitmap *other)
 			(self->word_alloc - original_size) * sizeof(eword_t));
 	}
 
-	ewah_iterator_init(&it, other);
-
-	while (ewah_iterator_next(&word, &it))
-		self->words[i++] |= word;
+	/*
+	 * Walk the compressed words directly instead of expanding them
+	 * one by one through an ewah_iterator: runs of zeroes are skipped
+	 * and runs of ones filled as a whole, and literal words are OR'ed
+	 * in a SIMD register at a time.
+	 */
+	while (pointer < other->buffer_size) {
+		const eword_t *rlw = &other->buffer[pointer++];
+		size_t run = rlw_get_running_len(rlw);
+		size_t literals = rlw_get_literal_words(rlw);
+		const eword_t *words = other->buffer + pointer;
+
+		if (run + literals > self->word_alloc - i)
+			die("EWAH bitmap is longer than its bit size");
+
+		if (rlw_get_run_bit(rlw))
+			memset(self->words + i, 0xff, run * sizeof(eword_t));
+		i += run;
+
+		ewah_combine_words(self->words + i, self->words + i, words,
+				   literals, EWAH_OP_OR);
+		i += literals;
+		pointer += literals;
+	}
 }
 
 void bitmap_each_bit(struct bitmap *self, ewah_callback callback, void *data)
@@ -145,6 +145,9 @@ void ewah_add_dirty_words(
 			size_t i;
 			for (i = 0; i < can_add; ++i)
 				self->buffer[self->buffer_size++] = ~buffer[i];
+		} else if (can_add == 1) {
+			/* the common case; not worth a call to memcpy() */
+			self->buffer[self->buffer_size++] = buffer[0];
 		} else {
 			memcpy(self->buffer + self->buffer_size,
 				buffer, can_add * sizeof(eword_t));
@@ -396,6 +399,83 @@ void ewah_not(struct ewah_bitmap *self)
 	}
 }
 
+#define COMBINE_BLOCK 64
+#define COMBINE_SHORT 4
+
+/*
+ * Append `number` literal words, each the combination of the words at
+ * the same position in `a` and `b`.
+ *
+ * The words are combined a block at a time, using SIMD instructions
+ * where available (see ewah_combine_words()), and are then appended
+ * in bulk. Words that come out clean (all zeroes or all ones) are
+ * added as runs, so that the result is compressed exactly as if each
+ * word had gone through ewah_add().
+ */
+static inline void add_combined_words(struct ewah_bitmap *out,
+	const eword_t *a, const eword_t *b, size_t number, enum ewah_op op)
+{
+	eword_t block[COMBINE_BLOCK];
+
+	/*
+	 * Most literal stretches in real bitmaps are a word or two long,
+	 * too short for the block machinery below to pay off.
+	 */
+	if (number < COMBINE_SHORT) {
+		size_t k;
+
+		for (k = 0; k < number; ++k)
+			ewah_add(out, EWAH_COMBINE(a[k], b[k], op));
+		return;
+	}
+
+	while (number > 0) {
+		size_t len = min_size(number, COMBINE_BLOCK);
+		size_t k, start;
+
+		switch (op) {
+		case EWAH_OP_OR:
+			ewah_combine_words(block, a, b, len, EWAH_OP_OR);
+			break;
+		case EWAH_OP_AND:
+			ewah_combine_words(block, a, b, len, EWAH_OP_AND);
+			break;
+		case EWAH_OP_AND_NOT:
+			ewah_combine_words(block, a, b, len, EWAH_OP_AND_NOT);
+			break;
+		case EWAH_OP_XOR:
+			ewah_combine_words(block, a, b, len, EWAH_OP_XOR);
+			break;
+		}
+
+		start = k = 0;
+		while (k < len) {
+			eword_t word = block[k];
+			size_t end;
+
+			if (word != 0 && word != (eword_t)(~0)) {
+				k++;
+				continue;
+			}
+
+			for (end = k + 1; end < len && block[end] == word; end++)
+				; /* nothing */
+
+			if (start < k)
+				ewah_add_dirty_words(out, block + start, k - start, 0);
+			ewah_add_empty_words(out, word != 0, end - k);
+			start = k = end;
+		}
+
+		if (start < len)
+			ewah_add_dirty_words(out, block + start, len - start, 0);
+
+		a += len;
+		b += len;
+		number -= len;
+	}
+}
+
 void ewah_xor(
 	struct ewah_bitmap *ewah_i,
 	struct ewah_bitmap *ewah_j,
@@ -438,14 +518,10 @@ void ewah_xor(
 			rlw_j.rlw.literal_words);
 
 		if (literals) {
-			size_t k;
-
-			for (k = 0; k < literals; ++k) {
-				ewah_add(out,
-					rlw_i.buffer[rlw_i.literal_word_start + k] ^
-					rlw_j.buffer[rlw_j.literal_word_start + k]
-				);
-			}
+			add_combined_words(out,
+				rlw_i.buffer + rlw_i.literal_word_start,
+				rlw_j.buffer + rlw_j.literal_word_start,
+				literals, EWAH_OP_XOR);
 
 			rlwit_discard_first_words(&rlw_i, literals);
 			rlwit_discard_first_words(&rlw_j, literals);
@@ -506,14 +582,10 @@ void ewah_and(
 			rlw_j.rlw.literal_words);
 
 		if (literals) {
-			size_t k;
-
-			for (k = 0; k < literals; ++k) {
-				ewah_add(out,
-					rlw_i.buffer[rlw_i.literal_word_start + k] &
-					rlw_j.buffer[rlw_j.literal_word_start + k]
-				);
-			}
+			add_combined_words(out,
+				rlw_i.buffer + rlw_i.literal_word_start,
+				rlw_j.buffer + rlw_j.literal_word_start,
+				literals, EWAH_OP_AND);
 
 			rlwit_discard_first_words(&rlw_i, literals);
 			rlwit_discard_first_words(&rlw_j, literals);
@@ -579,14 +651,10 @@ void ewah_and_not(
 			rlw_j.rlw.literal_words);
 
 		if (literals) {
-			size_t k;
-
-			for (k = 0; k < literals; ++k) {
-				ewah_add(out,
-					rlw_i.buffer[rlw_i.literal_word_start + k] &
-					~(rlw_j.buffer[rlw_j.literal_word_start + k])
-				);
-			}
+			add_combined_words(out,
+				rlw_i.buffer + rlw_i.literal_word_start,
+				rlw_j.buffer + rlw_j.literal_word_start,
+				literals, EWAH_OP_AND_NOT);
 
 			rlwit_discard_first_words(&rlw_i, literals);
 			rlwit_discard_first_words(&rlw_j, literals);
@@ -626,7 +694,7 @@ void ewah_or(
 			}
 
 			if (predator->rlw.running_bit) {
-				ewah_add_empty_words(out, 0,
+				ewah_add_empty_words(out, 1,
 					predator->rlw.running_len);
 				rlwit_discard_first_words(prey,
 					predator->rlw.running_len);
@@ -647,14 +715,10 @@ void ewah_or(
 			rlw_j.rlw.literal_words);
 
 		if (literals) {
-			size_t k;
-
-			for (k = 0; k < literals; ++k) {
-				ewah_add(out,
-					rlw_i.buffer[rlw_i.literal_word_start + k] |
-					rlw_j.buffer[rlw_j.literal_word_start + k]
-				);
-			}
+			add_combined_words(out,
+				rlw_i.buffer + rlw_i.literal_word_start,
+				rlw_j.buffer + rlw_j.literal_word_start,
+				literals, EWAH_OP_OR);
 
 			rlwit_discard_first_words(&rlw_i, literals);
 			rlwit_discard_first_words(&rlw_j, literals);
@@ -96,8 +96,9 @@ size_t rlwit_discharge(
 		if (pd + index > max)
 			pd = max - index;
 
-		ewah_add_dirty_words(out,
-			it->buffer + it->literal_word_start, pd, negate);
+		if (pd > 0)
+			ewah_add_dirty_words(out,
+				it->buffer + it->literal_word_start, pd, negate);
 
 		rlwit_discard_first_words(it, pd + pl);
 		index += pd;
@@ -80,6 +80,59 @@ static inline eword_t rlw_size(const eword_t *self)
 	return rlw_get_running_len(self) + rlw_get_literal_words(self);
 }
 
+enum ewah_op {
+	EWAH_OP_OR,
+	EWAH_OP_AND,
+	EWAH_OP_AND_NOT,
+	EWAH_OP_XOR
+};
+
+#define EWAH_COMBINE(x, y, op) \
+	((op) == EWAH_OP_OR ? (x) | (y) : \
+	 (op) == EWAH_OP_AND ? (x) & (y) : \
+	 (op) == EWAH_OP_AND_NOT ? (x) & ~(y) : \
+	 (x) ^ (y))
+
+/*
+ * When the compiler supports vector extensions and the target has
+ * SIMD registers (SSE2, AVX2 or NEON), literal words are combined a
+ * whole register at a time.
+ */
+#if defined(__GNUC__) && \
+	(defined(__SSE2__) || defined(__ARM_NEON__) || defined(__aarch64__))
+# ifdef __AVX2__
+#  define EWAH_VECTOR_SIZE 32
+# else
+#  define EWAH_VECTOR_SIZE 16
+# endif
+# define EWAH_VECTOR_WORDS (EWAH_VECTOR_SIZE / sizeof(eword_t))
+typedef eword_t ewah_vector_t __attribute__((vector_size(EWAH_VECTOR_SIZE)));
+#endif
+
+/*
+ * Store `op` applied to the `nr` words of `a` and `b` into `dst`,
+ * which may be the same array as `a`. This is meant to be called
+ * with a constant `op`, so that each operation gets its own loop.
+ */
+static inline void ewah_combine_words(eword_t *dst,
+	const eword_t *a, const eword_t *b, size_t nr, enum ewah_op op)
+{
+	size_t k = 0;
+
+#ifdef EWAH_VECTOR_WORDS
+	for (; k + EWAH_VECTOR_WORDS <= nr; k += EWAH_VECTOR_WORDS) {
+		ewah_vector_t va, vb;
+
+		memcpy(&va, a + k, sizeof(va));
+		memcpy(&vb, b + k, sizeof(vb));
+		va = EWAH_COMBINE(va, vb, op);
+		memcpy(dst + k, &va, sizeof(va));
+	}
+#endif
+	for (; k < nr; ++k)
+		dst[k] = EWAH_COMBINE(a[k], b[k], op);
+}
+
 struct rlw_iterator {
 	const eword_t *buffer;
 	size_t size;
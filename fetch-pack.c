@@ -669,15 +669,22 @@ static int everything_local(struct fetch_pack_args *args,
 			    struct ref **sought, int nr_sought)
 {
 	struct ref *ref;
-	int retval;
+	int i, retval;
 	unsigned long cutoff = 0;
+	struct oid_array oids = OID_ARRAY_INIT;
+	char *exists;
 
 	save_commit_buffer = 0;
 
-	for (ref = *refs; ref; ref = ref->next) {
+	for (ref = *refs; ref; ref = ref->next)
+		oid_array_append(&oids, &ref->old_oid);
+	exists = xmalloc(oids.nr);
+	has_object_files(&oids, exists, 0);
+
+	for (ref = *refs, i = 0; ref; ref = ref->next, i++) {
 		struct object *o;
 
-		if (!has_object_file(&ref->old_oid))
+		if (!exists[i])
 			continue;
 
 		o = parse_object(ref->old_oid.hash);
@@ -694,6 +701,8 @@ static int everything_local(struct fetch_pack_args *args,
 				cutoff = commit->date;
 		}
 	}
+	free(exists);
+	oid_array_clear(&oids);
 
 	if (!args->deepen) {
 		for_each_ref(mark_complete_oid, NULL);
@@ -1042,9 +1051,13 @@ static void update_shallow(struct fetch_pack_args *args,
 		 */
 		struct oid_array extra = OID_ARRAY_INIT;
 		struct object_id *oid = si->shallow->oid;
+		char *exists = xmalloc(si->shallow->nr);
+
+		has_object_files(si->shallow, exists, 0);
 		for (i = 0; i < si->shallow->nr; i++)
-			if (has_object_file(&oid[i]))
+			if (exists[i])
 				oid_array_append(&extra, &oid[i]);
+		free(exists);
 		if (extra.nr) {
 			setup_alternate_shallow(&shallow_lock,
 						&alternate_shallow_file,
@@ -0,0 +1,566 @@
+#include "cache.h"
+#include "grep.h"
+#include "grep-index.h"
+#include "tree.h"
+#include "tree-walk.h"
+#include "revision.h"
+#include "sha1-array.h"
+#include "sha1-lookup.h"
+#include "csum-file.h"
+#include "lockfile.h"
+#include "dir.h"
+#include "varint.h"
+#include "ewah/ewok.h"
+
+static const char GREP_INDEX_SIGNATURE[] = { 'G', 'T', 'R', 'I' };
+#define GREP_INDEX_VERSION 1
+#define GREP_INDEX_HEADER_SIZE 16
+#define GREP_INDEX_TRIGRAM_SIZE 8
+
+#define NR_TRIGRAMS (1u << 24)
+
+struct grep_index {
+	unsigned char *map;
+	size_t map_size;
+
+	uint32_t nr_blobs;
+	uint32_t nr_trigrams;
+	const unsigned char *blobs;
+	const unsigned char *trigrams;
+	const unsigned char *postings;
+	size_t postings_size;
+
+	/* positions in the blob table of the blobs we need to look at */
+	struct bitmap *candidates;
+};
+
+static inline uint32_t trigram_at(const unsigned char *p)
+{
+	return ((uint32_t)tolower(p[0]) << 16) |
+	       ((uint32_t)tolower(p[1]) << 8) |
+		(uint32_t)tolower(p[2]);
+}
+
+static char *grep_index_path(const struct object_id *tree_oid)
+{
+	return git_pathdup("grep-index/%s.gti", oid_to_hex(tree_oid));
+}
+
+/*
+ * Writing
+ */
+
+static void collect_blobs(struct tree *tree, struct oid_array *blobs)
+{
+	struct tree_desc desc;
+	struct name_entry entry;
+
+	if (tree->object.flags & SEEN)
+		return;
+	tree->object.flags |= SEEN;
+
+	if (parse_tree(tree))
+		die(_("unable to read tree (%s)"), oid_to_hex(&tree->object.oid));
+	init_tree_desc(&desc, tree->buffer, tree->size);
+	while (tree_entry(&desc, &entry)) {
+		if (S_ISDIR(entry.mode)) {
+			struct tree *subtree = lookup_tree(entry.oid->hash);
+			if (!subtree)
+				die(_("unable to read tree (%s)"),
+				    oid_to_hex(entry.oid));
+			collect_blobs(subtree, blobs);
+		} else if (S_ISREG(entry.mode)) {
+			/* git grep only ever looks at regular files */
+			oid_array_append(blobs, entry.oid);
+		}
+	}
+	free_tree_buffer(tree);
+}
+
+static int append_oid(const struct object_id *oid, void *data)
+{
+	oid_array_append(data, oid);
+	return 0;
+}
+
+struct trigram_pairs {
+	/* trigram in the upper, blob position in the lower 32 bits */
+	uint64_t *pair;
+	size_t nr, alloc;
+
+	/* scratch space for finding the distinct trigrams of one blob */
+	unsigned char *seen;
+	uint32_t *list;
+	size_t list_alloc;
+};
+
+static void add_blob_trigrams(struct trigram_pairs *tp, uint32_t pos,
+			      const unsigned char *buf, unsigned long size)
+{
+	size_t nr = 0, i;
+
+	for (i = 0; i + 2 < size; i++) {
+		uint32_t t = trigram_at(buf + i);
+		if (tp->seen[t >> 3] & (1 << (t & 7)))
+			continue;
+		tp->seen[t >> 3] |= 1 << (t & 7);
+		ALLOC_GROW(tp->list, nr + 1, tp->list_alloc);
+		tp->list[nr++] = t;
+	}
+
+	ALLOC_GROW(tp->pair, tp->nr + nr, tp->alloc);
+	for (i = 0; i < nr; i++) {
+		uint32_t t = tp->list[i];
+		tp->seen[t >> 3] &= ~(1 << (t & 7));
+		tp->pair[tp->nr++] = ((uint64_t)t << 32) | pos;
+	}
+}
+
+static int pair_cmp(const void *a_, const void *b_)
+{
+	uint64_t a = *(const uint64_t *)a_;
+	uint64_t b = *(const uint64_t *)b_;
+	return a < b ? -1 : a > b;
+}
+
+int write_grep_index(const struct object_id *tree_oid)
+{
+	struct oid_array all = OID_ARRAY_INIT, blobs = OID_ARRAY_INIT;
+	struct trigram_pairs tp;
+	struct strbuf postings = STRBUF_INIT;
+	struct lock_file *lk;
+	struct sha1file *f;
+	struct tree *tree;
+	unsigned char sha1[GIT_SHA1_RAWSZ];
+	char *path;
+	uint32_t nr_trigrams = 0;
+	size_t i;
+	int fd;
+
+	tree = parse_tree_indirect(tree_oid->hash);
+	if (!tree)
+		return error(_("not a tree object: %s"), oid_to_hex(tree_oid));
+	collect_blobs(tree, &all);
+	oid_array_for_each_unique(&all, append_oid, &blobs);
+	oid_array_clear(&all);
+
+	memset(&tp, 0, sizeof(tp));
+	tp.seen = xcalloc(NR_TRIGRAMS / 8, 1);
+	for (i = 0; i < blobs.nr; i++) {
+		enum object_type type;
+		unsigned long size;
+		void *buf = read_sha1_file(blobs.oid[i].hash, &type, &size);
+
+		if (!buf || type != OBJ_BLOB)
+			die(_("unable to read blob object %s"),
+			    oid_to_hex(&blobs.oid[i]));
+		add_blob_trigrams(&tp, i, buf, size);
+		free(buf);
+	}
+	free(tp.seen);
+	free(tp.list);
+	QSORT(tp.pair, tp.nr, pair_cmp);
+
+	path = grep_index_path(&tree->object.oid);
+	if (safe_create_leading_directories(path)) {
+		error_errno(_("unable to create leading directories of %s"),
+			    path);
+		free(path);
+		return -1;
+	}
+	lk = xcalloc(1, sizeof(*lk));
+	fd = hold_lock_file_for_update(lk, path, LOCK_DIE_ON_ERROR);
+	f = sha1fd(fd, get_lock_file_path(lk));
+
+	for (i = 0; i < tp.nr; i++)
+		if (!i || tp.pair[i] >> 32 != tp.pair[i - 1] >> 32)
+			nr_trigrams++;
+
+	sha1write(f, GREP_INDEX_SIGNATURE, sizeof(GREP_INDEX_SIGNATURE));
+	sha1write_be32(f, GREP_INDEX_VERSION);
+	sha1write_be32(f, blobs.nr);
+	sha1write_be32(f, nr_trigrams);
+	for (i = 0; i < blobs.nr; i++)
+		sha1write(f, blobs.oid[i].hash, GIT_SHA1_RAWSZ);
+
+	for (i = 0; i < tp.nr; i++) {
+		uint32_t t = tp.pair[i] >> 32;
+		uint32_t pos = tp.pair[i] & 0xffffffff;
+		unsigned char varint[16];
+		int len;
+
+		if (!i || t != tp.pair[i - 1] >> 32) {
+			if (postings.len > 0xffffffff)
+				die(_("trigram index for %s is too large"),
+				    oid_to_hex(&tree->object.oid));
+			sha1write_be32(f, t);
+			sha1write_be32(f, postings.len);
+			len = encode_varint(pos, varint);
+		} else {
+			len = encode_varint(pos - (tp.pair[i - 1] & 0xffffffff),
+					    varint);
+		}
+		strbuf_add(&postings, varint, len);
+	}
+	sha1write(f, postings.buf, postings.len);
+
+	/* the lockfile owns the descriptor, so write the trailer ourselves */
+	fd = sha1close(f, sha1, 0);
+	write_or_die(fd, sha1, GIT_SHA1_RAWSZ);
+	fsync_or_die(fd, get_lock_file_path(lk));
+	if (commit_lock_file(lk))
+		die_errno(_("unable to write %s"), path);
+
+	strbuf_release(&postings);
+	free(tp.pair);
+	oid_array_clear(&blobs);
+	free(path);
+	return 0;
+}
+
+/*
+ * Reading
+ */
+
+static int load_grep_index(struct grep_index *gi, const char *path)
+{
+	struct stat st;
+	size_t blobs_size, trigrams_size;
+	git_SHA_CTX c;
+	unsigned char sha1[GIT_SHA1_RAWSZ];
+	int fd = git_open(path);
+
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st)) {
+		close(fd);
+		return -1;
+	}
+	gi->map_size = xsize_t(st.st_size);
+	if (gi->map_size < GREP_INDEX_HEADER_SIZE + GIT_SHA1_RAWSZ) {
+		close(fd);
+		return error(_("trigram index file %s is too small"), path);
+	}
+	gi->map = xmmap(NULL, gi->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (memcmp(gi->map, GREP_INDEX_SIGNATURE, sizeof(GREP_INDEX_SIGNATURE)))
+		return error(_("trigram index file %s has unknown signature"),
+			     path);
+	if (get_be32(gi->map + 4) != GREP_INDEX_VERSION)
+		return error(_("trigram index file %s has unsupported version %u"),
+			     path, get_be32(gi->map + 4));
+
+	/* a damaged index could make us skip blobs that do match */
+	git_SHA1_Init(&c);
+	git_SHA1_Update(&c, gi->map, gi->map_size - GIT_SHA1_RAWSZ);
+	git_SHA1_Final(sha1, &c);
+	if (hashcmp(sha1, gi->map + gi->map_size - GIT_SHA1_RAWSZ))
+		return error(_("trigram index file %s has a bad checksum"),
+			     path);
+
+	gi->nr_blobs = get_be32(gi->map + 8);
+	gi->nr_trigrams = get_be32(gi->map + 12);
+
+	blobs_size = st_mult(gi->nr_blobs, GIT_SHA1_RAWSZ);
+	trigrams_size = st_mult(gi->nr_trigrams, GREP_INDEX_TRIGRAM_SIZE);
+	if (gi->map_size - GREP_INDEX_HEADER_SIZE - GIT_SHA1_RAWSZ <
+	    st_add(blobs_size, trigrams_size))
+		return error(_("trigram index file %s is truncated"), path);
+
+	gi->blobs = gi->map + GREP_INDEX_HEADER_SIZE;
+	gi->trigrams = gi->blobs + blobs_size;
+	gi->postings = gi->trigrams + trigrams_size;
+	gi->postings_size = gi->map + gi->map_size - GIT_SHA1_RAWSZ -
+			    gi->postings;
+	return 0;
+}
+
+static int find_trigram(struct grep_index *gi, uint32_t t)
+{
+	uint32_t lo = 0, hi = gi->nr_trigrams;
+
+	while (lo < hi) {
+		uint32_t mi = lo + (hi - lo) / 2;
+		uint32_t cur = get_be32(gi->trigrams + mi * GREP_INDEX_TRIGRAM_SIZE);
+
+		if (cur == t)
+			return mi;
+		if (cur < t)
+			lo = mi + 1;
+		else
+			hi = mi;
+	}
+	return -1;
+}
+
+static void posting_range(struct grep_index *gi, int nth,
+			  size_t *start, size_t *end)
+{
+	const unsigned char *e = gi->trigrams + nth * GREP_INDEX_TRIGRAM_SIZE;
+
+	*start = get_be32(e + 4);
+	if (nth + 1 < gi->nr_trigrams)
+		*end = get_be32(e + GREP_INDEX_TRIGRAM_SIZE + 4);
+	else
+		*end = gi->postings_size;
+}
+
+/*
+ * Decode the posting list of the nth trigram into a sorted array of
+ * blob positions.  Returns the number of positions, or -1 if the list
+ * is corrupt.
+ */
+static int decode_postings(struct grep_index *gi, int nth,
+			   uint32_t **out, size_t *alloc)
+{
+	const unsigned char *p, *end;
+	size_t start_ofs, end_ofs;
+	uint64_t pos = 0;
+	int nr = 0;
+
+	posting_range(gi, nth, &start_ofs, &end_ofs);
+	if (start_ofs > end_ofs || end_ofs > gi->postings_size)
+		return -1;
+	p = gi->postings + start_ofs;
+	end = gi->postings + end_ofs;
+	while (p < end) {
+		uint64_t delta = decode_varint(&p);
+
+		if (nr && !delta)
+			return -1;
+		pos += delta;
+		if (pos >= gi->nr_blobs)
+			return -1;
+		ALLOC_GROW(*out, nr + 1, *alloc);
+		(*out)[nr++] = pos;
+	}
+	return nr;
+}
+
+/*
+ * Find a string that every line matched by the pattern must contain,
+ * by taking the literal characters at the start of a regular
+ * expression.  Returns 0 if there is no such string.
+ */
+static int regexp_literal_prefix(const char *pat, size_t len, int extended,
+				 struct strbuf *out)
+{
+	const char *special = extended ? ".[]\\*^$+?{}()|" : ".[\\*^$";
+	size_t i = 0;
+
+	/* an alternation anywhere means no part of it is required */
+	if (extended ? !!memchr(pat, '|', len) : !!strstr(pat, "\\|"))
+		return 0;
+
+	if (i < len && pat[i] == '^')
+		i++;
+	while (i < len && !strchr(special, pat[i]))
+		strbuf_addch(out, pat[i++]);
+
+	/* the last literal character may be repeated zero times */
+	if (out->len && i < len &&
+	    (pat[i] == '*' ||
+	     (extended && strchr("?{", pat[i])) ||
+	     (!extended && pat[i] == '\\' && i + 1 < len &&
+	      strchr("?+{", pat[i + 1]))))
+		strbuf_setlen(out, out->len - 1);
+	return out->len > 0;
+}
+
+static int required_literal(struct grep_opt *opt, struct grep_pat *p,
+			    struct strbuf *out)
+{
+	strbuf_reset(out);
+	if (p->token != GREP_PATTERN)
+		return 0;
+	/*
+	 * The index folds ASCII letters the same way kwset does for
+	 * case-insensitive fixed strings.
+	 */
+	if (p->fixed) {
+		strbuf_add(out, p->pattern, p->patternlen);
+		return 1;
+	}
+	if (opt->fixed || opt->pcre1 || opt->pcre2 || p->ignore_case ||
+	    (opt->regflags & REG_ICASE))
+		return 0;
+	return regexp_literal_prefix(p->pattern, p->patternlen,
+				     opt->regflags & REG_EXTENDED, out);
+}
+
+/*
+ * Mark the blobs containing all trigrams of the literal as candidates.
+ */
+static int add_candidates(struct grep_index *gi, struct strbuf *literal)
+{
+	uint32_t *cand = NULL, *other = NULL;
+	size_t cand_alloc = 0, other_alloc = 0;
+	int *lists, nr_lists = 0, i, j, cand_nr;
+	int ret = 0;
+
+	ALLOC_ARRAY(lists, literal->len - 2);
+	for (i = 0; i + 2 < literal->len; i++) {
+		int nth = find_trigram(gi,
+				trigram_at((unsigned char *)literal->buf + i));
+		if (nth < 0)
+			goto out; /* no blob can match */
+		lists[nr_lists++] = nth;
+	}
+
+	/* start from the shortest posting list */
+	for (i = 1; i < nr_lists; i++) {
+		size_t s0, e0, s1, e1;
+		posting_range(gi, lists[0], &s0, &e0);
+		posting_range(gi, lists[i], &s1, &e1);
+		if (e1 - s1 < e0 - s0)
+			SWAP(lists[0], lists[i]);
+	}
+
+	cand_nr = decode_postings(gi, lists[0], &cand, &cand_alloc);
+	for (i = 1; 0 < cand_nr && i < nr_lists; i++) {
+		int other_nr, k, n = 0;
+
+		if (lists[i] == lists[0])
+			continue;
+		other_nr = decode_postings(gi, lists[i], &other, &other_alloc);
+		if (other_nr < 0) {
+			cand_nr = -1;
+			break;
+		}
+		for (j = k = 0; j < cand_nr && k < other_nr; ) {
+			if (cand[j] < other[k])
+				j++;
+			else if (cand[j] > other[k])
+				k++;
+			else {
+				cand[n++] = cand[j];
+				j++;
+				k++;
+			}
+		}
+		cand_nr = n;
+	}
+	if (cand_nr < 0) {
+		ret = -1;
+		goto out;
+	}
+	for (i = 0; i < cand_nr; i++)
+		bitmap_set(gi->candidates, cand[i]);
+
+out:
+	free(lists);
+	free(cand);
+	free(other);
+	return ret;
+}
+
+struct grep_index *prepare_grep_index(const struct object_id *tree_oid,
+				      struct grep_opt *opt)
+{
+	struct grep_index *gi;
+	struct grep_pat *p;
+	struct strbuf literal = STRBUF_INIT;
+	char *path;
+
+	/*
+	 * Skipping a blob is only safe when not matching means not
+	 * showing anything for it, and when what we match against is
+	 * the blob contents as indexed.
+	 */
+	if (opt->invert || opt->unmatch_name_only || opt->allow_textconv)
+		return NULL;
+	for (p = opt->pattern_list; p; p = p->next) {
+		if (!required_literal(opt, p, &literal) || literal.len < 3) {
+			strbuf_release(&literal);
+			return NULL;
+		}
+	}
+
+	gi = xcalloc(1, sizeof(*gi));
+	path = grep_index_path(tree_oid);
+	if (load_grep_index(gi, path) < 0)
+		goto fail;
+
+	gi->candidates = bitmap_new();
+	for (p = opt->pattern_list; p; p = p->next) {
+		required_literal(opt, p, &literal);
+		if (add_candidates(gi, &literal) < 0) {
+			error(_("trigram index file %s is corrupt"), path);
+			goto fail;
+		}
+	}
+	strbuf_release(&literal);
+	free(path);
+	return gi;
+
+fail:
+	strbuf_release(&literal);
+	free(path);
+	free_grep_index(gi);
+	return NULL;
+}
+
+static const unsigned char *blob_access(size_t pos, void *table)
+{
+	return (const unsigned char *)table + pos * GIT_SHA1_RAWSZ;
+}
+
+int grep_index_may_match(struct grep_index *gi, const struct object_id *oid)
+{
+	int pos = sha1_pos(oid->hash, (void *)gi->blobs, gi->nr_blobs,
+			   blob_access);
+
+	if (pos < 0)
+		return 1; /* not indexed; we know nothing about it */
+	return bitmap_get(gi->candidates, pos);
+}
+
+void prune_grep_indexes(void)
+{
+	struct strbuf path = STRBUF_INIT;
+	struct dirent *de;
+	size_t dirlen;
+	DIR *dir;
+
+	strbuf_addstr(&path, git_path("grep-index"));
+	dir = opendir(path.buf);
+	if (!dir) {
+		strbuf_release(&path);
+		return;
+	}
+	strbuf_addch(&path, '/');
+	dirlen = path.len;
+	while ((de = readdir(dir)) != NULL) {
+		unsigned char sha1[GIT_SHA1_RAWSZ];
+		const char *ext;
+
+		if (is_dot_or_dotdot(de->d_name))
+			continue;
+		/* leave the lock of a concurrent --build-index alone */
+		if (ends_with(de->d_name, ".lock"))
+			continue;
+		if (!get_sha1_hex(de->d_name, sha1) &&
+		    skip_prefix(de->d_name + GIT_SHA1_HEXSZ, ".gti", &ext) &&
+		    !*ext && sha1_object_info(sha1, NULL) == OBJ_TREE)
+			continue;
+
+		strbuf_setlen(&path, dirlen);
+		strbuf_addstr(&path, de->d_name);
+		if (unlink(path.buf))
+			warning_errno(_("unable to remove %s"), path.buf);
+	}
+	closedir(dir);
+	strbuf_release(&path);
+}
+
+void free_grep_index(struct grep_index *gi)
+{
+	if (!gi)
+		return;
+	if (gi->map)
+		munmap(gi->map, gi->map_size);
+	if (gi->candidates)
+		bitmap_free(gi->candidates);
+	free(gi);
+}
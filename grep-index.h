@@ -0,0 +1,56 @@
+#ifndef GREP_INDEX_H
+#define GREP_INDEX_H
+
+struct grep_opt;
+struct grep_index;
+
+/*
+ * A trigram index lists, for every distinct sequence of three bytes
+ * (ASCII letters folded to lowercase), the blobs of one tree that
+ * contain it.  It is stored in $GIT_DIR/grep-index/<tree>.gti and
+ * never goes stale, as it is keyed by the tree object name.
+ *
+ *   - 4-byte signature "GTRI"
+ *   - 4-byte version number (network byte order), currently 1
+ *   - 4-byte number of blobs N (network byte order)
+ *   - 4-byte number of trigrams T (network byte order)
+ *   - N 20-byte object names of the blobs, sorted
+ *   - T 8-byte trigram entries, sorted by trigram: the trigram in the
+ *     low 24 bits of a 4-byte word, followed by the 4-byte offset of
+ *     its posting list from the start of the posting lists
+ *   - the posting lists: for each trigram, the ascending positions of
+ *     the blobs containing it in the blob table, as varint-encoded
+ *     deltas from the previous position (the first one as is)
+ *   - 20-byte SHA-1 checksum of all of the above
+ */
+
+/*
+ * Write the trigram index for the given tree.  Returns 0 on success,
+ * or -1 (after reporting an error) on failure.
+ */
+int write_grep_index(const struct object_id *tree_oid);
+
+/*
+ * Load the trigram index for the given tree and narrow it down to the
+ * blobs that can possibly match the patterns in opt.  Returns NULL if
+ * there is no usable index, or if the patterns (or the options) are
+ * such that the index cannot be used to rule out any blob.
+ */
+struct grep_index *prepare_grep_index(const struct object_id *tree_oid,
+				      struct grep_opt *opt);
+
+/*
+ * Returns 0 if the blob is known not to match the patterns given to
+ * prepare_grep_index(), and 1 if it has to be searched.
+ */
+int grep_index_may_match(struct grep_index *gi, const struct object_id *oid);
+
+void free_grep_index(struct grep_index *gi);
+
+/*
+ * Remove the trigram indexes of trees that no longer exist, and any
+ * other file that has no business in $GIT_DIR/grep-index/.
+ */
+void prune_grep_indexes(void);
+
+#endif
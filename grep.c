@@ -178,25 +178,40 @@ static void grep_set_pattern_type_option(enum grep_pattern_type pattern_type, st
 
 	case GREP_PATTERN_TYPE_BRE:
 		opt->fixed = 0;
-		opt->pcre = 0;
+		opt->pcre1 = 0;
+		opt->pcre2 = 0;
 		opt->regflags &= ~REG_EXTENDED;
 		break;
 
 	case GREP_PATTERN_TYPE_ERE:
 		opt->fixed = 0;
-		opt->pcre = 0;
+		opt->pcre1 = 0;
+		opt->pcre2 = 0;
 		opt->regflags |= REG_EXTENDED;
 		break;
 
 	case GREP_PATTERN_TYPE_FIXED:
 		opt->fixed = 1;
-		opt->pcre = 0;
+		opt->pcre1 = 0;
+		opt->pcre2 = 0;
 		opt->regflags &= ~REG_EXTENDED;
 		break;
 
 	case GREP_PATTERN_TYPE_PCRE:
 		opt->fixed = 0;
-		opt->pcre = 1;
+#ifdef USE_LIBPCRE2
+		opt->pcre1 = 0;
+		opt->pcre2 = 1;
+#else
+		/*
+		 * It's important that pcre1 always be assigned to
+		 * even when there's no USE_LIBPCRE* defined. We still
+		 * call the PCRE stub function, it just dies with
+		 * "cannot use Perl-compatible regexes[...]".
+		 */
+		opt->pcre1 = 1;
+		opt->pcre2 = 0;
+#endif
 		opt->regflags &= ~REG_EXTENDED;
 		break;
 	}
@@ -393,6 +408,425 @@ static void free_pcre_regexp(struct grep_pat *p)
 }
 #endif /* !USE_LIBPCRE */
 
+#ifdef USE_LIBPCRE2
+/*
+ * Allocate the match data, and JIT-compile the pattern if libpcre2
+ * can.  Each thread compiles its own copy of the patterns, so the
+ * match data and the JIT stack are never shared between threads.
+ */
+static void setup_pcre2_match(struct grep_pat *p)
+{
+	p->pcre2_match_data = pcre2_match_data_create_from_pattern(p->pcre2_pattern, NULL);
+	if (!p->pcre2_match_data)
+		die("Couldn't allocate PCRE2 match data");
+
+	pcre2_config(PCRE2_CONFIG_JIT, &p->pcre2_jit_on);
+	if (p->pcre2_jit_on &&
+	    pcre2_jit_compile(p->pcre2_pattern, PCRE2_JIT_COMPLETE))
+		p->pcre2_jit_on = 0; /* e.g. no executable memory; interpret */
+	if (p->pcre2_jit_on) {
+		p->pcre2_jit_stack = pcre2_jit_stack_create(32 * 1024, 1024 * 1024, NULL);
+		if (!p->pcre2_jit_stack)
+			die("Couldn't allocate PCRE2 JIT stack");
+		p->pcre2_match_context = pcre2_match_context_create(NULL);
+		if (!p->pcre2_match_context)
+			die("Couldn't allocate PCRE2 match context");
+		pcre2_jit_stack_assign(p->pcre2_match_context, NULL, p->pcre2_jit_stack);
+	}
+}
+
+static void compile_pcre2_pattern(struct grep_pat *p, const struct grep_opt *opt)
+{
+	int error;
+	PCRE2_UCHAR errbuf[256];
+	PCRE2_SIZE erroffset;
+	int options = PCRE2_MULTILINE;
+
+	if (opt->ignore_case) {
+		if (has_non_ascii(p->pattern)) {
+			p->pcre2_tables = pcre2_maketables(NULL);
+			p->pcre2_compile_context = pcre2_compile_context_create(NULL);
+			pcre2_set_character_tables(p->pcre2_compile_context,
+						   p->pcre2_tables);
+		}
+		options |= PCRE2_CASELESS;
+	}
+	if (is_utf8_locale() && has_non_ascii(p->pattern))
+		options |= PCRE2_UTF;
+
+	p->pcre2_pattern = pcre2_compile((PCRE2_SPTR)p->pattern,
+					 p->patternlen, options, &error,
+					 &erroffset, p->pcre2_compile_context);
+	if (!p->pcre2_pattern) {
+		pcre2_get_error_message(error, errbuf, sizeof(errbuf));
+		compile_regexp_failed(p, (const char *)errbuf);
+	}
+	setup_pcre2_match(p);
+}
+
+static int is_same_range_class(int lo, int hi)
+{
+	return (isdigit(lo) && isdigit(hi)) ||
+	       (islower(lo) && islower(hi)) ||
+	       (isupper(lo) && isupper(hi));
+}
+
+static void add_pcre2_literal(struct strbuf *out, int c)
+{
+	/* in PCRE, a backslash before a non-alphanumeric is always literal */
+	if (isascii(c) && !isalnum(c))
+		strbuf_addch(out, '\\');
+	strbuf_addch(out, c);
+}
+
+/*
+ * Translate the bracket expression starting after the '[' at pat[*i].
+ * Unlike in POSIX, a non-matching list in PCRE also matches newlines,
+ * and a backslash is special.
+ */
+static int bracket_to_pcre2(const char *pat, size_t len, size_t *i,
+			    struct strbuf *out)
+{
+	int negate = 0, first = 1;
+
+	strbuf_addch(out, '[');
+	if (*i < len && pat[*i] == '^') {
+		strbuf_addch(out, '^');
+		negate = 1;
+		(*i)++;
+	}
+	for (;;) {
+		int c;
+
+		if (*i >= len)
+			return -1;
+		c = pat[*i];
+		if (c == ']' && !first) {
+			(*i)++;
+			break;
+		}
+		first = 0;
+		/* character classes, equivalence classes, collating symbols */
+		if (c == '[' && *i + 1 < len && strchr(":=.", pat[*i + 1]))
+			return -1;
+		if (*i + 2 < len && pat[*i + 1] == '-' && pat[*i + 2] != ']') {
+			int hi = pat[*i + 2];
+
+			/* only ranges that cannot depend on the collation */
+			if (!is_same_range_class(c, hi) || c > hi)
+				return -1;
+			strbuf_addf(out, "%c-%c", c, hi);
+			*i += 3;
+			continue;
+		}
+		add_pcre2_literal(out, c);
+		(*i)++;
+	}
+	if (negate)
+		strbuf_addstr(out, "\\n");
+	strbuf_addch(out, ']');
+	return 0;
+}
+
+/*
+ * Translate the interval expression starting after the '{' (or "\{")
+ * at pat[*i], up to and including the closing '}' (or "\}").
+ */
+static int interval_to_pcre2(const char *pat, size_t len, size_t *i,
+			     int extended, struct strbuf *out)
+{
+	unsigned long min, max;
+	const char *start = pat + *i, *end = pat + len, *p;
+	char *ep;
+
+	if (start >= end || !isdigit(*start))
+		return -1;
+	min = strtoul(start, &ep, 10);
+	max = min;
+	p = ep;
+	if (p < end && *p == ',') {
+		p++;
+		if (p < end && isdigit(*p)) {
+			max = strtoul(p, &ep, 10);
+			p = ep;
+		} else {
+			max = ULONG_MAX;
+		}
+	}
+	if (!extended && p < end && *p == '\\')
+		p++;
+	if (p >= end || *p != '}' || max < min || min > 255 ||
+	    (max != ULONG_MAX && max > 255))
+		return -1;
+	strbuf_addf(out, "{%lu", min);
+	if (max == ULONG_MAX)
+		strbuf_addch(out, ',');
+	else if (max != min)
+		strbuf_addf(out, ",%lu", max);
+	strbuf_addch(out, '}');
+	*i = p + 1 - pat;
+	return 0;
+}
+
+/*
+ * Translate a POSIX basic or extended regexp, as compiled by regcomp()
+ * with REG_NEWLINE, into a PCRE2 pattern that matches a line if and
+ * only if the original does.  Returns -1 when that cannot be
+ * guaranteed: back-references, GNU escapes like \w or \<, character
+ * classes, ranges whose meaning may depend on the collation order,
+ * and constructs whose meaning is undefined or implementation
+ * specific in POSIX.  With !any_char, '.' and bracket expressions are
+ * refused too, as they would have to match multibyte characters.
+ */
+static int posix_to_pcre2(const char *pat, size_t len, int extended,
+			  int any_char, struct strbuf *out)
+{
+	enum { AT_START, AFTER_ANCHOR, AFTER_ATOM, AFTER_REPEAT } prev = AT_START;
+	size_t i = 0;
+	int depth = 0;
+
+	while (i < len) {
+		int c = pat[i++];
+
+		if (c == '\\') {
+			if (i >= len)
+				return -1;
+			c = pat[i++];
+			if (!extended && c == '(') {
+				strbuf_addch(out, '(');
+				depth++;
+				prev = AT_START;
+			} else if (!extended && c == ')') {
+				if (!depth--)
+					return -1;
+				strbuf_addch(out, ')');
+				prev = AFTER_ATOM;
+			} else if (!extended && c == '|') {
+				strbuf_addch(out, '|');
+				prev = AT_START;
+			} else if (!extended && c == '{') {
+				if (prev != AFTER_ATOM ||
+				    interval_to_pcre2(pat, len, &i, 0, out))
+					return -1;
+				prev = AFTER_REPEAT;
+			} else if (!extended && (c == '+' || c == '?')) {
+				if (prev != AFTER_ATOM)
+					return -1;
+				strbuf_addch(out, c);
+				prev = AFTER_REPEAT;
+			} else if (!isascii(c) || isalnum(c) ||
+				   strchr("<>`'{}()|", c)) {
+				return -1;
+			} else {
+				add_pcre2_literal(out, c);
+				prev = AFTER_ATOM;
+			}
+			continue;
+		}
+
+		switch (c) {
+		case '^':
+			if (extended || prev == AT_START) {
+				strbuf_addch(out, '^');
+				prev = AFTER_ANCHOR;
+			} else {
+				add_pcre2_literal(out, c);
+				prev = AFTER_ATOM;
+			}
+			break;
+		case '$':
+			if (extended || i == len ||
+			    (pat[i] == '\\' && i + 1 < len &&
+			     (pat[i + 1] == ')' || pat[i + 1] == '|'))) {
+				strbuf_addch(out, '$');
+				prev = AFTER_ANCHOR;
+			} else {
+				add_pcre2_literal(out, c);
+				prev = AFTER_ATOM;
+			}
+			break;
+		case '.':
+			if (!any_char)
+				return -1;
+			/* regexec() does not let '.' match NUL */
+			strbuf_addstr(out, "[^\\n\\x00]");
+			prev = AFTER_ATOM;
+			break;
+		case '[':
+			if (!any_char || bracket_to_pcre2(pat, len, &i, out))
+				return -1;
+			prev = AFTER_ATOM;
+			break;
+		case '*':
+			if (prev == AFTER_ATOM) {
+				strbuf_addch(out, '*');
+				prev = AFTER_REPEAT;
+			} else if (!extended && prev != AFTER_REPEAT) {
+				/* a leading '*' is literal in a BRE */
+				add_pcre2_literal(out, c);
+				prev = AFTER_ATOM;
+			} else {
+				return -1;
+			}
+			break;
+		case '+':
+		case '?':
+		case '{':
+		case '(':
+		case ')':
+		case '|':
+			if (!extended) {
+				add_pcre2_literal(out, c);
+				prev = AFTER_ATOM;
+			} else if (c == '(') {
+				strbuf_addch(out, '(');
+				depth++;
+				prev = AT_START;
+			} else if (c == ')') {
+				if (!depth--)
+					return -1;
+				strbuf_addch(out, ')');
+				prev = AFTER_ATOM;
+			} else if (c == '|') {
+				strbuf_addch(out, '|');
+				prev = AT_START;
+			} else if (prev != AFTER_ATOM) {
+				return -1;
+			} else if (c == '{') {
+				if (interval_to_pcre2(pat, len, &i, 1, out))
+					return -1;
+				prev = AFTER_REPEAT;
+			} else {
+				strbuf_addch(out, c);
+				prev = AFTER_REPEAT;
+			}
+			break;
+		default:
+			add_pcre2_literal(out, c);
+			prev = AFTER_ATOM;
+			break;
+		}
+	}
+	return depth ? -1 : 0;
+}
+
+/*
+ * Try to let PCRE2 find the matches of the POSIX regexp p->regexp,
+ * which is much faster, especially with JIT.  regexec() is still
+ * used to find the extent of each match (POSIX wants the longest
+ * one, PCRE the first one found), see posix_match_extent().
+ */
+static void compile_pcre2_for_posix(struct grep_pat *p, const struct grep_opt *opt)
+{
+	struct strbuf sb = STRBUF_INIT;
+	int any_char = 1, error;
+	PCRE2_SIZE erroffset;
+	uint32_t options = PCRE2_MULTILINE;
+
+	if (MB_CUR_MAX > 1) {
+#ifdef PCRE2_MATCH_INVALID_UTF
+		if (is_utf8_locale())
+			options |= PCRE2_UTF | PCRE2_MATCH_INVALID_UTF;
+		else
+#endif
+			any_char = 0;
+	}
+	if (p->ignore_case || (opt->regflags & REG_ICASE)) {
+		/* POSIX folds case according to the locale */
+		if (MB_CUR_MAX > 1 || has_non_ascii(p->pattern))
+			return;
+		options |= PCRE2_CASELESS;
+	}
+	if (posix_to_pcre2(p->pattern, p->patternlen,
+			   opt->regflags & REG_EXTENDED, any_char, &sb))
+		goto out;
+
+	p->pcre2_compile_context = pcre2_compile_context_create(NULL);
+	if (!p->pcre2_compile_context)
+		die("Couldn't allocate PCRE2 compile context");
+	/* REG_NEWLINE only treats LF as the end of a line */
+	pcre2_set_newline(p->pcre2_compile_context, PCRE2_NEWLINE_LF);
+	p->pcre2_pattern = pcre2_compile((PCRE2_SPTR)sb.buf, sb.len, options,
+					 &error, &erroffset,
+					 p->pcre2_compile_context);
+	if (!p->pcre2_pattern) {
+		/* e.g. invalid UTF-8 in the pattern; stick to regexec() */
+		pcre2_compile_context_free(p->pcre2_compile_context);
+		p->pcre2_compile_context = NULL;
+		goto out;
+	}
+	setup_pcre2_match(p);
+	p->pcre2_for_posix = 1;
+out:
+	strbuf_release(&sb);
+}
+
+static int pcre2match(struct grep_pat *p, const char *line, const char *eol,
+		regmatch_t *match, int eflags)
+{
+	int ret, flags = 0;
+	PCRE2_SIZE *ovector;
+	PCRE2_UCHAR errbuf[256];
+
+	if (eflags & REG_NOTBOL)
+		flags |= PCRE2_NOTBOL;
+
+	if (p->pcre2_jit_on)
+		ret = pcre2_jit_match(p->pcre2_pattern, (unsigned char *)line,
+				      eol - line, 0, flags, p->pcre2_match_data,
+				      p->pcre2_match_context);
+	else
+		ret = pcre2_match(p->pcre2_pattern, (unsigned char *)line,
+				  eol - line, 0, flags, p->pcre2_match_data,
+				  NULL);
+
+	if (ret < 0 && ret != PCRE2_ERROR_NOMATCH) {
+		pcre2_get_error_message(ret, errbuf, sizeof(errbuf));
+		die("%s failed with error code %d: %s",
+		    (p->pcre2_jit_on ? "pcre2_jit_match" : "pcre2_match"), ret,
+		    errbuf);
+	}
+	if (ret > 0) {
+		ovector = pcre2_get_ovector_pointer(p->pcre2_match_data);
+		ret = 0;
+		match->rm_so = (int)ovector[0];
+		match->rm_eo = (int)ovector[1];
+	}
+
+	return ret;
+}
+
+static void free_pcre2_pattern(struct grep_pat *p)
+{
+	pcre2_compile_context_free(p->pcre2_compile_context);
+	pcre2_code_free(p->pcre2_pattern);
+	pcre2_match_data_free(p->pcre2_match_data);
+	pcre2_jit_stack_free(p->pcre2_jit_stack);
+	pcre2_match_context_free(p->pcre2_match_context);
+	free((void *)p->pcre2_tables);
+}
+#else /* !USE_LIBPCRE2 */
+static void compile_pcre2_pattern(struct grep_pat *p, const struct grep_opt *opt)
+{
+	/* opt->pcre2 is only ever set when compiled with USE_LIBPCRE2 */
+	die("BUG: libpcre2 pattern without USE_LIBPCRE2");
+}
+
+static void compile_pcre2_for_posix(struct grep_pat *p, const struct grep_opt *opt)
+{
+}
+
+static int pcre2match(struct grep_pat *p, const char *line, const char *eol,
+		regmatch_t *match, int eflags)
+{
+	return 1;
+}
+
+static void free_pcre2_pattern(struct grep_pat *p)
+{
+}
+#endif /* !USE_LIBPCRE2 */
+
 static int is_fixed(const char *s, size_t len)
 {
 	size_t i;
@@ -475,11 +909,16 @@ static void compile_regexp(struct grep_pat *p, struct grep_opt *opt)
 		return;
 	}
 
-	if (opt->pcre) {
+	if (opt->pcre1) {
 		compile_pcre_regexp(p, opt);
 		return;
 	}
 
+	if (opt->pcre2) {
+		compile_pcre2_pattern(p, opt);
+		return;
+	}
+
 	err = regcomp(&p->regexp, p->pattern, opt->regflags);
 	if (err) {
 		char errbuf[1024];
@@ -487,6 +926,7 @@ static void compile_regexp(struct grep_pat *p, struct grep_opt *opt)
 		regfree(&p->regexp);
 		compile_regexp_failed(p, errbuf);
 	}
+	compile_pcre2_for_posix(p, opt);
 }
 
 static struct grep_expr *compile_pattern_or(struct grep_pat **);
@@ -834,8 +1274,13 @@ void free_grep_patterns(struct grep_opt *opt)
 				kwsfree(p->kws);
 			else if (p->pcre_regexp)
 				free_pcre_regexp(p);
-			else
+			else if (p->pcre2_pattern && !p->pcre2_for_posix)
+				free_pcre2_pattern(p);
+			else {
+				if (p->pcre2_for_posix)
+					free_pcre2_pattern(p);
 				regfree(&p->regexp);
+			}
 			free(p->pattern);
 			break;
 		default:
@@ -905,6 +1350,32 @@ static int fixmatch(struct grep_pat *p, char *line, char *eol,
 	}
 }
 
+/*
+ * PCRE2 found where the leftmost match of the POSIX regexp starts.
+ * Let regexec() work out where it ends, starting right there.  Should
+ * the two disagree, regexec() has the last word on the whole line.
+ */
+static int posix_match_extent(struct grep_pat *p, char *line, char *eol,
+			      regmatch_t *match, int eflags)
+{
+	regoff_t so = match->rm_so;
+	int at_so = eflags;
+
+	if (so) {
+		if (line[so - 1] == '\n')
+			at_so &= ~REG_NOTBOL;
+		else
+			at_so |= REG_NOTBOL;
+	}
+	if (!regexec_buf(&p->regexp, line + so, eol - line - so, 1, match,
+			 at_so) && !match->rm_so) {
+		match->rm_so += so;
+		match->rm_eo += so;
+		return 0;
+	}
+	return regexec_buf(&p->regexp, line, eol - line, 1, match, eflags);
+}
+
 static int patmatch(struct grep_pat *p, char *line, char *eol,
 		    regmatch_t *match, int eflags)
 {
@@ -914,6 +1385,11 @@ static int patmatch(struct grep_pat *p, char *line, char *eol,
 		hit = !fixmatch(p, line, eol, match);
 	else if (p->pcre_regexp)
 		hit = !pcrematch(p, line, eol, match, eflags);
+	else if (p->pcre2_pattern && !p->pcre2_for_posix)
+		hit = !pcre2match(p, line, eol, match, eflags);
+	else if (p->pcre2_pattern)
+		hit = !pcre2match(p, line, eol, match, eflags) &&
+		      !posix_match_extent(p, line, eol, match, eflags);
 	else
 		hit = !regexec_buf(&p->regexp, line, eol - line, 1, match,
 				   eflags);
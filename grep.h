@@ -7,6 +7,16 @@
 typedef int pcre;
 typedef int pcre_extra;
 #endif
+#ifdef USE_LIBPCRE2
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
+#else
+typedef int pcre2_code;
+typedef int pcre2_match_data;
+typedef int pcre2_compile_context;
+typedef int pcre2_match_context;
+typedef int pcre2_jit_stack;
+#endif
 #include "kwset.h"
 #include "thread-utils.h"
 #include "userdiff.h"
@@ -49,6 +59,18 @@ struct grep_pat {
 	pcre *pcre_regexp;
 	pcre_extra *pcre_extra_info;
 	const unsigned char *pcre_tables;
+	pcre2_code *pcre2_pattern;
+	pcre2_match_data *pcre2_match_data;
+	pcre2_compile_context *pcre2_compile_context;
+	pcre2_match_context *pcre2_match_context;
+	pcre2_jit_stack *pcre2_jit_stack;
+	const unsigned char *pcre2_tables;
+	uint32_t pcre2_jit_on;
+	/*
+	 * pcre2_pattern is a translation of the POSIX regexp, used to
+	 * find matches quickly; regexp still decides where they end.
+	 */
+	unsigned pcre2_for_posix:1;
 	kwset_t kws;
 	unsigned fixed:1;
 	unsigned ignore_case:1;
@@ -111,7 +133,8 @@ struct grep_opt {
 	int allow_textconv;
 	int extended;
 	int use_reflog_filter;
-	int pcre;
+	int pcre1;
+	int pcre2;
 	int relative;
 	int pathname;
 	int null_following_name;
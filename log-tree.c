@@ -11,6 +11,7 @@
 #include "gpg-interface.h"
 #include "sequencer.h"
 #include "line-log.h"
+#include "tree-diff-cache.h"
 
 static struct decoration name_decoration = { "object names" };
 static int decoration_loaded;
@@ -723,10 +724,12 @@ void show_log(struct rev_info *opt)
 	free(ctx.notes_message);
 }
 
-int log_tree_diff_flush(struct rev_info *opt)
+/*
+ * Show the diff queue, which diffcore_std() has already been run on.
+ */
+static int show_diff_queue(struct rev_info *opt)
 {
 	opt->shown_dashes = 0;
-	diffcore_std(&opt->diffopt);
 
 	if (diff_queue_is_empty()) {
 		int saved_fmt = opt->diffopt.output_format;
@@ -776,6 +779,34 @@ int log_tree_diff_flush(struct rev_info *opt)
 	return 1;
 }
 
+int log_tree_diff_flush(struct rev_info *opt)
+{
+	diffcore_std(&opt->diffopt);
+	return show_diff_queue(opt);
+}
+
+/*
+ * Diff the two trees and run diffcore_std() on the result, unless the
+ * result is already in the tree diff cache.
+ */
+static void diff_tree_std(struct rev_info *opt,
+			  const struct object_id *old_oid,
+			  const struct object_id *new_oid)
+{
+	struct notes_cache *cache = opt->tree_diff_cache;
+
+	if (cache && !tree_diff_cache_usable(&opt->diffopt))
+		cache = NULL;
+	if (cache && !tree_diff_cache_get(cache, old_oid, new_oid, &opt->diffopt))
+		return;
+
+	diff_tree_sha1(old_oid->hash, new_oid->hash, "", &opt->diffopt);
+	diffcore_std(&opt->diffopt);
+
+	if (cache)
+		tree_diff_cache_put(cache, old_oid, new_oid, &opt->diffopt);
+}
+
 static int do_diff_combined(struct rev_info *opt, struct commit *commit)
 {
 	diff_tree_combined_merge(commit, opt->dense_combined_merges, opt);
@@ -822,9 +853,8 @@ static int log_tree_diff(struct rev_info *opt, struct commit *commit, struct log
 			 * we merged _in_.
 			 */
 			parse_commit_or_die(parents->item);
-			diff_tree_sha1(parents->item->tree->object.oid.hash,
-				       oid->hash, "", &opt->diffopt);
-			log_tree_diff_flush(opt);
+			diff_tree_std(opt, &parents->item->tree->object.oid, oid);
+			show_diff_queue(opt);
 			return !opt->loginfo;
 		}
 
@@ -837,9 +867,8 @@ static int log_tree_diff(struct rev_info *opt, struct commit *commit, struct log
 		struct commit *parent = parents->item;
 
 		parse_commit_or_die(parent);
-		diff_tree_sha1(parent->tree->object.oid.hash,
-			       oid->hash, "", &opt->diffopt);
-		log_tree_diff_flush(opt);
+		diff_tree_std(opt, &parent->tree->object.oid, oid);
+		show_diff_queue(opt);
 
 		showed_log |= !opt->loginfo;
 
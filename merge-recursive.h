@@ -3,6 +3,8 @@
 
 #include "string-list.h"
 
+struct rename_cache;
+
 struct merge_options {
 	const char *ancestor;
 	const char *branch1;
@@ -23,6 +25,7 @@ struct merge_options {
 	int rename_score;
 	int needed_rename_limit;
 	int show_rename_progress;
+	struct rename_cache *rename_cache;
 	int call_depth;
 	struct strbuf obuf;
 	struct string_list current_file_set;
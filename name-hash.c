@@ -13,6 +13,11 @@ struct dir_entry {
 	struct dir_entry *parent;
 	int nr;
 	unsigned int namelen;
+	/*
+	 * Position of the index entry it was created for; only used
+	 * while the threads of lazy_init_name_hash() run.
+	 */
+	int first;
 	char name[FLEX_ARRAY];
 };
 
@@ -147,33 +152,6 @@ static inline void threaded_lazy_init_name_hash(
  */
 #define LAZY_THREAD_COST (2000)
 
-/*
- * We use n mutexes to guard n partitions of the "istate->dir_hash"
- * hashtable.  Since "find" and "insert" operations will hash to a
- * particular bucket and modify/search a single chain, we can say
- * that "all chains mod n" are guarded by the same mutex -- rather
- * than having a single mutex to guard the entire table.  (This does
- * require that we disable "rehashing" on the hashtable.)
- *
- * So, a larger value here decreases the probability of a collision
- * and the time that each thread must wait for the mutex.
- */
-#define LAZY_MAX_MUTEX   (32)
-
-static pthread_mutex_t *lazy_dir_mutex_array;
-
-/*
- * An array of lazy_entry items is used by the n threads in
- * the directory parse (first) phase to (lock-free) store the
- * intermediate results.  These values are then referenced by
- * the 2 threads in the second phase.
- */
-struct lazy_entry {
-	struct dir_entry *dir;
-	unsigned int hash_dir;
-	unsigned int hash_name;
-};
-
 /*
  * Decide if we want to use threads (if available) to load
  * the hash tables.  We set "lazy_nr_dir_threads" to zero when
@@ -196,6 +174,14 @@ static int lookup_lazy_params(struct index_state *istate)
 	if (!ignore_case)
 		return 0;
 
+	/* the test helper can ask for a specific number of threads */
+	if (lazy_try_threaded > 1) {
+		if (istate->cache_nr >= 2)
+			lazy_nr_dir_threads = istate->cache_nr < lazy_try_threaded ?
+				istate->cache_nr : lazy_try_threaded;
+		return lazy_nr_dir_threads;
+	}
+
 	nr_cpus = online_cpus();
 	if (nr_cpus < 2)
 		return 0;
@@ -210,62 +196,149 @@ static int lookup_lazy_params(struct index_state *istate)
 }
 
 /*
- * Initialize n mutexes for use when searching and inserting
- * into "istate->dir_hash".  All "dir" threads are trying
- * to insert partial pathnames into the hash as they iterate
- * over their portions of the index, so lock contention is
- * high.
+ * The "dir" threads insert into "istate->dir_hash" and
+ * "istate->name_hash" concurrently, without taking locks: an entry is
+ * added by atomically swinging the head pointer of its bucket's chain
+ * from the head it was linked to onto the new entry (and retrying
+ * when another thread got there first).  Searches can run alongside,
+ * as entries are only ever prepended to a chain and are complete
+ * before they are published.  This requires that the hashtables are
+ * not rehashed while the threads run, so they are sized up front.
  *
- * However, the hashmap is going to put items into bucket
- * chains based on their hash values.  Use that to create n
- * mutexes and lock on mutex[bucket(hash) % n].  This will
- * decrease the collision rate by (hopefully) by a factor of n.
+ * Without compiler support for atomic operations, the compare-and-swap
+ * and the increments are emulated with n mutexes guarding "all chains
+ * mod n" (and all counters whose address is the same mod n).
  */
-static void init_dir_mutex(void)
+#if defined(__GNUC__)
+
+static inline void init_lazy_atomics(void)
+{
+}
+
+static inline void cleanup_lazy_atomics(void)
+{
+}
+
+static inline int bucket_cas(struct hashmap_entry **slot,
+			     struct hashmap_entry *old,
+			     struct hashmap_entry *new)
+{
+	return __sync_bool_compare_and_swap(slot, old, new);
+}
+
+static inline void atomic_inc(int *counter)
+{
+	__sync_fetch_and_add(counter, 1);
+}
+
+#else
+
+#define LAZY_MAX_MUTEX   (32)
+
+static pthread_mutex_t *lazy_mutex_array;
+
+static void init_lazy_atomics(void)
 {
 	int j;
 
-	lazy_dir_mutex_array = xcalloc(LAZY_MAX_MUTEX, sizeof(pthread_mutex_t));
+	lazy_mutex_array = xcalloc(LAZY_MAX_MUTEX, sizeof(pthread_mutex_t));
 
 	for (j = 0; j < LAZY_MAX_MUTEX; j++)
-		init_recursive_mutex(&lazy_dir_mutex_array[j]);
+		pthread_mutex_init(&lazy_mutex_array[j], NULL);
 }
 
-static void cleanup_dir_mutex(void)
+static void cleanup_lazy_atomics(void)
 {
 	int j;
 
 	for (j = 0; j < LAZY_MAX_MUTEX; j++)
-		pthread_mutex_destroy(&lazy_dir_mutex_array[j]);
+		pthread_mutex_destroy(&lazy_mutex_array[j]);
+
+	free(lazy_mutex_array);
+}
+
+static inline pthread_mutex_t *lazy_mutex(const void *p)
+{
+	return &lazy_mutex_array[((uintptr_t)p / sizeof(void *)) % LAZY_MAX_MUTEX];
+}
+
+static int bucket_cas(struct hashmap_entry **slot,
+		      struct hashmap_entry *old,
+		      struct hashmap_entry *new)
+{
+	pthread_mutex_t *mutex = lazy_mutex(slot);
+	int ret = 0;
 
-	free(lazy_dir_mutex_array);
+	pthread_mutex_lock(mutex);
+	if (*slot == old) {
+		*slot = new;
+		ret = 1;
+	}
+	pthread_mutex_unlock(mutex);
+	return ret;
 }
 
-static void lock_dir_mutex(int j)
+static void atomic_inc(int *counter)
 {
-	pthread_mutex_lock(&lazy_dir_mutex_array[j]);
+	pthread_mutex_t *mutex = lazy_mutex(counter);
+
+	pthread_mutex_lock(mutex);
+	(*counter)++;
+	pthread_mutex_unlock(mutex);
 }
 
-static void unlock_dir_mutex(int j)
+#endif
+
+static inline struct hashmap_entry *bucket_head(struct hashmap_entry **slot)
 {
-	pthread_mutex_unlock(&lazy_dir_mutex_array[j]);
+	return *(struct hashmap_entry * volatile *)slot;
 }
 
-static inline int compute_dir_lock_nr(
-	const struct hashmap *map,
-	unsigned int hash)
+static void concurrent_hashmap_add(struct hashmap *map,
+				   struct hashmap_entry *e)
 {
-	return hashmap_bucket(map, hash) % LAZY_MAX_MUTEX;
+	struct hashmap_entry **slot = &map->table[hashmap_bucket(map, e->hash)];
+
+	do {
+		e->next = bucket_head(slot);
+	} while (!bucket_cas(slot, e->next, e));
 }
 
+/*
+ * A directory found by a thread that was created by another thread for
+ * an index entry that comes later than the one at position "k".
+ */
+struct lazy_dir_fixup {
+	struct dir_entry *dir;
+	int k;
+};
+
+/*
+ * Each "dir" thread works on its own range of the index and counts
+ * the entries it adds to the hashtables; the sizes of the tables are
+ * updated from these after the threads are done.
+ */
+struct lazy_dir_thread_data {
+	pthread_t pthread;
+	struct index_state *istate;
+	int k_start;
+	int k_end;
+	unsigned int nr_dirs;
+	unsigned int nr_names;
+	struct lazy_dir_fixup *fixups;
+	int fixups_nr, fixups_alloc;
+};
+
 static struct dir_entry *hash_dir_entry_with_parent_and_prefix(
-	struct index_state *istate,
+	struct lazy_dir_thread_data *d,
+	int k,
 	struct dir_entry *parent,
 	struct strbuf *prefix)
 {
-	struct dir_entry *dir;
+	struct hashmap *map = &d->istate->dir_hash;
+	struct hashmap_entry **slot, *head, *e, *seen = NULL;
+	struct dir_entry *dir = NULL;
 	unsigned int hash;
-	int lock_nr;
 
 	/*
 	 * Either we have a parent directory and path with slash(es)
@@ -280,29 +353,51 @@ static struct dir_entry *hash_dir_entry_with_parent_and_prefix(
 	else
 		hash = memihash(prefix->buf, prefix->len);
 
-	lock_nr = compute_dir_lock_nr(&istate->dir_hash, hash);
-	lock_dir_mutex(lock_nr);
-
-	dir = find_dir_entry__hash(istate, prefix->buf, prefix->len, hash);
-	if (!dir) {
-		FLEX_ALLOC_MEM(dir, name, prefix->buf, prefix->len);
-		hashmap_entry_init(dir, hash);
-		dir->namelen = prefix->len;
-		dir->parent = parent;
-		hashmap_add(&istate->dir_hash, dir);
-
-		if (parent) {
-			unlock_dir_mutex(lock_nr);
+	slot = &map->table[hashmap_bucket(map, hash)];
+	for (;;) {
+		/*
+		 * Look for the directory in the part of the chain we
+		 * have not seen yet, i.e. all of it the first time, and
+		 * what other threads prepended when we fail to add it.
+		 */
+		head = bucket_head(slot);
+		for (e = head; e != seen; e = e->next) {
+			struct dir_entry *found = (struct dir_entry *)e;
+			if (e->hash == hash && found->namelen == prefix->len &&
+			    !strncasecmp(found->name, prefix->buf, prefix->len)) {
+				/*
+				 * The directory has to be spelled
+				 * as in its first entry, as if the
+				 * index was hashed in order.
+				 */
+				if (found->first > k) {
+					ALLOC_GROW(d->fixups, d->fixups_nr + 1,
+						   d->fixups_alloc);
+					d->fixups[d->fixups_nr].dir = found;
+					d->fixups[d->fixups_nr].k = k;
+					d->fixups_nr++;
+				}
+				free(dir);
+				return found;
+			}
+		}
 
-			/* All I really need here is an InterlockedIncrement(&(parent->nr)) */
-			lock_nr = compute_dir_lock_nr(&istate->dir_hash, parent->ent.hash);
-			lock_dir_mutex(lock_nr);
-			parent->nr++;
+		if (!dir) {
+			FLEX_ALLOC_MEM(dir, name, prefix->buf, prefix->len);
+			hashmap_entry_init(dir, hash);
+			dir->namelen = prefix->len;
+			dir->parent = parent;
+			dir->first = k;
 		}
+		dir->ent.next = head;
+		if (bucket_cas(slot, head, &dir->ent))
+			break;
+		seen = head;
 	}
 
-	unlock_dir_mutex(lock_nr);
-
+	d->nr_dirs++;
+	if (parent)
+		atomic_inc(&parent->nr);
 	return dir;
 }
 
@@ -314,27 +409,26 @@ static struct dir_entry *hash_dir_entry_with_parent_and_prefix(
  * directory.
  */
 static int handle_range_1(
-	struct index_state *istate,
+	struct lazy_dir_thread_data *d,
 	int k_start,
 	int k_end,
 	struct dir_entry *parent,
-	struct strbuf *prefix,
-	struct lazy_entry *lazy_entries);
+	struct strbuf *prefix);
 
 static int handle_range_dir(
-	struct index_state *istate,
+	struct lazy_dir_thread_data *d,
 	int k_start,
 	int k_end,
 	struct dir_entry *parent,
 	struct strbuf *prefix,
-	struct lazy_entry *lazy_entries,
 	struct dir_entry **dir_new_out)
 {
+	struct index_state *istate = d->istate;
 	int rc, k;
 	int input_prefix_len = prefix->len;
 	struct dir_entry *dir_new;
 
-	dir_new = hash_dir_entry_with_parent_and_prefix(istate, parent, prefix);
+	dir_new = hash_dir_entry_with_parent_and_prefix(d, k_start, parent, prefix);
 
 	strbuf_addch(prefix, '/');
 
@@ -367,7 +461,7 @@ static int handle_range_dir(
 	/*
 	 * Recurse and process what we can of this subset [k_start, k).
 	 */
-	rc = handle_range_1(istate, k_start, k, dir_new, prefix, lazy_entries);
+	rc = handle_range_1(d, k_start, k, dir_new, prefix);
 
 	strbuf_setlen(prefix, input_prefix_len);
 
@@ -376,19 +470,20 @@ static int handle_range_dir(
 }
 
 static int handle_range_1(
-	struct index_state *istate,
+	struct lazy_dir_thread_data *d,
 	int k_start,
 	int k_end,
 	struct dir_entry *parent,
-	struct strbuf *prefix,
-	struct lazy_entry *lazy_entries)
+	struct strbuf *prefix)
 {
+	struct index_state *istate = d->istate;
 	int input_prefix_len = prefix->len;
 	int k = k_start;
 
 	while (k < k_end) {
 		struct cache_entry *ce_k = istate->cache[k];
 		const char *name, *slash;
+		unsigned int hash;
 
 		if (prefix->len && strncmp(ce_k->name, prefix->buf, prefix->len))
 			break;
@@ -402,7 +497,7 @@ static int handle_range_1(
 			struct dir_entry *dir_new;
 
 			strbuf_add(prefix, name, len);
-			processed = handle_range_dir(istate, k, k_end, parent, prefix, lazy_entries, &dir_new);
+			processed = handle_range_dir(d, k, k_end, parent, prefix, &dir_new);
 			if (processed) {
 				k += processed;
 				strbuf_setlen(prefix, input_prefix_len);
@@ -410,35 +505,25 @@ static int handle_range_1(
 			}
 
 			strbuf_addch(prefix, '/');
-			processed = handle_range_1(istate, k, k_end, dir_new, prefix, lazy_entries);
+			processed = handle_range_1(d, k, k_end, dir_new, prefix);
 			k += processed;
 			strbuf_setlen(prefix, input_prefix_len);
 			continue;
 		}
 
-		/*
-		 * It is too expensive to take a lock to insert "ce_k"
-		 * into "istate->name_hash" and increment the ref-count
-		 * on the "parent" dir.  So we defer actually updating
-		 * permanent data structures until phase 2 (where we
-		 * can change the locking requirements) and simply
-		 * accumulate our current results into the lazy_entries
-		 * data array).
-		 *
-		 * We do not need to lock the lazy_entries array because
-		 * we have exclusive access to the cells in the range
-		 * [k_start,k_end) that this thread was given.
-		 */
-		lazy_entries[k].dir = parent;
-		if (parent) {
-			lazy_entries[k].hash_name = memihash_cont(
-				parent->ent.hash,
-				ce_k->name + parent->namelen,
-				ce_namelen(ce_k) - parent->namelen);
-			lazy_entries[k].hash_dir = parent->ent.hash;
-		} else {
-			lazy_entries[k].hash_name = memihash(ce_k->name, ce_namelen(ce_k));
-		}
+		if (parent)
+			hash = memihash_cont(parent->ent.hash,
+					     ce_k->name + parent->namelen,
+					     ce_namelen(ce_k) - parent->namelen);
+		else
+			hash = memihash(ce_k->name, ce_namelen(ce_k));
+
+		ce_k->ce_flags |= CE_HASHED;
+		hashmap_entry_init(ce_k, hash);
+		concurrent_hashmap_add(&istate->name_hash, &ce_k->ent);
+		d->nr_names++;
+		if (parent)
+			atomic_inc(&parent->nr);
 
 		k++;
 	}
@@ -446,54 +531,69 @@ static int handle_range_1(
 	return k - k_start;
 }
 
-struct lazy_dir_thread_data {
-	pthread_t pthread;
-	struct index_state *istate;
-	struct lazy_entry *lazy_entries;
-	int k_start;
-	int k_end;
-};
-
-static void *lazy_dir_thread_proc(void *_data)
+static int lazy_entry_cmp(const struct hashmap_entry *a,
+			  const struct hashmap_entry *b)
 {
-	struct lazy_dir_thread_data *d = _data;
-	struct strbuf prefix = STRBUF_INIT;
-	handle_range_1(d->istate, d->k_start, d->k_end, NULL, &prefix, d->lazy_entries);
-	strbuf_release(&prefix);
-	return NULL;
-}
+	const struct cache_entry *ce_a = (const struct cache_entry *)a;
+	const struct cache_entry *ce_b = (const struct cache_entry *)b;
 
-struct lazy_name_thread_data {
-	pthread_t pthread;
-	struct index_state *istate;
-	struct lazy_entry *lazy_entries;
-};
+	return cache_name_stage_compare(ce_a->name, ce_namelen(ce_a), ce_stage(ce_a),
+					ce_b->name, ce_namelen(ce_b), ce_stage(ce_b));
+}
 
-static void *lazy_name_thread_proc(void *_data)
+/*
+ * Entries that were added by different threads to the same chain of
+ * "name_hash" can be in any order.  Put them in the reverse order of
+ * the index, as if they had been added one after the other, so that
+ * the first match found for a name that is in the index with more than
+ * one spelling does not depend on the timing of the threads.
+ */
+static void sort_name_hash_chains(struct hashmap *map)
 {
-	struct lazy_name_thread_data *d = _data;
-	int k;
+	unsigned int i;
 
-	for (k = 0; k < d->istate->cache_nr; k++) {
-		struct cache_entry *ce_k = d->istate->cache[k];
-		ce_k->ce_flags |= CE_HASHED;
-		hashmap_entry_init(ce_k, d->lazy_entries[k].hash_name);
-		hashmap_add(&d->istate->name_hash, ce_k);
-	}
+	for (i = 0; i < map->tablesize; i++) {
+		struct hashmap_entry *sorted = NULL, *e, *next;
 
-	return NULL;
+		if (!map->table[i] || !map->table[i]->next)
+			continue;
+		for (e = map->table[i]; e; e = next) {
+			struct hashmap_entry **pos = &sorted;
+
+			next = e->next;
+			while (*pos && lazy_entry_cmp(*pos, e) > 0)
+				pos = &(*pos)->next;
+			e->next = *pos;
+			*pos = e;
+		}
+		map->table[i] = sorted;
+	}
 }
 
-static inline void lazy_update_dir_ref_counts(
-	struct index_state *istate,
-	struct lazy_entry *lazy_entries)
+static void apply_lazy_dir_fixups(struct index_state *istate,
+				  struct lazy_dir_thread_data *d)
 {
-	int k;
+	int i;
 
-	for (k = 0; k < istate->cache_nr; k++) {
-		if (lazy_entries[k].dir)
-			lazy_entries[k].dir->nr++;
+	for (i = 0; i < d->fixups_nr; i++) {
+		struct dir_entry *dir = d->fixups[i].dir;
+		int k = d->fixups[i].k;
+
+		if (k < dir->first) {
+			memcpy(dir->name, istate->cache[k]->name, dir->namelen);
+			dir->first = k;
+		}
 	}
+	free(d->fixups);
+}
+
+static void *lazy_dir_thread_proc(void *_data)
+{
+	struct lazy_dir_thread_data *d = _data;
+	struct strbuf prefix = STRBUF_INIT;
+	handle_range_1(d, d->k_start, d->k_end, NULL, &prefix);
+	strbuf_release(&prefix);
+	return NULL;
 }
 
 static void threaded_lazy_init_name_hash(
@@ -502,31 +602,34 @@ static void threaded_lazy_init_name_hash(
 	int nr_each;
 	int k_start;
 	int t;
-	struct lazy_entry *lazy_entries;
 	struct lazy_dir_thread_data *td_dir;
-	struct lazy_name_thread_data *td_name;
 
 	k_start = 0;
 	nr_each = DIV_ROUND_UP(istate->cache_nr, lazy_nr_dir_threads);
 
-	lazy_entries = xcalloc(istate->cache_nr, sizeof(struct lazy_entry));
 	td_dir = xcalloc(lazy_nr_dir_threads, sizeof(struct lazy_dir_thread_data));
-	td_name = xcalloc(1, sizeof(struct lazy_name_thread_data));
 
-	init_dir_mutex();
+	init_lazy_atomics();
 
 	/*
-	 * Phase 1:
-	 * Build "istate->dir_hash" using n "dir" threads (and a read-only index).
+	 * Build "istate->dir_hash" and "istate->name_hash" using n "dir"
+	 * threads (and a read-only index).
+	 *
+	 * Entries with the same name (in different stages) are kept in
+	 * the same range, so that they end up in the same order in
+	 * their chain as if they had been added one after the other.
 	 */
 	for (t = 0; t < lazy_nr_dir_threads; t++) {
 		struct lazy_dir_thread_data *td_dir_t = td_dir + t;
 		td_dir_t->istate = istate;
-		td_dir_t->lazy_entries = lazy_entries;
 		td_dir_t->k_start = k_start;
 		k_start += nr_each;
 		if (k_start > istate->cache_nr)
 			k_start = istate->cache_nr;
+		while (k_start > 0 && k_start < istate->cache_nr &&
+		       !strcmp(istate->cache[k_start - 1]->name,
+			       istate->cache[k_start]->name))
+			k_start++;
 		td_dir_t->k_end = k_start;
 		if (pthread_create(&td_dir_t->pthread, NULL, lazy_dir_thread_proc, td_dir_t))
 			die("unable to create lazy_dir_thread");
@@ -535,33 +638,15 @@ static void threaded_lazy_init_name_hash(
 		struct lazy_dir_thread_data *td_dir_t = td_dir + t;
 		if (pthread_join(td_dir_t->pthread, NULL))
 			die("unable to join lazy_dir_thread");
+		istate->dir_hash.size += td_dir_t->nr_dirs;
+		istate->name_hash.size += td_dir_t->nr_names;
+		apply_lazy_dir_fixups(istate, td_dir_t);
 	}
+	sort_name_hash_chains(&istate->name_hash);
 
-	/*
-	 * Phase 2:
-	 * Iterate over all index entries and add them to the "istate->name_hash"
-	 * using a single "name" background thread.
-	 * (Testing showed it wasn't worth running more than 1 thread for this.)
-	 *
-	 * Meanwhile, finish updating the parent directory ref-counts for each
-	 * index entry using the current thread.  (This step is very fast and
-	 * doesn't need threading.)
-	 */
-	td_name->istate = istate;
-	td_name->lazy_entries = lazy_entries;
-	if (pthread_create(&td_name->pthread, NULL, lazy_name_thread_proc, td_name))
-		die("unable to create lazy_name_thread");
-
-	lazy_update_dir_ref_counts(istate, lazy_entries);
-
-	if (pthread_join(td_name->pthread, NULL))
-		die("unable to join lazy_name_thread");
-
-	cleanup_dir_mutex();
+	cleanup_lazy_atomics();
 
-	free(td_name);
 	free(td_dir);
-	free(lazy_entries);
 }
 
 #endif
@@ -577,8 +662,10 @@ static void lazy_init_name_hash(struct index_state *istate)
 
 	if (lookup_lazy_params(istate)) {
 		hashmap_disallow_rehash(&istate->dir_hash, 1);
+		hashmap_disallow_rehash(&istate->name_hash, 1);
 		threaded_lazy_init_name_hash(istate);
 		hashmap_disallow_rehash(&istate->dir_hash, 0);
+		hashmap_disallow_rehash(&istate->name_hash, 0);
 	} else {
 		int nr;
 		for (nr = 0; nr < istate->cache_nr; nr++)
@@ -595,7 +682,8 @@ static void lazy_init_name_hash(struct index_state *istate)
  * the non-threaded code path was used.
  *
  * Requesting threading WILL NOT override guards
- * in lookup_lazy_params().
+ * in lookup_lazy_params(), unless a specific number
+ * of threads (more than 1) is given in try_threaded.
  */
 int test_lazy_init_name_hash(struct index_state *istate, int try_threaded)
 {
@@ -5,7 +5,20 @@
 #include "commit.h"
 #include "tag.h"
 
-static struct object **obj_hash;
+/*
+ * The object hash table uses open addressing with linear probing.  Each
+ * bucket keeps the first eight bytes of the object name next to the
+ * pointer: a probe only has to dereference the object when those match,
+ * which for any other object is next to impossible, and growing the
+ * table does not have to touch the objects at all.  With 16-byte
+ * buckets, the probes for a lookup usually stay within one cache line.
+ */
+struct obj_hash_entry {
+	uint64_t prefix;
+	struct object *obj;
+};
+
+static struct obj_hash_entry *obj_hash;
 static int nr_objs, obj_hash_size;
 
 unsigned int get_max_object_index(void)
@@ -15,7 +28,7 @@ unsigned int get_max_object_index(void)
 
 struct object *get_indexed_object(unsigned int idx)
 {
-	return obj_hash[idx];
+	return obj_hash[idx].obj;
 }
 
 static const char *object_type_strings[] = {
@@ -51,31 +64,40 @@ int type_from_string_gently(const char *str, ssize_t len, int gentle)
 	die("invalid object type \"%s\"", str);
 }
 
+static inline uint64_t hash_prefix(const unsigned char *sha1)
+{
+	uint64_t prefix;
+	memcpy(&prefix, sha1, sizeof(prefix));
+	return prefix;
+}
+
 /*
  * Return a numerical hash value between 0 and n-1 for the object with
- * the specified sha1.  n must be a power of 2.  Please note that the
- * return value is *not* consistent across computer architectures.
+ * the specified name prefix.  n must be a power of 2.  Please note that
+ * the return value is *not* consistent across computer architectures.
  */
-static unsigned int hash_obj(const unsigned char *sha1, unsigned int n)
+static inline unsigned int hash_obj(uint64_t prefix, unsigned int n)
 {
-	return sha1hash(sha1) & (n - 1);
+	return (unsigned int)prefix & (n - 1);
 }
 
 /*
- * Insert obj into the hash table hash, which has length size (which
+ * Insert an entry into the hash table hash, which has length size (which
  * must be a power of 2).  On collisions, simply overflow to the next
  * empty bucket.
  */
-static void insert_obj_hash(struct object *obj, struct object **hash, unsigned int size)
+static void insert_obj_hash(uint64_t prefix, struct object *obj,
+			    struct obj_hash_entry *hash, unsigned int size)
 {
-	unsigned int j = hash_obj(obj->oid.hash, size);
+	unsigned int j = hash_obj(prefix, size);
 
-	while (hash[j]) {
+	while (hash[j].obj) {
 		j++;
 		if (j >= size)
 			j = 0;
 	}
-	hash[j] = obj;
+	hash[j].prefix = prefix;
+	hash[j].obj = obj;
 }
 
 /*
@@ -84,29 +106,23 @@ static void insert_obj_hash(struct object *obj, struct object **hash, unsigned i
  */
 struct object *lookup_object(const unsigned char *sha1)
 {
-	unsigned int i, first;
-	struct object *obj;
+	unsigned int i;
+	uint64_t prefix;
+	struct obj_hash_entry *e;
 
 	if (!obj_hash)
 		return NULL;
 
-	first = i = hash_obj(sha1, obj_hash_size);
-	while ((obj = obj_hash[i]) != NULL) {
-		if (!hashcmp(sha1, obj->oid.hash))
-			break;
+	prefix = hash_prefix(sha1);
+	i = hash_obj(prefix, obj_hash_size);
+	while ((e = &obj_hash[i])->obj != NULL) {
+		if (e->prefix == prefix && !hashcmp(sha1, e->obj->oid.hash))
+			return e->obj;
 		i++;
 		if (i == obj_hash_size)
 			i = 0;
 	}
-	if (obj && i != first) {
-		/*
-		 * Move object to where we started to look for it so
-		 * that we do not need to walk the hash table the next
-		 * time we look for it.
-		 */
-		SWAP(obj_hash[i], obj_hash[first]);
-	}
-	return obj;
+	return NULL;
 }
 
 /*
@@ -122,14 +138,14 @@ static void grow_object_hash(void)
 	 * above.
 	 */
 	int new_hash_size = obj_hash_size < 32 ? 32 : 2 * obj_hash_size;
-	struct object **new_hash;
+	struct obj_hash_entry *new_hash;
 
-	new_hash = xcalloc(new_hash_size, sizeof(struct object *));
+	new_hash = xcalloc(new_hash_size, sizeof(*new_hash));
 	for (i = 0; i < obj_hash_size; i++) {
-		struct object *obj = obj_hash[i];
-		if (!obj)
+		struct obj_hash_entry *e = &obj_hash[i];
+		if (!e->obj)
 			continue;
-		insert_obj_hash(obj, new_hash, new_hash_size);
+		insert_obj_hash(e->prefix, e->obj, new_hash, new_hash_size);
 	}
 	free(obj_hash);
 	obj_hash = new_hash;
@@ -148,7 +164,7 @@ void *create_object(const unsigned char *sha1, void *o)
 	if (obj_hash_size - 1 <= nr_objs * 2)
 		grow_object_hash();
 
-	insert_obj_hash(obj, obj_hash, obj_hash_size);
+	insert_obj_hash(hash_prefix(sha1), obj, obj_hash, obj_hash_size);
 	nr_objs++;
 	return obj;
 }
@@ -418,7 +434,7 @@ void clear_object_flags(unsigned flags)
 	int i;
 
 	for (i=0; i < obj_hash_size; i++) {
-		struct object *obj = obj_hash[i];
+		struct object *obj = obj_hash[i].obj;
 		if (obj)
 			obj->flags &= ~flags;
 	}
@@ -10,6 +10,7 @@
 #include "pack-bitmap.h"
 #include "sha1-lookup.h"
 #include "pack-objects.h"
+#include "prio-queue.h"
 
 struct bitmapped_commit {
 	struct commit *commit;
@@ -18,6 +19,7 @@ struct bitmapped_commit {
 	int flags;
 	int xor_offset;
 	uint32_t commit_pos;
+	off_t offset; /* of the entry in the .bitmap file */
 };
 
 struct bitmap_writer {
@@ -104,9 +106,6 @@ void bitmap_writer_build_type_index(struct pack_idx_entry **index,
 /**
  * Compute the actual bitmaps
  */
-static struct object **seen_objects;
-static unsigned int seen_objects_nr, seen_objects_alloc;
-
 static inline void push_bitmapped_commit(struct commit *commit, struct ewah_bitmap *reused)
 {
 	if (writer.selected_nr >= writer.selected_alloc) {
@@ -121,21 +120,6 @@ static inline void push_bitmapped_commit(struct commit *commit, struct ewah_bitm
 	writer.selected_nr++;
 }
 
-static inline void mark_as_seen(struct object *object)
-{
-	ALLOC_GROW(seen_objects, seen_objects_nr + 1, seen_objects_alloc);
-	seen_objects[seen_objects_nr++] = object;
-}
-
-static inline void reset_all_seen(void)
-{
-	unsigned int i;
-	for (i = 0; i < seen_objects_nr; ++i) {
-		seen_objects[i]->flags &= ~(SEEN | ADDED | SHOWN);
-	}
-	seen_objects_nr = 0;
-}
-
 static uint32_t find_object_pos(const unsigned char *sha1)
 {
 	struct object_entry *entry = packlist_find(writer.to_pack, sha1, NULL);
@@ -148,58 +132,120 @@ static uint32_t find_object_pos(const unsigned char *sha1)
 	return entry->in_pack_pos;
 }
 
-static void show_object(struct object *object, const char *name, void *data)
+static struct ewah_bitmap *find_reused_bitmap(const unsigned char *sha1)
 {
-	struct bitmap *base = data;
-	bitmap_set(base, find_object_pos(object->oid.hash));
-	mark_as_seen(object);
-}
+	khiter_t hash_pos;
 
-static void show_commit(struct commit *commit, void *data)
-{
-	mark_as_seen((struct object *)commit);
+	if (!writer.reused)
+		return NULL;
+
+	hash_pos = kh_get_sha1(writer.reused, sha1);
+	if (hash_pos >= kh_end(writer.reused))
+		return NULL;
+
+	return kh_value(writer.reused, hash_pos);
 }
 
-static int
-add_to_include_set(struct bitmap *base, struct commit *commit)
+/*
+ * The bitmap of the given commit, if we already know it: either we
+ * have computed it for a selected commit, or it comes from the bitmap
+ * index of the pack we are replacing.
+ */
+static struct ewah_bitmap *find_known_bitmap(const unsigned char *sha1)
 {
-	khiter_t hash_pos;
-	uint32_t bitmap_pos = find_object_pos(commit->object.oid.hash);
-
-	if (bitmap_get(base, bitmap_pos))
-		return 0;
+	khiter_t hash_pos = kh_get_sha1(writer.bitmaps, sha1);
 
-	hash_pos = kh_get_sha1(writer.bitmaps, commit->object.oid.hash);
 	if (hash_pos < kh_end(writer.bitmaps)) {
 		struct bitmapped_commit *bc = kh_value(writer.bitmaps, hash_pos);
-		bitmap_or_ewah(base, bc->bitmap);
-		return 0;
+		return bc->bitmap;
 	}
-
-	bitmap_set(base, bitmap_pos);
-	return 1;
+	return find_reused_bitmap(sha1);
 }
 
-static int
-should_include(struct commit *commit, void *_data)
+static void fill_bitmap_tree(struct bitmap *bitmap, struct tree *tree)
 {
-	struct bitmap *base = _data;
+	struct tree_desc desc;
+	struct name_entry entry;
+	uint32_t pos = find_object_pos(tree->object.oid.hash);
+
+	/*
+	 * The bitmap is always closed under reachability, so if the tree
+	 * is in it already, so is everything it refers to.
+	 */
+	if (bitmap_get(bitmap, pos))
+		return;
+	bitmap_set(bitmap, pos);
 
-	if (!add_to_include_set(base, commit)) {
-		struct commit_list *parent = commit->parents;
+	if (parse_tree(tree) < 0)
+		die("unable to load tree object %s",
+		    oid_to_hex(&tree->object.oid));
+	init_tree_desc(&desc, tree->buffer, tree->size);
 
-		mark_as_seen((struct object *)commit);
+	while (tree_entry(&desc, &entry)) {
+		switch (object_type(entry.mode)) {
+		case OBJ_TREE:
+			fill_bitmap_tree(bitmap, lookup_tree(entry.oid->hash));
+			break;
+		case OBJ_BLOB:
+			bitmap_set(bitmap, find_object_pos(entry.oid->hash));
+			break;
+		default:
+			/* submodule commits are not in the pack */
+			break;
+		}
+	}
+
+	free_tree_buffer(tree);
+}
 
-		while (parent) {
-			parent->item->object.flags |= SEEN;
-			mark_as_seen((struct object *)parent->item);
-			parent = parent->next;
+/*
+ * Add everything reachable from "commit" to "bitmap".  The walk stops
+ * at commits whose bitmap is known, and ORs that bitmap in instead.
+ * Commits are visited newest first, so that the known bitmaps (which
+ * belong to older commits) are usually reached before the commits they
+ * cover, and the trees are only filled in at the end, when the bitmap
+ * already has most of the objects that they share with older history.
+ */
+static void fill_bitmap_commit(struct bitmap *bitmap, struct commit *commit,
+			       struct prio_queue *queue)
+{
+	struct tree **trees = NULL;
+	size_t trees_nr = 0, trees_alloc = 0, i;
+
+	prio_queue_put(queue, commit);
+	while (queue->nr) {
+		struct commit *c = prio_queue_get(queue);
+		struct commit_list *p;
+		struct ewah_bitmap *known;
+		uint32_t pos = find_object_pos(c->object.oid.hash);
+
+		if (bitmap_get(bitmap, pos))
+			continue;
+
+		if (c != commit && (known = find_known_bitmap(c->object.oid.hash))) {
+			bitmap_or_ewah(bitmap, known);
+			continue;
 		}
 
-		return 0;
+		bitmap_set(bitmap, pos);
+		if (parse_commit(c))
+			die("unable to parse commit %s", oid_to_hex(&c->object.oid));
+		ALLOC_GROW(trees, trees_nr + 1, trees_alloc);
+		trees[trees_nr++] = c->tree;
+
+		for (p = c->parents; p; p = p->next) {
+			if (bitmap_get(bitmap, find_object_pos(p->item->object.oid.hash)))
+				continue;
+			if (parse_commit(p->item))
+				die("unable to parse commit %s",
+				    oid_to_hex(&p->item->object.oid));
+			prio_queue_put(queue, p->item);
+		}
 	}
 
-	return 1;
+	for (i = 0; i < trees_nr; i++)
+		fill_bitmap_tree(bitmap, trees[i]);
+	free(trees);
 }
 
 static void compute_xor_offsets(void)
@@ -246,9 +292,9 @@ void bitmap_writer_build(struct packing_data *to_pack)
 {
 	static const double REUSE_BITMAP_THRESHOLD = 0.2;
 
-	int i, reuse_after, need_reset;
+	int i, reuse_after;
 	struct bitmap *base = bitmap_new();
-	struct rev_info revs;
+	struct prio_queue queue = { compare_commits_by_commit_date };
 
 	writer.bitmaps = kh_init_sha1();
 	writer.to_pack = to_pack;
@@ -256,18 +302,9 @@ void bitmap_writer_build(struct packing_data *to_pack)
 	if (writer.show_progress)
 		writer.progress = start_progress("Building bitmaps", writer.selected_nr);
 
-	init_revisions(&revs, NULL);
-	revs.tag_objects = 1;
-	revs.tree_objects = 1;
-	revs.blob_objects = 1;
-	revs.no_walk = 0;
-
-	revs.include_check = should_include;
-	reset_revision_walk();
-
 	reuse_after = writer.selected_nr * REUSE_BITMAP_THRESHOLD;
-	need_reset = 0;
 
+	/* oldest first, so that the walks can stop at the older bitmaps */
 	for (i = writer.selected_nr - 1; i >= 0; --i) {
 		struct bitmapped_commit *stored;
 		struct object *object;
@@ -279,30 +316,10 @@ void bitmap_writer_build(struct packing_data *to_pack)
 		object = (struct object *)stored->commit;
 
 		if (stored->bitmap == NULL) {
-			if (i < writer.selected_nr - 1 &&
-			    (need_reset ||
-			     !in_merge_bases(writer.selected[i + 1].commit,
-					     stored->commit))) {
-			    bitmap_reset(base);
-			    reset_all_seen();
-			}
-
-			add_pending_object(&revs, object, "");
-			revs.include_check_data = base;
-
-			if (prepare_revision_walk(&revs))
-				die("revision walk setup failed");
-
-			traverse_commit_list(&revs, show_commit, show_object, base);
-
-			revs.pending.nr = 0;
-			revs.pending.alloc = 0;
-			revs.pending.objects = NULL;
-
+			bitmap_reset(base);
+			fill_bitmap_commit(base, stored->commit, &queue);
 			stored->bitmap = bitmap_to_ewah(base);
-			need_reset = 0;
-		} else
-			need_reset = 1;
+		}
 
 		if (i >= reuse_after)
 			stored->flags |= BITMAP_FLAG_REUSE;
@@ -316,6 +333,7 @@ void bitmap_writer_build(struct packing_data *to_pack)
 		display_progress(writer.progress, writer.selected_nr - i);
 	}
 
+	clear_prio_queue(&queue);
 	bitmap_free(base);
 	stop_progress(&writer.progress);
 
@@ -365,20 +383,6 @@ void bitmap_writer_reuse_bitmaps(struct packing_data *to_pack)
 	rebuild_existing_bitmaps(to_pack, writer.reused, writer.show_progress);
 }
 
-static struct ewah_bitmap *find_reused_bitmap(const unsigned char *sha1)
-{
-	khiter_t hash_pos;
-
-	if (!writer.reused)
-		return NULL;
-
-	hash_pos = kh_get_sha1(writer.reused, sha1);
-	if (hash_pos >= kh_end(writer.reused))
-		return NULL;
-
-	return kh_value(writer.reused, hash_pos);
-}
-
 void bitmap_writer_select_commits(struct commit **indexed_commits,
 				  unsigned int indexed_commits_nr,
 				  int max_bitmaps)
@@ -477,6 +481,8 @@ static void write_selected_commits_v1(struct sha1file *f,
 		if (commit_pos < 0)
 			die("BUG: trying to write commit not in index");
 
+		stored->commit_pos = commit_pos;
+		stored->offset = f->total + f->offset;
 		sha1write_be32(f, commit_pos);
 		sha1write_u8(f, stored->xor_offset);
 		sha1write_u8(f, stored->flags);
@@ -485,6 +491,45 @@ static void write_selected_commits_v1(struct sha1file *f,
 	}
 }
 
+static int table_cmp(const void *va, const void *vb, void *ctx)
+{
+	struct bitmapped_commit *selected = ctx;
+	uint32_t a = selected[*(uint32_t *)va].commit_pos;
+	uint32_t b = selected[*(uint32_t *)vb].commit_pos;
+
+	return (a < b) ? -1 : (a != b);
+}
+
+static void write_lookup_table(struct sha1file *f)
+{
+	uint32_t *table, *table_inv;
+	uint32_t i;
+
+	ALLOC_ARRAY(table, writer.selected_nr);
+	ALLOC_ARRAY(table_inv, writer.selected_nr);
+	for (i = 0; i < writer.selected_nr; i++)
+		table[i] = i;
+	QSORT_S(table, writer.selected_nr, table_cmp, writer.selected);
+	for (i = 0; i < writer.selected_nr; i++)
+		table_inv[table[i]] = i;
+
+	for (i = 0; i < writer.selected_nr; i++) {
+		struct bitmapped_commit *stored = &writer.selected[table[i]];
+		uint32_t xor_row = BITMAP_NO_XOR_ROW;
+
+		if (stored->xor_offset)
+			xor_row = table_inv[table[i] - stored->xor_offset];
+
+		sha1write_be32(f, stored->commit_pos);
+		sha1write_be32(f, (uint64_t)stored->offset >> 32);
+		sha1write_be32(f, (uint64_t)stored->offset & 0xffffffff);
+		sha1write_be32(f, xor_row);
+	}
+
+	free(table);
+	free(table_inv);
+}
+
 static void write_hash_cache(struct sha1file *f,
 			     struct pack_idx_entry **index,
 			     uint32_t index_nr)
@@ -532,6 +577,9 @@ void bitmap_writer_finish(struct pack_idx_entry **index,
 	dump_bitmap(f, writer.tags);
 	write_selected_commits_v1(f, index, index_nr);
 
+	if (options & BITMAP_OPT_LOOKUP_TABLE)
+		write_lookup_table(f);
+
 	if (options & BITMAP_OPT_HASH_CACHE)
 		write_hash_cache(f, index, index_nr);
 
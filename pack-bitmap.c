@@ -57,9 +57,15 @@ static struct bitmap_index {
 	struct ewah_bitmap *blobs;
 	struct ewah_bitmap *tags;
 
-	/* Map from SHA1 -> `stored_bitmap` for all the bitmapped commits */
+	/*
+	 * Map from SHA1 -> `stored_bitmap` for all the bitmapped commits;
+	 * with a lookup table, only for those that have been loaded.
+	 */
 	khash_sha1 *bitmaps;
 
+	/* The lookup table of the bitmapped commits (or NULL if not present) */
+	const unsigned char *table_lookup;
+
 	/* Number of bitmapped commits */
 	uint32_t entry_count;
 
@@ -148,18 +154,33 @@ static int load_bitmap_header(struct bitmap_index *index)
 	/* Parse known bitmap format options */
 	{
 		uint32_t flags = ntohs(header->options);
+		unsigned char *end = index->map + index->map_size - 20;
 
 		if ((flags & BITMAP_OPT_FULL_DAG) == 0)
 			return error("Unsupported options for bitmap index file "
 				"(Git requires BITMAP_OPT_FULL_DAG)");
 
+		index->entry_count = ntohl(header->entry_count);
+
 		if (flags & BITMAP_OPT_HASH_CACHE) {
-			unsigned char *end = index->map + index->map_size - 20;
-			index->hashes = ((uint32_t *)end) - index->pack->num_objects;
+			size_t cache_size = st_mult(index->pack->num_objects, 4);
+			if (cache_size > end - index->map - sizeof(*header))
+				return error("Corrupted bitmap index (too short to fit hash cache)");
+			end -= cache_size;
+			index->hashes = (uint32_t *)end;
+		}
+
+		if (flags & BITMAP_OPT_LOOKUP_TABLE) {
+			size_t table_size = st_mult(index->entry_count,
+						    BITMAP_LOOKUP_TABLE_ROW_WIDTH);
+			if (table_size > end - index->map - sizeof(*header))
+				return error("Corrupted bitmap index (too short to fit lookup table)");
+			end -= table_size;
+			if (git_env_bool("GIT_TEST_BITMAP_LOOKUP_TABLE", 1))
+				index->table_lookup = end;
 		}
 	}
 
-	index->entry_count = ntohl(header->entry_count);
 	index->map_pos += sizeof(*header);
 	return 0;
 }
@@ -247,6 +268,147 @@ static int load_bitmap_entries_v1(struct bitmap_index *index)
 	return 0;
 }
 
+static uint32_t table_commit_pos(struct bitmap_index *index, uint32_t row)
+{
+	return get_be32(index->table_lookup + row * BITMAP_LOOKUP_TABLE_ROW_WIDTH);
+}
+
+static int table_row_cmp(const void *sha1, struct bitmap_index *index,
+			 uint32_t row)
+{
+	return hashcmp(sha1, nth_packed_object_sha1(index->pack,
+						    table_commit_pos(index, row)));
+}
+
+/*
+ * Load the bitmap in the given row of the lookup table, and the ones it
+ * is XOR'ed with that have not been loaded yet.
+ */
+static struct stored_bitmap *load_table_row(struct bitmap_index *index,
+					    uint32_t row)
+{
+	uint32_t *chain = NULL;
+	size_t chain_nr = 0, chain_alloc = 0;
+	struct stored_bitmap *stored = NULL;
+
+	/*
+	 * Walk down the XOR chain until we hit a bitmap that is already
+	 * loaded, or one that is not XOR'ed with anything.
+	 */
+	for (;;) {
+		const unsigned char *sha1, *p;
+		khiter_t pos;
+		uint32_t xor_row;
+
+		if (row >= index->entry_count || chain_nr > index->entry_count) {
+			error("Corrupted bitmap lookup table");
+			goto out;
+		}
+		sha1 = nth_packed_object_sha1(index->pack,
+					      table_commit_pos(index, row));
+		if (!sha1) {
+			error("Corrupted bitmap lookup table");
+			goto out;
+		}
+		pos = kh_get_sha1(index->bitmaps, sha1);
+		if (pos < kh_end(index->bitmaps)) {
+			stored = kh_value(index->bitmaps, pos);
+			break;
+		}
+
+		ALLOC_GROW(chain, chain_nr + 1, chain_alloc);
+		chain[chain_nr++] = row;
+
+		p = index->table_lookup + row * BITMAP_LOOKUP_TABLE_ROW_WIDTH;
+		xor_row = get_be32(p + 12);
+		if (xor_row == BITMAP_NO_XOR_ROW)
+			break;
+		row = xor_row;
+	}
+
+	/* ...and load them in reverse order, each one on top of the next */
+	while (chain_nr) {
+		const unsigned char *p;
+		uint32_t commit_pos;
+		uint64_t offset;
+		struct ewah_bitmap *bitmap;
+		int flags;
+
+		row = chain[--chain_nr];
+		p = index->table_lookup + row * BITMAP_LOOKUP_TABLE_ROW_WIDTH;
+		commit_pos = get_be32(p);
+		offset = ((uint64_t)get_be32(p + 4) << 32) | get_be32(p + 8);
+
+		if (offset > index->map_size - 6 ||
+		    get_be32(index->map + offset) != commit_pos) {
+			error("Corrupted bitmap lookup table");
+			stored = NULL;
+			goto out;
+		}
+		flags = index->map[offset + 5];
+		index->map_pos = offset + 6;
+		bitmap = read_bitmap_1(index);
+		if (!bitmap) {
+			stored = NULL;
+			goto out;
+		}
+		stored = store_bitmap(index, bitmap,
+				      nth_packed_object_sha1(index->pack, commit_pos),
+				      stored, flags);
+		if (!stored)
+			goto out;
+	}
+
+out:
+	free(chain);
+	return stored;
+}
+
+/*
+ * Find the stored bitmap for the given commit, loading it from the
+ * lookup table if needed.  Returns NULL if the commit has no bitmap.
+ */
+static struct stored_bitmap *find_stored_bitmap(struct bitmap_index *index,
+						const unsigned char *sha1)
+{
+	khiter_t pos = kh_get_sha1(index->bitmaps, sha1);
+	uint32_t lo = 0, hi = index->entry_count;
+
+	if (pos < kh_end(index->bitmaps))
+		return kh_value(index->bitmaps, pos);
+	if (!index->table_lookup)
+		return NULL;
+
+	while (lo < hi) {
+		uint32_t mi = lo + (hi - lo) / 2;
+		int cmp = table_row_cmp(sha1, index, mi);
+
+		if (!cmp)
+			return load_table_row(index, mi);
+		if (cmp < 0)
+			hi = mi;
+		else
+			lo = mi + 1;
+	}
+	return NULL;
+}
+
+/*
+ * Make sure that all the bitmaps of the index have been loaded, for
+ * the callers that iterate over index->bitmaps.
+ */
+static int load_all_table_rows(struct bitmap_index *index)
+{
+	uint32_t i;
+
+	if (!index->table_lookup)
+		return 0;
+	for (i = 0; i < index->entry_count; i++)
+		if (!load_table_row(index, i))
+			return -1;
+	return 0;
+}
+
 static char *pack_bitmap_filename(struct packed_git *p)
 {
 	size_t len;
@@ -305,7 +467,8 @@ static int load_pack_bitmap(void)
 
 	bitmap_git.bitmaps = kh_init_sha1();
 	bitmap_git.ext_index.positions = kh_init_sha1_pos();
-	load_pack_revindex(bitmap_git.pack);
+	if (load_pack_revindex(bitmap_git.pack))
+		goto failed;
 
 	if (!(bitmap_git.commits = read_bitmap_1(&bitmap_git)) ||
 		!(bitmap_git.trees = read_bitmap_1(&bitmap_git)) ||
@@ -313,7 +476,9 @@ static int load_pack_bitmap(void)
 		!(bitmap_git.tags = read_bitmap_1(&bitmap_git)))
 		goto failed;
 
-	if (load_bitmap_entries_v1(&bitmap_git) < 0)
+	/* with a lookup table, the bitmaps are loaded when needed */
+	if (!bitmap_git.table_lookup &&
+	    load_bitmap_entries_v1(&bitmap_git) < 0)
 		goto failed;
 
 	bitmap_git.loaded = 1;
@@ -435,7 +600,7 @@ static int add_to_include_set(struct include_data *data,
 			      const unsigned char *sha1,
 			      int bitmap_pos)
 {
-	khiter_t hash_pos;
+	struct stored_bitmap *st;
 
 	if (data->seen && bitmap_get(data->seen, bitmap_pos))
 		return 0;
@@ -443,9 +608,8 @@ static int add_to_include_set(struct include_data *data,
 	if (bitmap_get(data->base, bitmap_pos))
 		return 0;
 
-	hash_pos = kh_get_sha1(bitmap_git.bitmaps, sha1);
-	if (hash_pos < kh_end(bitmap_git.bitmaps)) {
-		struct stored_bitmap *st = kh_value(bitmap_git.bitmaps, hash_pos);
+	st = find_stored_bitmap(&bitmap_git, sha1);
+	if (st) {
 		bitmap_or_ewah(data->base, lookup_stored_bitmap(st));
 		return 0;
 	}
@@ -499,10 +663,10 @@ static struct bitmap *find_objects(struct rev_info *revs,
 		roots = roots->next;
 
 		if (object->type == OBJ_COMMIT) {
-			khiter_t pos = kh_get_sha1(bitmap_git.bitmaps, object->oid.hash);
+			struct stored_bitmap *st =
+				find_stored_bitmap(&bitmap_git, object->oid.hash);
 
-			if (pos < kh_end(bitmap_git.bitmaps)) {
-				struct stored_bitmap *st = kh_value(bitmap_git.bitmaps, pos);
+			if (st) {
 				struct ewah_bitmap *or_with = lookup_stored_bitmap(st);
 
 				if (base == NULL)
@@ -612,7 +776,7 @@ static void show_objects_for_type(
 
 		for (offset = 0; offset < BITS_IN_EWORD; ++offset) {
 			const unsigned char *sha1;
-			struct revindex_entry *entry;
+			uint32_t index_pos;
 			uint32_t hash = 0;
 
 			if ((word >> offset) == 0)
@@ -623,13 +787,14 @@ static void show_objects_for_type(
 			if (pos + offset < bitmap_git.reuse_objects)
 				continue;
 
-			entry = &bitmap_git.pack->revindex[pos + offset];
-			sha1 = nth_packed_object_sha1(bitmap_git.pack, entry->nr);
+			index_pos = pack_pos_to_index(bitmap_git.pack, pos + offset);
+			sha1 = nth_packed_object_sha1(bitmap_git.pack, index_pos);
 
 			if (bitmap_git.hashes)
-				hash = ntohl(bitmap_git.hashes[entry->nr]);
+				hash = ntohl(bitmap_git.hashes[index_pos]);
 
-			show_reach(sha1, object_type, 0, hash, bitmap_git.pack, entry->offset);
+			show_reach(sha1, object_type, 0, hash, bitmap_git.pack,
+				   pack_pos_to_offset(bitmap_git.pack, pos + offset));
 		}
 
 		pos += BITS_IN_EWORD;
@@ -770,10 +935,9 @@ int reuse_partial_packfile_from_bitmap(struct packed_git **packfile,
 #ifdef GIT_BITMAP_DEBUG
 	{
 		const unsigned char *sha1;
-		struct revindex_entry *entry;
 
-		entry = &bitmap_git.reverse_index->revindex[reuse_objects];
-		sha1 = nth_packed_object_sha1(bitmap_git.pack, entry->nr);
+		sha1 = nth_packed_object_sha1(bitmap_git.pack,
+				pack_pos_to_index(bitmap_git.pack, reuse_objects));
 
 		fprintf(stderr, "Failed to reuse at %d (%016llx)\n",
 			reuse_objects, result->words[i]);
@@ -797,7 +961,7 @@ int reuse_partial_packfile_from_bitmap(struct packed_git **packfile,
 		return -1;
 
 	bitmap_git.reuse_objects = *entries = reuse_objects;
-	*up_to = bitmap_git.pack->revindex[reuse_objects].offset;
+	*up_to = pack_pos_to_offset(bitmap_git.pack, reuse_objects);
 	*packfile = bitmap_git.pack;
 
 	return 0;
@@ -822,35 +986,42 @@ void traverse_bitmap_commit_list(show_reachable_fn show_reachable)
 	bitmap_git.result = NULL;
 }
 
-static uint32_t count_object_type(struct bitmap *objects,
-				  enum object_type type)
+static int init_type_iterator(struct ewah_iterator *it,
+			      enum object_type type)
 {
-	struct eindex *eindex = &bitmap_git.ext_index;
-
-	uint32_t i = 0, count = 0;
-	struct ewah_iterator it;
-	eword_t filter;
-
 	switch (type) {
 	case OBJ_COMMIT:
-		ewah_iterator_init(&it, bitmap_git.commits);
-		break;
+		ewah_iterator_init(it, bitmap_git.commits);
+		return 1;
 
 	case OBJ_TREE:
-		ewah_iterator_init(&it, bitmap_git.trees);
-		break;
+		ewah_iterator_init(it, bitmap_git.trees);
+		return 1;
 
 	case OBJ_BLOB:
-		ewah_iterator_init(&it, bitmap_git.blobs);
-		break;
+		ewah_iterator_init(it, bitmap_git.blobs);
+		return 1;
 
 	case OBJ_TAG:
-		ewah_iterator_init(&it, bitmap_git.tags);
-		break;
+		ewah_iterator_init(it, bitmap_git.tags);
+		return 1;
 
 	default:
 		return 0;
 	}
+}
+
+static uint32_t count_object_type(struct bitmap *objects,
+				  enum object_type type)
+{
+	struct eindex *eindex = &bitmap_git.ext_index;
+
+	uint32_t i = 0, count = 0;
+	struct ewah_iterator it;
+	eword_t filter;
+
+	if (!init_type_iterator(&it, type))
+		return 0;
 
 	while (i < objects->word_alloc && ewah_iterator_next(&filter, &it)) {
 		eword_t word = objects->words[i++] & filter;
@@ -884,6 +1055,77 @@ void count_bitmap_commit_list(uint32_t *commits, uint32_t *trees,
 		*tags = count_object_type(bitmap_git.result, OBJ_TAG);
 }
 
+/*
+ * The on-disk size of the objects of the given type in "objects": for
+ * the packed ones, the distance to the next object in pack order, read
+ * from the reverse index; the objects of the extended index are looked
+ * up one by one.
+ */
+static off_t disk_usage_for_type(struct bitmap *objects,
+				 enum object_type type)
+{
+	struct eindex *eindex = &bitmap_git.ext_index;
+	struct packed_git *pack = bitmap_git.pack;
+	size_t pos = 0, i = 0;
+	struct ewah_iterator it;
+	eword_t filter;
+	uint32_t offset;
+	off_t total = 0;
+
+	if (!init_type_iterator(&it, type))
+		return 0;
+
+	while (i < objects->word_alloc && ewah_iterator_next(&filter, &it)) {
+		eword_t word = objects->words[i++] & filter;
+
+		for (offset = 0; offset < BITS_IN_EWORD; ++offset) {
+			if ((word >> offset) == 0)
+				break;
+
+			offset += ewah_bit_ctz64(word >> offset);
+			total += pack_pos_to_offset(pack, pos + offset + 1) -
+				 pack_pos_to_offset(pack, pos + offset);
+		}
+
+		pos += BITS_IN_EWORD;
+	}
+
+	for (i = 0; i < eindex->count; ++i) {
+		struct object *obj = eindex->objects[i];
+		struct object_info oi = OBJECT_INFO_INIT;
+		off_t size;
+
+		if (obj->type != type ||
+		    !bitmap_get(objects, pack->num_objects + i))
+			continue;
+
+		oi.disk_sizep = &size;
+		if (sha1_object_info_extended(obj->oid.hash, &oi, 0) < 0)
+			die(_("unable to get disk usage of %s"),
+			    oid_to_hex(&obj->oid));
+		total += size;
+	}
+
+	return total;
+}
+
+off_t get_disk_usage_from_bitmap(struct rev_info *revs)
+{
+	off_t total;
+
+	assert(bitmap_git.result);
+
+	total = disk_usage_for_type(bitmap_git.result, OBJ_COMMIT);
+	if (revs->tree_objects)
+		total += disk_usage_for_type(bitmap_git.result, OBJ_TREE);
+	if (revs->blob_objects)
+		total += disk_usage_for_type(bitmap_git.result, OBJ_BLOB);
+	if (revs->tag_objects)
+		total += disk_usage_for_type(bitmap_git.result, OBJ_TAG);
+
+	return total;
+}
+
 struct bitmap_test_data {
 	struct bitmap *base;
 	struct progress *prg;
@@ -921,7 +1163,7 @@ void test_bitmap_walk(struct rev_info *revs)
 {
 	struct object *root;
 	struct bitmap *result = NULL;
-	khiter_t pos;
+	struct stored_bitmap *st;
 	size_t result_popcnt;
 	struct bitmap_test_data tdata;
 
@@ -935,10 +1177,9 @@ void test_bitmap_walk(struct rev_info *revs)
 		bitmap_git.version, bitmap_git.entry_count);
 
 	root = revs->pending.objects[0].item;
-	pos = kh_get_sha1(bitmap_git.bitmaps, root->oid.hash);
+	st = find_stored_bitmap(&bitmap_git, root->oid.hash);
 
-	if (pos < kh_end(bitmap_git.bitmaps)) {
-		struct stored_bitmap *st = kh_value(bitmap_git.bitmaps, pos);
+	if (st) {
 		struct ewah_bitmap *bm = lookup_stored_bitmap(st);
 
 		fprintf(stderr, "Found bitmap for %s. %d bits / %08x checksum\n",
@@ -1022,16 +1263,18 @@ int rebuild_existing_bitmaps(struct packing_data *mapping,
 	if (prepare_bitmap_git() < 0)
 		return -1;
 
+	if (load_all_table_rows(&bitmap_git) < 0)
+		return -1;
+
 	num_objects = bitmap_git.pack->num_objects;
 	reposition = xcalloc(num_objects, sizeof(uint32_t));
 
 	for (i = 0; i < num_objects; ++i) {
 		const unsigned char *sha1;
-		struct revindex_entry *entry;
 		struct object_entry *oe;
 
-		entry = &bitmap_git.pack->revindex[i];
-		sha1 = nth_packed_object_sha1(bitmap_git.pack, entry->nr);
+		sha1 = nth_packed_object_sha1(bitmap_git.pack,
+					      pack_pos_to_index(bitmap_git.pack, i));
 		oe = packlist_find(mapping, sha1, NULL);
 
 		if (oe)
@@ -1044,20 +1287,25 @@ int rebuild_existing_bitmaps(struct packing_data *mapping,
 	if (show_progress)
 		progress = start_progress("Reusing bitmaps", 0);
 
+	/*
+	 * The bitmap of a commit stays valid as long as all the objects in
+	 * it are still packed, so we carry over all of them, not only
+	 * those flagged for reuse: besides the selected commits that have
+	 * one already, the bitmap writer can stop walking at any commit
+	 * with a known bitmap.
+	 */
 	kh_foreach_value(bitmap_git.bitmaps, stored, {
-		if (stored->flags & BITMAP_FLAG_REUSE) {
-			if (!rebuild_bitmap(reposition,
-					    lookup_stored_bitmap(stored),
-					    rebuild)) {
-				hash_pos = kh_put_sha1(reused_bitmaps,
-						       stored->sha1,
-						       &hash_ret);
-				kh_value(reused_bitmaps, hash_pos) =
-					bitmap_to_ewah(rebuild);
-			}
-			bitmap_reset(rebuild);
-			display_progress(progress, ++i);
+		if (!rebuild_bitmap(reposition,
+				    lookup_stored_bitmap(stored),
+				    rebuild)) {
+			hash_pos = kh_put_sha1(reused_bitmaps,
+					       stored->sha1,
+					       &hash_ret);
+			kh_value(reused_bitmaps, hash_pos) =
+				bitmap_to_ewah(rebuild);
 		}
+		bitmap_reset(rebuild);
+		display_progress(progress, ++i);
 	});
 
 	stop_progress(&progress);
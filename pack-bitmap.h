@@ -20,8 +20,17 @@ static const char BITMAP_IDX_SIGNATURE[] = {'B', 'I', 'T', 'M'};
 enum pack_bitmap_opts {
 	BITMAP_OPT_FULL_DAG = 1,
 	BITMAP_OPT_HASH_CACHE = 4,
+	BITMAP_OPT_LOOKUP_TABLE = 0x10,
 };
 
+/*
+ * Each row of the lookup table is a 4-byte commit position in the pack
+ * index, the 8-byte offset of its entry in the .bitmap file and the
+ * 4-byte row of the bitmap it is XOR'ed with (or BITMAP_NO_XOR_ROW).
+ */
+#define BITMAP_LOOKUP_TABLE_ROW_WIDTH 16
+#define BITMAP_NO_XOR_ROW 0xffffffff
+
 enum pack_bitmap_flags {
 	BITMAP_FLAG_REUSE = 0x1
 };
@@ -36,6 +45,7 @@ typedef int (*show_reachable_fn)(
 
 int prepare_bitmap_git(void);
 void count_bitmap_commit_list(uint32_t *commits, uint32_t *trees, uint32_t *blobs, uint32_t *tags);
+off_t get_disk_usage_from_bitmap(struct rev_info *revs);
 void traverse_bitmap_commit_list(show_reachable_fn show_reachable);
 void test_bitmap_walk(struct rev_info *revs);
 int prepare_bitmap_walk(struct rev_info *revs);
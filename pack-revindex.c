@@ -13,6 +13,9 @@
  * ordered by offset, so if you know the offset of an object, next offset
  * is where its packed representation ends and the index_nr can be used to
  * get the object sha1 from the main index.
+ *
+ * When the pack comes with a .rev file, the positions stored in it are
+ * used instead, and the offsets are looked up in the pack index.
  */
 
 /*
@@ -157,23 +160,118 @@ static void create_pack_revindex(struct packed_git *p)
 	sort_revindex(p->revindex, num_ent, p->pack_size);
 }
 
-void load_pack_revindex(struct packed_git *p)
+static int load_revindex_file(struct packed_git *p)
 {
-	if (!p->revindex)
+	char *rev_name;
+	size_t len, rev_size;
+	struct stat st;
+	void *map;
+	const uint32_t *hdr;
+	const unsigned char *idx_pack_sha1;
+	int fd, ret = -1;
+
+	if (!strip_suffix(p->pack_name, ".pack", &len))
+		die("BUG: pack_name does not end in .pack");
+	rev_name = xstrfmt("%.*s.rev", (int)len, p->pack_name);
+
+	fd = git_open(rev_name);
+	if (fd < 0) {
+		if (errno != ENOENT)
+			error_errno("unable to open %s", rev_name);
+		goto out;
+	}
+	if (fstat(fd, &st)) {
+		error_errno("unable to stat %s", rev_name);
+		close(fd);
+		goto out;
+	}
+	rev_size = xsize_t(st.st_size);
+	if (rev_size != 12 + st_mult(p->num_objects, 4) + 20 + 20) {
+		error("reverse index file %s has the wrong size", rev_name);
+		close(fd);
+		goto out;
+	}
+	map = xmmap(NULL, rev_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	hdr = map;
+	idx_pack_sha1 = (const unsigned char *)p->index_data + p->index_size - 40;
+	if (ntohl(hdr[0]) != RIDX_SIGNATURE) {
+		error("reverse index file %s has unknown signature", rev_name);
+	} else if (ntohl(hdr[1]) != RIDX_VERSION) {
+		error("reverse index file %s is version %"PRIu32
+		      " and is not supported by this binary",
+		      rev_name, ntohl(hdr[1]));
+	} else if (ntohl(hdr[2]) != 1) {
+		error("reverse index file %s uses an unknown hash function",
+		      rev_name);
+	} else if (hashcmp((const unsigned char *)map + rev_size - 40,
+			   idx_pack_sha1)) {
+		error("reverse index file %s does not match its pack index",
+		      rev_name);
+	} else {
+		p->revindex_map = map;
+		p->revindex_size = rev_size;
+		p->revindex_data = hdr + 3;
+		ret = 0;
+	}
+	if (ret)
+		munmap(map, rev_size);
+out:
+	free(rev_name);
+	return ret;
+}
+
+int load_pack_revindex(struct packed_git *p)
+{
+	if (p->revindex || p->revindex_data)
+		return 0;
+	if (open_pack_index(p))
+		return -1;
+	if (load_revindex_file(p))
 		create_pack_revindex(p);
+	return 0;
+}
+
+void close_pack_revindex(struct packed_git *p)
+{
+	if (p->revindex_map) {
+		munmap((void *)p->revindex_map, p->revindex_size);
+		p->revindex_map = NULL;
+		p->revindex_data = NULL;
+	}
+}
+
+uint32_t pack_pos_to_index(struct packed_git *p, uint32_t pos)
+{
+	if (p->revindex)
+		return p->revindex[pos].nr;
+	return ntohl(p->revindex_data[pos]);
+}
+
+off_t pack_pos_to_offset(struct packed_git *p, uint32_t pos)
+{
+	if (p->revindex)
+		return p->revindex[pos].offset;
+	if (pos == p->num_objects)
+		return p->pack_size - 20;
+	return nth_packed_object_offset(p, ntohl(p->revindex_data[pos]));
 }
 
 int find_revindex_position(struct packed_git *p, off_t ofs)
 {
 	int lo = 0;
 	int hi = p->num_objects + 1;
-	struct revindex_entry *revindex = p->revindex;
+
+	if (load_pack_revindex(p))
+		return -1;
 
 	do {
 		unsigned mi = lo + (hi - lo) / 2;
-		if (revindex[mi].offset == ofs) {
+		off_t mi_ofs = pack_pos_to_offset(p, mi);
+		if (mi_ofs == ofs) {
 			return mi;
-		} else if (ofs < revindex[mi].offset)
+		} else if (ofs < mi_ofs)
 			hi = mi;
 		else
 			lo = mi + 1;
@@ -182,16 +280,3 @@ int find_revindex_position(struct packed_git *p, off_t ofs)
 	error("bad offset for revindex");
 	return -1;
 }
-
-struct revindex_entry *find_pack_revindex(struct packed_git *p, off_t ofs)
-{
-	int pos;
-
-	load_pack_revindex(p);
-	pos = find_revindex_position(p, ofs);
-
-	if (pos < 0)
-		return NULL;
-
-	return p->revindex + pos;
-}
@@ -8,9 +8,46 @@ struct revindex_entry {
 	unsigned int nr;
 };
 
-void load_pack_revindex(struct packed_git *p);
+/*
+ * A reverse index file maps the position of each object in the pack
+ * (that is, the objects sorted by their offset) to its position in the
+ * pack index, and is stored next to the pack as "pack-<sha1>.rev":
+ *
+ *   - 4-byte signature "RIDX"
+ *   - 4-byte version number (network byte order), currently 1
+ *   - 4-byte hash function identifier (network byte order), 1 for SHA-1
+ *   - for each object in pack order, its 4-byte position in the .idx
+ *     (network byte order)
+ *   - 20-byte SHA-1 checksum of the corresponding packfile
+ *   - 20-byte SHA-1 checksum of all of the above
+ */
+#define RIDX_SIGNATURE 0x52494458 /* "RIDX" */
+#define RIDX_VERSION 1
+
+/*
+ * Make the reverse index of the pack available, either by mapping its
+ * .rev file or, if there is none, by computing it in memory.  Returns 0
+ * on success and -1 if the pack index cannot be opened.
+ */
+int load_pack_revindex(struct packed_git *p);
+
+/*
+ * Returns the position in pack order of the object at offset "ofs",
+ * loading the reverse index if needed, or -1 (after reporting an error)
+ * if no object starts at that offset.
+ */
 int find_revindex_position(struct packed_git *p, off_t ofs);
 
-struct revindex_entry *find_pack_revindex(struct packed_git *p, off_t ofs);
+/*
+ * The position in the pack index, and the offset, of the object at
+ * position "pos" in pack order; load_pack_revindex() must have been
+ * called.  For "pos" equal to the number of objects, the offset is the
+ * one at which the pack trailer starts, so that the size of the object
+ * at "pos" is always the offset of "pos + 1" minus its own.
+ */
+uint32_t pack_pos_to_index(struct packed_git *p, uint32_t pos);
+off_t pack_pos_to_offset(struct packed_git *p, uint32_t pos);
+
+void close_pack_revindex(struct packed_git *p);
 
 #endif
@@ -175,6 +175,60 @@ const char *write_idx_file(const char *index_name, struct pack_idx_entry **objec
 	return index_name;
 }
 
+static int pack_order_cmp(const void *va, const void *vb, void *ctx)
+{
+	struct pack_idx_entry **objects = ctx;
+	off_t a = objects[*(uint32_t *)va]->offset;
+	off_t b = objects[*(uint32_t *)vb]->offset;
+
+	return (a < b) ? -1 : (a != b);
+}
+
+/*
+ * The objects array must be sorted by SHA1, as write_idx_file() leaves
+ * it, so that the position of an object in it is its position in the
+ * pack index.
+ */
+const char *write_rev_file(const char *rev_name, struct pack_idx_entry **objects,
+			   uint32_t nr_objects, const unsigned char *sha1)
+{
+	struct sha1file *f;
+	uint32_t *pack_order;
+	uint32_t hdr[3], i;
+	int fd;
+
+	ALLOC_ARRAY(pack_order, nr_objects);
+	for (i = 0; i < nr_objects; i++)
+		pack_order[i] = i;
+	QSORT_S(pack_order, nr_objects, pack_order_cmp, objects);
+
+	if (!rev_name) {
+		struct strbuf tmp_file = STRBUF_INIT;
+		fd = odb_mkstemp(&tmp_file, "pack/tmp_rev_XXXXXX");
+		rev_name = strbuf_detach(&tmp_file, NULL);
+	} else {
+		unlink(rev_name);
+		fd = open(rev_name, O_CREAT|O_EXCL|O_WRONLY, 0600);
+		if (fd < 0)
+			die_errno("unable to create '%s'", rev_name);
+	}
+	f = sha1fd(fd, rev_name);
+
+	hdr[0] = htonl(RIDX_SIGNATURE);
+	hdr[1] = htonl(RIDX_VERSION);
+	hdr[2] = htonl(1);
+	sha1write(f, hdr, sizeof(hdr));
+	for (i = 0; i < nr_objects; i++) {
+		uint32_t nr = htonl(pack_order[i]);
+		sha1write(f, &nr, 4);
+	}
+	sha1write(f, sha1, 20);
+	sha1close(f, NULL, CSUM_FSYNC);
+
+	free(pack_order);
+	return rev_name;
+}
+
 off_t write_pack_header(struct sha1file *f, uint32_t nr_entries)
 {
 	struct pack_header hdr;
@@ -344,7 +398,7 @@ void finish_tmp_packfile(struct strbuf *name_buffer,
 			 struct pack_idx_option *pack_idx_opts,
 			 unsigned char sha1[])
 {
-	const char *idx_tmp_name;
+	const char *idx_tmp_name, *rev_tmp_name = NULL;
 	int basename_len = name_buffer->len;
 
 	if (adjust_shared_perm(pack_tmp_name))
@@ -355,6 +409,13 @@ void finish_tmp_packfile(struct strbuf *name_buffer,
 	if (adjust_shared_perm(idx_tmp_name))
 		die_errno("unable to make temporary index file readable");
 
+	if (pack_idx_opts->flags & WRITE_REV) {
+		rev_tmp_name = write_rev_file(NULL, written_list, nr_written,
+					      sha1);
+		if (adjust_shared_perm(rev_tmp_name))
+			die_errno("unable to make temporary reverse index file readable");
+	}
+
 	strbuf_addf(name_buffer, "%s.pack", sha1_to_hex(sha1));
 
 	if (rename(pack_tmp_name, name_buffer->buf))
@@ -362,6 +423,13 @@ void finish_tmp_packfile(struct strbuf *name_buffer,
 
 	strbuf_setlen(name_buffer, basename_len);
 
+	if (rev_tmp_name) {
+		strbuf_addf(name_buffer, "%s.rev", sha1_to_hex(sha1));
+		if (rename(rev_tmp_name, name_buffer->buf))
+			die_errno("unable to rename temporary reverse index file");
+		strbuf_setlen(name_buffer, basename_len);
+	}
+
 	strbuf_addf(name_buffer, "%s.idx", sha1_to_hex(sha1));
 	if (rename(idx_tmp_name, name_buffer->buf))
 		die_errno("unable to rename temporary index file");
@@ -369,4 +437,5 @@ void finish_tmp_packfile(struct strbuf *name_buffer,
 	strbuf_setlen(name_buffer, basename_len);
 
 	free((void *)idx_tmp_name);
+	free((void *)rev_tmp_name);
 }
@@ -14,66 +14,102 @@ static void preload_index(struct index_state *index,
 #else
 
 #include <pthread.h>
+#include "thread-utils.h"
 
 /*
- * Mostly randomly chosen maximum thread counts: we
- * cap the parallelism to 20 threads, and we want
- * to have at least 500 lstat's per thread for it to
- * be worth starting a thread.
+ * We want to have at least 500 lstat's per thread for it to be worth
+ * starting a thread.  The number of threads is capped to the number
+ * of CPUs, but as the threads mostly wait for lstat() to return, we
+ * allow up to 20 of them even on smaller machines.
+ *
+ * The threads take the entries in batches of PRELOAD_BATCH from a
+ * shared queue, so that a thread that stumbles upon a slow directory
+ * does not hold up the others: contiguous chunks of the index would
+ * put whole directories on one thread.
  */
-#define MAX_PARALLEL (20)
+#define MIN_PARALLEL (20)
 #define THREAD_COST (500)
+#define PRELOAD_BATCH (64)
+
+struct preload_queue {
+	pthread_mutex_t mutex;
+	int next;
+};
 
 struct thread_data {
 	pthread_t pthread;
 	struct index_state *index;
 	struct pathspec pathspec;
-	int offset, nr;
+	struct preload_queue *queue;
+	uint64_t nanos;
+	int nr_entries, nr_lstat;
 };
 
+static int next_batch(struct preload_queue *queue, int cache_nr, int *nr)
+{
+	int offset;
+
+	pthread_mutex_lock(&queue->mutex);
+	offset = queue->next;
+	if (offset < cache_nr)
+		queue->next += PRELOAD_BATCH;
+	pthread_mutex_unlock(&queue->mutex);
+
+	if (offset >= cache_nr)
+		return -1;
+	*nr = cache_nr - offset < PRELOAD_BATCH ?
+		cache_nr - offset : PRELOAD_BATCH;
+	return offset;
+}
+
 static void *preload_thread(void *_data)
 {
-	int nr;
 	struct thread_data *p = _data;
 	struct index_state *index = p->index;
-	struct cache_entry **cep = index->cache + p->offset;
 	struct cache_def cache = CACHE_DEF_INIT;
+	uint64_t start = getnanotime();
+	int offset, nr;
+
+	while ((offset = next_batch(p->queue, index->cache_nr, &nr)) >= 0) {
+		struct cache_entry **cep = index->cache + offset;
+
+		p->nr_entries += nr;
+		do {
+			struct cache_entry *ce = *cep++;
+			struct stat st;
 
-	nr = p->nr;
-	if (nr + p->offset > index->cache_nr)
-		nr = index->cache_nr - p->offset;
-
-	do {
-		struct cache_entry *ce = *cep++;
-		struct stat st;
-
-		if (ce_stage(ce))
-			continue;
-		if (S_ISGITLINK(ce->ce_mode))
-			continue;
-		if (ce_uptodate(ce))
-			continue;
-		if (ce_skip_worktree(ce))
-			continue;
-		if (!ce_path_match(ce, &p->pathspec, NULL))
-			continue;
-		if (threaded_has_symlink_leading_path(&cache, ce->name, ce_namelen(ce)))
-			continue;
-		if (lstat(ce->name, &st))
-			continue;
-		if (ie_match_stat(index, ce, &st, CE_MATCH_RACY_IS_DIRTY))
-			continue;
-		ce_mark_uptodate(ce);
-	} while (--nr > 0);
+			if (ce_stage(ce))
+				continue;
+			if (S_ISGITLINK(ce->ce_mode))
+				continue;
+			if (ce_uptodate(ce))
+				continue;
+			if (ce_skip_worktree(ce))
+				continue;
+			if (!ce_path_match(ce, &p->pathspec, NULL))
+				continue;
+			if (threaded_has_symlink_leading_path(&cache, ce->name, ce_namelen(ce)))
+				continue;
+			p->nr_lstat++;
+			if (lstat(ce->name, &st))
+				continue;
+			if (ie_match_stat(index, ce, &st, CE_MATCH_RACY_IS_DIRTY))
+				continue;
+			ce_mark_uptodate(ce);
+		} while (--nr > 0);
+	}
 	cache_def_clear(&cache);
+	p->nanos = getnanotime() - start;
 	return NULL;
 }
 
 static void preload_index(struct index_state *index,
 			  const struct pathspec *pathspec)
 {
-	int threads, i, work, offset;
-	struct thread_data data[MAX_PARALLEL];
+	int threads, max_threads, i;
+	struct thread_data *data;
+	struct preload_queue queue;
+	uint64_t start = getnanotime();
 
 	if (!core_preload_index)
 		return;
@@ -81,19 +117,21 @@ static void preload_index(struct index_state *index,
 	threads = index->cache_nr / THREAD_COST;
 	if (threads < 2)
 		return;
-	if (threads > MAX_PARALLEL)
-		threads = MAX_PARALLEL;
-	offset = 0;
-	work = DIV_ROUND_UP(index->cache_nr, threads);
-	memset(&data, 0, sizeof(data));
+	max_threads = online_cpus();
+	if (max_threads < MIN_PARALLEL)
+		max_threads = MIN_PARALLEL;
+	if (threads > max_threads)
+		threads = max_threads;
+
+	pthread_mutex_init(&queue.mutex, NULL);
+	queue.next = 0;
+	data = xcalloc(threads, sizeof(*data));
 	for (i = 0; i < threads; i++) {
 		struct thread_data *p = data+i;
 		p->index = index;
 		if (pathspec)
 			copy_pathspec(&p->pathspec, pathspec);
-		p->offset = offset;
-		p->nr = work;
-		offset += work;
+		p->queue = &queue;
 		if (pthread_create(&p->pthread, NULL, preload_thread, p))
 			die("unable to create threaded lstat");
 	}
@@ -101,7 +139,16 @@ static void preload_index(struct index_state *index,
 		struct thread_data *p = data+i;
 		if (pthread_join(p->pthread, NULL))
 			die("unable to join threaded lstat");
+		trace_performance(p->nanos,
+				  "preload thread %d: %d entries, %d lstat",
+				  i, p->nr_entries, p->nr_lstat);
+		if (pathspec)
+			clear_pathspec(&p->pathspec);
 	}
+	free(data);
+	pthread_mutex_destroy(&queue.mutex);
+	trace_performance_since(start, "preload index with %d threads",
+				threads);
 }
 #endif
 
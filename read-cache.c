@@ -18,6 +18,8 @@
 #include "varint.h"
 #include "split-index.h"
 #include "utf8.h"
+#include "arena.h"
+#include "run-command.h"
 
 /* Mask for the name length in ce_flags in the on-disk index */
 
@@ -48,6 +50,7 @@ static const char *alternate_index_output;
 
 static void set_index_entry(struct index_state *istate, int nr, struct cache_entry *ce)
 {
+	istate->ce_arena_only = 0;
 	istate->cache[nr] = ce;
 	add_name_hash(istate, ce);
 }
@@ -58,7 +61,7 @@ static void replace_index_entry(struct index_state *istate, int nr, struct cache
 
 	replace_index_entry_in_base(istate, old, ce);
 	remove_name_hash(istate, old);
-	free(old);
+	free_cache_entry(old);
 	set_index_entry(istate, nr, ce);
 	ce->ce_flags |= CE_UPDATE_IN_BASE;
 	istate->cache_changed |= CE_ENTRY_CHANGED;
@@ -1569,12 +1572,73 @@ int read_index(struct index_state *istate)
 	return read_index_from(istate, get_index_file());
 }
 
-static struct cache_entry *cache_entry_from_ondisk(struct ondisk_cache_entry *ondisk,
+/*
+ * The arenas holding the entries of read-only indexes.  Entries may
+ * move between indexes (e.g. into the shared index of a split index),
+ * so free_cache_entry() checks all of them.
+ */
+static struct arena **ce_arenas;
+static int ce_arenas_nr, ce_arenas_alloc;
+
+static struct arena *new_ce_arena(size_t size)
+{
+	struct arena *arena = xcalloc(1, sizeof(*arena));
+
+	arena->block_size = size;
+	ALLOC_GROW(ce_arenas, ce_arenas_nr + 1, ce_arenas_alloc);
+	ce_arenas[ce_arenas_nr++] = arena;
+	return arena;
+}
+
+static void discard_ce_arena(struct arena *arena)
+{
+	int i;
+
+	for (i = 0; i < ce_arenas_nr; i++)
+		if (ce_arenas[i] == arena) {
+			ce_arenas[i] = ce_arenas[--ce_arenas_nr];
+			break;
+		}
+	arena_release(arena);
+	free(arena);
+}
+
+void free_cache_entry(struct cache_entry *ce)
+{
+	int i;
+
+	for (i = 0; i < ce_arenas_nr; i++)
+		if (arena_contains(ce_arenas[i], ce))
+			return;
+	free(ce);
+}
+
+/*
+ * How much memory the entries of an index will take, so that the
+ * arena can usually hold them in a single block.  With v4, the
+ * prefix-compressed names give no good clue, so guess.
+ */
+#define CACHE_ENTRY_PATH_LENGTH_GUESS 80
+
+static size_t estimate_cache_size(int version, size_t ondisk_size,
+				  unsigned int entries)
+{
+	size_t per_entry = sizeof(struct cache_entry) + sizeof(uintmax_t);
+
+	if (version == 4)
+		return st_mult(entries, per_entry + CACHE_ENTRY_PATH_LENGTH_GUESS);
+	return st_add(ondisk_size, st_mult(entries, per_entry));
+}
+
+static struct cache_entry *cache_entry_from_ondisk(struct arena *arena,
+						   struct ondisk_cache_entry *ondisk,
 						   unsigned int flags,
 						   const char *name,
 						   size_t len)
 {
-	struct cache_entry *ce = xmalloc(cache_entry_size(len));
+	struct cache_entry *ce = arena ?
+		arena_alloc(arena, cache_entry_size(len)) :
+		xmalloc(cache_entry_size(len));
 
 	ce->ce_stat_data.sd_ctime.sec = get_be32(&ondisk->ctime.sec);
 	ce->ce_stat_data.sd_mtime.sec = get_be32(&ondisk->mtime.sec);
@@ -1616,7 +1680,8 @@ static unsigned long expand_name_field(struct strbuf *name, const char *cp_)
 	return (const char *)ep + 1 - cp_;
 }
 
-static struct cache_entry *create_from_disk(struct ondisk_cache_entry *ondisk,
+static struct cache_entry *create_from_disk(struct arena *arena,
+					    struct ondisk_cache_entry *ondisk,
 					    unsigned long *ent_size,
 					    struct strbuf *previous_name)
 {
@@ -1647,13 +1712,13 @@ static struct cache_entry *create_from_disk(struct ondisk_cache_entry *ondisk,
 		/* v3 and earlier */
 		if (len == CE_NAMEMASK)
 			len = strlen(name);
-		ce = cache_entry_from_ondisk(ondisk, flags, name, len);
+		ce = cache_entry_from_ondisk(arena, ondisk, flags, name, len);
 
 		*ent_size = ondisk_ce_size(ce);
 	} else {
 		unsigned long consumed;
 		consumed = expand_name_field(previous_name, name);
-		ce = cache_entry_from_ondisk(ondisk, flags,
+		ce = cache_entry_from_ondisk(arena, ondisk, flags,
 					     previous_name->buf,
 					     previous_name->len);
 
@@ -1768,6 +1833,10 @@ int do_read_index(struct index_state *istate, const char *path, int must_exist)
 	istate->cache_alloc = alloc_nr(istate->cache_nr);
 	istate->cache = xcalloc(istate->cache_alloc, sizeof(*istate->cache));
 	istate->initialized = 1;
+	if (istate->read_only && istate->cache_nr)
+		istate->ce_arena = new_ce_arena(
+			estimate_cache_size(istate->version, mmap_size,
+					    istate->cache_nr));
 
 	if (istate->version == 4)
 		previous_name = &previous_name_buf;
@@ -1781,11 +1850,13 @@ int do_read_index(struct index_state *istate, const char *path, int must_exist)
 		unsigned long consumed;
 
 		disk_ce = (struct ondisk_cache_entry *)((char *)mmap + src_offset);
-		ce = create_from_disk(disk_ce, &consumed, previous_name);
+		ce = create_from_disk(istate->ce_arena, disk_ce, &consumed,
+				      previous_name);
 		set_index_entry(istate, i, ce);
 
 		src_offset += consumed;
 	}
+	istate->ce_arena_only = !!istate->ce_arena;
 	strbuf_release(&previous_name_buf);
 	istate->timestamp.sec = st.st_mtime;
 	istate->timestamp.nsec = ST_MTIME_NSEC(st);
@@ -1853,6 +1924,7 @@ int read_index_from(struct index_state *istate, const char *path)
 		discard_index(split_index->base);
 	else
 		split_index->base = xcalloc(1, sizeof(*split_index->base));
+	split_index->base->read_only = istate->read_only;
 
 	base_sha1_hex = sha1_to_hex(split_index->base_sha1);
 	base_path = git_path("sharedindex.%s", base_sha1_hex);
@@ -1864,6 +1936,8 @@ int read_index_from(struct index_state *istate, const char *path)
 
 	freshen_shared_index(base_sha1_hex, 0);
 	merge_base_index(istate);
+	/* now it holds entries of the shared index, too */
+	istate->ce_arena_only = 0;
 	post_read_index_from(istate);
 	return ret;
 }
@@ -1877,14 +1951,15 @@ int discard_index(struct index_state *istate)
 {
 	int i;
 
-	for (i = 0; i < istate->cache_nr; i++) {
+	/* Entries that all live in ce_arena go away with it below */
+	for (i = 0; i < istate->cache_nr && !istate->ce_arena_only; i++) {
 		if (istate->cache[i]->index &&
 		    istate->split_index &&
 		    istate->split_index->base &&
 		    istate->cache[i]->index <= istate->split_index->base->cache_nr &&
 		    istate->cache[i] == istate->split_index->base->cache[istate->cache[i]->index - 1])
 			continue;
-		free(istate->cache[i]);
+		free_cache_entry(istate->cache[i]);
 	}
 	resolve_undo_clear_index(istate);
 	istate->cache_nr = 0;
@@ -1900,6 +1975,11 @@ int discard_index(struct index_state *istate)
 	discard_split_index(istate);
 	free_untracked_cache(istate->untracked);
 	istate->untracked = NULL;
+	if (istate->ce_arena) {
+		discard_ce_arena(istate->ce_arena);
+		istate->ce_arena = NULL;
+	}
+	istate->ce_arena_only = 0;
 	return 0;
 }
 
@@ -2347,6 +2427,9 @@ static int write_split_index(struct index_state *istate,
 
 static const char *shared_index_expire = "2.weeks.ago";
 
+/* how long a background rewrite waits for the index lock */
+static const long shared_index_lock_timeout_ms = 5000;
+
 static unsigned long get_shared_index_expire_date(void)
 {
 	static unsigned long shared_index_expire_date;
@@ -2406,17 +2489,15 @@ static int clean_shared_index_files(const char *current_hex)
 
 static struct tempfile temporary_sharedindex;
 
-static int write_shared_index(struct index_state *istate,
-			      struct lock_file *lock, unsigned flags)
+/*
+ * Move all entries of istate to a new base and write it out to fd,
+ * a temporary_sharedindex opened by the caller.
+ */
+static int write_shared_index_file(struct index_state *istate, int fd)
 {
 	struct split_index *si = istate->split_index;
-	int fd, ret;
+	int ret;
 
-	fd = mks_tempfile(&temporary_sharedindex, git_path("sharedindex_XXXXXX"));
-	if (fd < 0) {
-		hashclr(si->base_sha1);
-		return do_write_locked_index(istate, lock, flags);
-	}
 	move_cache_to_base_index(istate);
 	ret = do_write_index(si->base, fd, 1);
 	if (ret) {
@@ -2425,14 +2506,149 @@ static int write_shared_index(struct index_state *istate,
 	}
 	ret = rename_tempfile(&temporary_sharedindex,
 			      git_path("sharedindex.%s", sha1_to_hex(si->base->sha1)));
-	if (!ret) {
+	if (!ret)
 		hashcpy(si->base_sha1, si->base->sha1);
+	return ret;
+}
+
+static int write_shared_index(struct index_state *istate,
+			      struct lock_file *lock, unsigned flags)
+{
+	struct split_index *si = istate->split_index;
+	int fd, ret;
+
+	fd = mks_tempfile(&temporary_sharedindex, git_path("sharedindex_XXXXXX"));
+	if (fd < 0) {
+		hashclr(si->base_sha1);
+		return do_write_locked_index(istate, lock, flags);
+	}
+	ret = write_shared_index_file(istate, fd);
+	if (!ret)
 		clean_shared_index_files(sha1_to_hex(si->base->sha1));
+
+	return ret;
+}
+
+/*
+ * Does the index file at path still end with the given checksum,
+ * i.e. has nobody written it since we read or wrote it ourselves?
+ */
+static int index_file_unchanged(const char *path, const unsigned char *sha1)
+{
+	unsigned char trailer[20];
+	struct stat st;
+	int fd, ret = 0;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 0;
+	if (!fstat(fd, &st) && st.st_size >= sizeof(trailer) &&
+	    pread_in_full(fd, trailer, sizeof(trailer),
+			  st.st_size - sizeof(trailer)) == sizeof(trailer))
+		ret = !hashcmp(trailer, sha1);
+	close(fd);
+	return ret;
+}
+
+/*
+ * Write all entries of istate, which holds what the split index at
+ * path currently records, to a new shared index and point the split
+ * index at it.  The index itself is only locked for the final step,
+ * which is skipped if the index has been written in the meantime:
+ * the old base stays in use and the new one will simply expire.
+ */
+static int rebase_split_index(struct index_state *istate, const char *path)
+{
+	static struct lock_file rewrite_lock;
+	static struct lock_file index_lock;
+	struct split_index *si = istate->split_index;
+	unsigned char sha1[20];
+	int fd, ret = 0;
+
+	if (hold_lock_file_for_update(&rewrite_lock,
+				      git_path("sharedindex_rewrite"), 0) < 0)
+		return 0; /* somebody else is at it already */
+
+	hashcpy(sha1, istate->sha1);
+	fd = mks_tempfile(&temporary_sharedindex, git_path("sharedindex_XXXXXX"));
+	if (fd < 0) {
+		ret = error_errno(_("unable to create temporary shared index"));
+		goto out;
 	}
+	ret = write_shared_index_file(istate, fd);
+	if (ret)
+		goto out;
 
+	if (hold_lock_file_for_update_timeout(&index_lock, path, 0,
+					      shared_index_lock_timeout_ms) < 0)
+		goto out;
+	if (!index_file_unchanged(path, sha1)) {
+		rollback_lock_file(&index_lock);
+		goto out;
+	}
+	ret = write_split_index(istate, &index_lock, COMMIT_LOCK);
+	if (!ret)
+		clean_shared_index_files(sha1_to_hex(si->base->sha1));
+out:
+	rollback_lock_file(&rewrite_lock);
+	return ret;
+}
+
+int rewrite_shared_index(const char *path)
+{
+	struct index_state istate = { NULL };
+	struct split_index *si;
+	int i, ret = 0;
+
+	if (read_index_from(&istate, path) < 0)
+		return -1;
+	si = istate.split_index;
+	if (!si || !si->base)
+		goto out;
+	for (i = 0; i < istate.cache_nr; i++)
+		if (!istate.cache[i]->index)
+			break;
+	if (i < istate.cache_nr || istate.cache_nr != si->base->cache_nr)
+		ret = rebase_split_index(&istate, path);
+out:
+	discard_index(&istate);
 	return ret;
 }
 
+static int background_shared_index_rewrite(void)
+{
+	static int enabled = -1;
+
+	if (enabled < 0 &&
+	    git_config_get_bool("splitindex.backgroundrewrite", &enabled))
+		enabled = 0;
+	return enabled;
+}
+
+/*
+ * Let "git update-index --rewrite-shared-index" write the new shared
+ * index from what the index at path records, so that the caller can go
+ * on with its business.  It is not waited for, and gets none of our
+ * standard file descriptors, so that e.g. a pager does not wait for it.
+ */
+static void rewrite_shared_index_in_background(const char *path)
+{
+	struct child_process cp = CHILD_PROCESS_INIT;
+
+	if (file_exists(git_path("sharedindex_rewrite.lock")))
+		return;
+
+	argv_array_pushl(&cp.args, "update-index", "--rewrite-shared-index", NULL);
+	argv_array_pushf(&cp.env_array, "GIT_INDEX_FILE=%s", path);
+	cp.git_cmd = 1;
+	cp.no_stdin = 1;
+	cp.no_stdout = 1;
+	cp.no_stderr = 1;
+	if (start_command(&cp))
+		warning(_("unable to rewrite the shared index in the background"));
+	child_process_clear(&cp);
+}
+
 static const int default_max_percent_split_change = 20;
 
 static int too_many_not_shared_entries(struct index_state *istate)
@@ -2468,6 +2684,7 @@ int write_locked_index(struct index_state *istate, struct lock_file *lock,
 {
 	int new_shared_index, ret;
 	struct split_index *si = istate->split_index;
+	char *rewrite_path = NULL;
 
 	if (!si || alternate_index_output ||
 	    (istate->cache_changed & ~EXTMASK)) {
@@ -2481,8 +2698,17 @@ int write_locked_index(struct index_state *istate, struct lock_file *lock,
 		if ((v & 15) < 6)
 			istate->cache_changed |= SPLIT_INDEX_ORDERED;
 	}
-	if (too_many_not_shared_entries(istate))
-		istate->cache_changed |= SPLIT_INDEX_ORDERED;
+	if (too_many_not_shared_entries(istate)) {
+		/*
+		 * Unless asked for one explicitly, leave the new shared
+		 * index to a background process when configured to.
+		 */
+		if (!(istate->cache_changed & SPLIT_INDEX_ORDERED) &&
+		    (flags & COMMIT_LOCK) && background_shared_index_rewrite())
+			rewrite_path = get_locked_file_path(lock);
+		else
+			istate->cache_changed |= SPLIT_INDEX_ORDERED;
+	}
 
 	new_shared_index = istate->cache_changed & SPLIT_INDEX_ORDERED;
 
@@ -2498,6 +2724,10 @@ int write_locked_index(struct index_state *istate, struct lock_file *lock,
 	if (!ret && !new_shared_index)
 		freshen_shared_index(sha1_to_hex(si->base_sha1), 1);
 
+	if (!ret && rewrite_path)
+		rewrite_shared_index_in_background(rewrite_path);
+	free(rewrite_path);
+
 	return ret;
 }
 
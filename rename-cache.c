@@ -0,0 +1,184 @@
+#include "cache.h"
+#include "lockfile.h"
+#include "rename-cache.h"
+
+#define RENAME_CACHE_SIGNATURE 0x524e4348 /* "RNCH" */
+#define RENAME_CACHE_VERSION 1
+#define RENAME_CACHE_HEADER_SIZE 12
+#define RENAME_CACHE_ENTRY_SIZE (2 * GIT_SHA1_RAWSZ + 2)
+
+struct rename_cache_entry {
+	struct hashmap_entry ent;
+	struct object_id dst;
+	struct object_id src;
+	int score;
+};
+
+static int rename_cache_entry_cmp(const struct rename_cache_entry *a,
+				  const struct rename_cache_entry *b,
+				  const void *keydata)
+{
+	return oidcmp(&a->dst, &b->dst) || oidcmp(&a->src, &b->src);
+}
+
+static unsigned int pair_hash(const struct object_id *dst,
+			      const struct object_id *src)
+{
+	return sha1hash(dst->hash) ^ sha1hash(src->hash);
+}
+
+static struct rename_cache_entry *find_pair(struct rename_cache *c,
+					    const struct object_id *dst,
+					    const struct object_id *src)
+{
+	struct rename_cache_entry key;
+
+	hashmap_entry_init(&key, pair_hash(dst, src));
+	oidcpy(&key.dst, dst);
+	oidcpy(&key.src, src);
+	return hashmap_get(&c->map, &key, NULL);
+}
+
+void rename_cache_init(struct rename_cache *c)
+{
+	hashmap_init(&c->map, (hashmap_cmp_fn)rename_cache_entry_cmp, 0);
+	c->initialized = 1;
+	c->dirty = 0;
+}
+
+void rename_cache_clear(struct rename_cache *c)
+{
+	if (!c->initialized)
+		return;
+	hashmap_free(&c->map, 1);
+	c->initialized = 0;
+	c->dirty = 0;
+}
+
+int rename_cache_lookup(struct rename_cache *c, const struct object_id *dst,
+			const struct object_id *src)
+{
+	struct rename_cache_entry *e = find_pair(c, dst, src);
+
+	return e ? e->score : -1;
+}
+
+void rename_cache_add(struct rename_cache *c, const struct object_id *dst,
+		      const struct object_id *src, int score)
+{
+	struct rename_cache_entry *e = find_pair(c, dst, src);
+
+	if (e) {
+		if (e->score == score)
+			return;
+	} else {
+		e = xmalloc(sizeof(*e));
+		hashmap_entry_init(e, pair_hash(dst, src));
+		oidcpy(&e->dst, dst);
+		oidcpy(&e->src, src);
+		hashmap_add(&c->map, e);
+	}
+	e->score = score;
+	c->dirty = 1;
+}
+
+void rename_cache_read(struct rename_cache *c, const char *path)
+{
+	struct strbuf sb = STRBUF_INIT;
+	const unsigned char *p;
+	unsigned char sha1[GIT_SHA1_RAWSZ];
+	git_SHA_CTX ctx;
+	uint32_t nr, i;
+
+	if (strbuf_read_file(&sb, path, 0) < 0) {
+		if (errno != ENOENT)
+			warning_errno(_("could not read '%s'"), path);
+		return;
+	}
+
+	p = (const unsigned char *)sb.buf;
+	if (sb.len < RENAME_CACHE_HEADER_SIZE + GIT_SHA1_RAWSZ ||
+	    get_be32(p) != RENAME_CACHE_SIGNATURE ||
+	    get_be32(p + 4) != RENAME_CACHE_VERSION)
+		goto corrupt;
+	nr = get_be32(p + 8);
+	if ((sb.len - RENAME_CACHE_HEADER_SIZE - GIT_SHA1_RAWSZ) /
+	    RENAME_CACHE_ENTRY_SIZE != nr ||
+	    (sb.len - RENAME_CACHE_HEADER_SIZE - GIT_SHA1_RAWSZ) %
+	    RENAME_CACHE_ENTRY_SIZE)
+		goto corrupt;
+
+	git_SHA1_Init(&ctx);
+	git_SHA1_Update(&ctx, sb.buf, sb.len - GIT_SHA1_RAWSZ);
+	git_SHA1_Final(sha1, &ctx);
+	if (hashcmp(sha1, p + sb.len - GIT_SHA1_RAWSZ))
+		goto corrupt;
+
+	p += RENAME_CACHE_HEADER_SIZE;
+	for (i = 0; i < nr; i++, p += RENAME_CACHE_ENTRY_SIZE) {
+		struct object_id dst, src;
+
+		hashcpy(dst.hash, p);
+		hashcpy(src.hash, p + GIT_SHA1_RAWSZ);
+		rename_cache_add(c, &dst, &src,
+				 get_be16(p + 2 * GIT_SHA1_RAWSZ));
+	}
+	c->dirty = 0;
+	strbuf_release(&sb);
+	return;
+
+corrupt:
+	warning(_("ignoring corrupt rename cache '%s'"), path);
+	strbuf_release(&sb);
+}
+
+int rename_cache_write(struct rename_cache *c, const char *path)
+{
+	static struct lock_file lock;
+	struct strbuf sb = STRBUF_INIT;
+	struct hashmap_iter iter;
+	struct rename_cache_entry *e;
+	unsigned char sha1[GIT_SHA1_RAWSZ];
+	unsigned char header[RENAME_CACHE_HEADER_SIZE];
+	git_SHA_CTX ctx;
+	int fd;
+
+	if (!c->dirty)
+		return 0;
+
+	put_be32(header, RENAME_CACHE_SIGNATURE);
+	put_be32(header + 4, RENAME_CACHE_VERSION);
+	put_be32(header + 8, c->map.size);
+	strbuf_add(&sb, header, sizeof(header));
+	hashmap_iter_init(&c->map, &iter);
+	while ((e = hashmap_iter_next(&iter))) {
+		unsigned char score[2];
+
+		score[0] = (e->score >> 8) & 0xff;
+		score[1] = e->score & 0xff;
+		strbuf_add(&sb, e->dst.hash, GIT_SHA1_RAWSZ);
+		strbuf_add(&sb, e->src.hash, GIT_SHA1_RAWSZ);
+		strbuf_add(&sb, score, sizeof(score));
+	}
+	git_SHA1_Init(&ctx);
+	git_SHA1_Update(&ctx, sb.buf, sb.len);
+	git_SHA1_Final(sha1, &ctx);
+	strbuf_add(&sb, sha1, sizeof(sha1));
+
+	fd = hold_lock_file_for_update(&lock, path, 0);
+	if (fd < 0) {
+		strbuf_release(&sb);
+		return -1;
+	}
+	if (write_in_full(fd, sb.buf, sb.len) < 0) {
+		error_errno(_("could not write '%s'"), path);
+		rollback_lock_file(&lock);
+		strbuf_release(&sb);
+		return -1;
+	}
+	strbuf_release(&sb);
+	if (commit_lock_file(&lock) < 0)
+		return error_errno(_("could not write '%s'"), path);
+	c->dirty = 0;
+	return 0;
+}
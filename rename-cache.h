@@ -0,0 +1,51 @@
+#ifndef RENAME_CACHE_H
+#define RENAME_CACHE_H
+
+#include "hashmap.h"
+
+/*
+ * A rename cache remembers the similarity scores diffcore-rename
+ * estimated for pairs of blobs, so that a series of merges that keep
+ * comparing the same files (e.g. the picks of a rebase across a
+ * directory rename) only pay for estimating the similarity of pairs
+ * that were not seen before.  The renames themselves are still chosen
+ * from the scores of all candidates, as without a cache.
+ *
+ * It can be stored in a file:
+ *
+ *   - 4-byte signature "RNCH"
+ *   - 4-byte version number (network byte order), currently 1
+ *   - 4-byte number of pairs N (network byte order)
+ *   - N entries of a 20-byte destination blob name, a 20-byte source
+ *     blob name and a 2-byte score (network byte order)
+ *   - 20-byte SHA-1 checksum of all of the above
+ */
+struct rename_cache {
+	struct hashmap map;
+	unsigned initialized : 1;
+	unsigned dirty : 1;
+};
+
+void rename_cache_init(struct rename_cache *c);
+void rename_cache_clear(struct rename_cache *c);
+
+/*
+ * Read the pairs stored in the file into the cache.  A missing file is
+ * not an error; a corrupt one is reported and ignored.
+ */
+void rename_cache_read(struct rename_cache *c, const char *path);
+
+/* Write the cache to the file, if it has changed since it was read */
+int rename_cache_write(struct rename_cache *c, const char *path);
+
+/*
+ * Returns the similarity score remembered for the pair of blobs, or -1
+ * if there is none.
+ */
+int rename_cache_lookup(struct rename_cache *c, const struct object_id *dst,
+			const struct object_id *src);
+
+void rename_cache_add(struct rename_cache *c, const struct object_id *dst,
+		      const struct object_id *src, int score);
+
+#endif
@@ -29,6 +29,7 @@ struct rev_info;
 struct log_info;
 struct string_list;
 struct saved_parents;
+struct notes_cache;
 
 struct rev_cmdline_info {
 	unsigned int nr;
@@ -213,6 +214,9 @@ struct rev_info {
 
 	struct commit_list *previous_parents;
 	const char *break_bar;
+
+	/* remembers the diffs between trees, see tree-diff-cache.h */
+	struct notes_cache *tree_diff_cache;
 };
 
 extern int ref_excluded(struct string_list *, const char *path);
@@ -569,6 +569,8 @@ int finish_command(struct child_process *cmd)
 {
 	int ret = wait_or_whine(cmd->pid, cmd->argv[0], 0);
 	child_process_clear(cmd);
+	/* the child may have written objects we have not seen */
+	invalidate_loose_object_cache();
 	return ret;
 }
 
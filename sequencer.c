@@ -19,6 +19,7 @@
 #include "trailer.h"
 #include "log-tree.h"
 #include "wt-status.h"
+#include "rename-cache.h"
 
 #define GIT_REFLOG_ACTION "GIT_REFLOG_ACTION"
 
@@ -31,6 +32,7 @@ static GIT_PATH_FUNC(git_path_todo_file, "sequencer/todo")
 static GIT_PATH_FUNC(git_path_opts_file, "sequencer/opts")
 static GIT_PATH_FUNC(git_path_head_file, "sequencer/head")
 static GIT_PATH_FUNC(git_path_abort_safety_file, "sequencer/abort-safety")
+static GIT_PATH_FUNC(git_path_rename_cache_file, "sequencer/rename-cache")
 
 static GIT_PATH_FUNC(rebase_path, "rebase-merge")
 /*
@@ -126,6 +128,11 @@ static GIT_PATH_FUNC(rebase_path_onto, "rebase-merge/onto")
 static GIT_PATH_FUNC(rebase_path_autostash, "rebase-merge/autostash")
 static GIT_PATH_FUNC(rebase_path_strategy, "rebase-merge/strategy")
 static GIT_PATH_FUNC(rebase_path_strategy_opts, "rebase-merge/strategy_opts")
+/*
+ * The inexact renames found while merging, so that the following picks
+ * do not have to find them again; see rename-cache.h.
+ */
+static GIT_PATH_FUNC(rebase_path_rename_cache, "rebase-merge/rename-cache")
 
 static inline int is_rebase_i(const struct replay_opts *opts)
 {
@@ -146,6 +153,30 @@ static const char *get_todo_path(const struct replay_opts *opts)
 	return git_path_todo_file();
 }
 
+static const char *get_rename_cache_path(const struct replay_opts *opts)
+{
+	if (is_rebase_i(opts))
+		return rebase_path_rename_cache();
+	return git_path_rename_cache_file();
+}
+
+/* Returns NULL unless merge.renameCache is set */
+static struct rename_cache *get_rename_cache(const struct replay_opts *opts)
+{
+	static struct rename_cache cache;
+	static int enabled = -1;
+
+	if (enabled < 0 && git_config_get_bool("merge.renamecache", &enabled))
+		enabled = 0;
+	if (!enabled)
+		return NULL;
+	if (!cache.initialized) {
+		rename_cache_init(&cache);
+		rename_cache_read(&cache, get_rename_cache_path(opts));
+	}
+	return &cache;
+}
+
 /*
  * Returns 0 for non-conforming footer
  * Returns 1 for conforming footer
@@ -453,9 +484,13 @@ static int do_recursive_merge(struct commit *base, struct commit *next,
 	for (xopt = opts->xopts; xopt != opts->xopts + opts->xopts_nr; xopt++)
 		parse_merge_opt(&o, *xopt);
 
+	o.rename_cache = get_rename_cache(opts);
 	clean = merge_trees(&o,
 			    head_tree,
 			    next_tree, base_tree, &result);
+	/* Only a multi-commit run has a state directory to keep it in */
+	if (o.rename_cache && is_directory(get_dir(opts)))
+		rename_cache_write(o.rename_cache, get_rename_cache_path(opts));
 	if (is_rebase_i(opts) && clean <= 0)
 		fputs(o.obuf.buf, stdout);
 	strbuf_release(&o.obuf);
@@ -27,6 +27,7 @@
 #include "list.h"
 #include "mergesort.h"
 #include "quote.h"
+#include "sha1-array.h"
 
 #define SZ_FMT PRIuMAX
 static inline uintmax_t sz_fmt(size_t s) { return s; }
@@ -671,8 +672,130 @@ int check_and_freshen_file(const char *fn, int freshen)
 	return 1;
 }
 
+static int for_each_file_in_obj_subdir(int subdir_nr,
+				       struct strbuf *path,
+				       each_loose_object_fn obj_cb,
+				       each_loose_cruft_fn cruft_cb,
+				       each_loose_subdir_fn subdir_cb,
+				       void *data);
+
+static int append_loose_object(const struct object_id *oid, const char *path,
+			       void *data)
+{
+	oid_array_append(data, oid);
+	return 0;
+}
+
+static void list_loose_subdir(int subdir_nr, struct strbuf *path,
+			      const char *objdir, struct oid_array *out)
+{
+	strbuf_reset(path);
+	strbuf_addf(path, "%s/%02x", objdir, subdir_nr);
+	for_each_file_in_obj_subdir(subdir_nr, path, append_loose_object,
+				    NULL, NULL, out);
+}
+
+/*
+ * With core.looseObjectCache, each fan-out directory of an object
+ * directory is read once, the first time we look for a loose object in
+ * it, and lookups of objects that are not in the listing do not touch
+ * the filesystem at all. Objects written by this process are added to
+ * the listing, and it is dropped when objects may have been added behind
+ * its back: by reprepare_packed_git(), when a child process exits and
+ * when a temporary object directory is migrated. The lookups that merely
+ * retry after a miss only rescan the packs.
+ */
+struct loose_object_cache {
+	struct oid_array subdir[256];
+	unsigned char loaded[256];
+};
+
+static struct loose_object_cache *local_loose_cache;
+
+/*
+ * Return false if the cache is enabled and knows that "objdir" has no
+ * loose object named "sha1", and true otherwise.
+ */
+static int loose_object_maybe_in(struct loose_object_cache **cachep,
+				 const char *objdir,
+				 const unsigned char *sha1)
+{
+	struct loose_object_cache *cache;
+	struct object_id oid;
+	int subdir_nr = sha1[0];
+
+	if (!use_loose_object_cache)
+		return 1;
+	if (!*cachep)
+		*cachep = xcalloc(1, sizeof(**cachep));
+	cache = *cachep;
+
+	if (!cache->loaded[subdir_nr]) {
+		struct strbuf path = STRBUF_INIT;
+
+		list_loose_subdir(subdir_nr, &path, objdir,
+				  &cache->subdir[subdir_nr]);
+		strbuf_release(&path);
+		cache->loaded[subdir_nr] = 1;
+	}
+	hashcpy(oid.hash, sha1);
+	return oid_array_lookup(&cache->subdir[subdir_nr], &oid) >= 0;
+}
+
+static void clear_loose_object_cache(struct loose_object_cache *cache)
+{
+	int i;
+
+	if (!cache)
+		return;
+	for (i = 0; i < ARRAY_SIZE(cache->subdir); i++)
+		oid_array_clear(&cache->subdir[i]);
+	memset(cache->loaded, 0, sizeof(cache->loaded));
+}
+
+void invalidate_loose_object_cache(void)
+{
+	struct alternate_object_database *alt;
+
+	clear_loose_object_cache(local_loose_cache);
+	for (alt = alt_odb_list; alt; alt = alt->next)
+		clear_loose_object_cache(alt->loose_cache);
+}
+
+/*
+ * Insert the object into a listing that has already been sorted in
+ * place, so that lookups between writes do not sort it all over again.
+ */
+static void add_to_loose_object_cache(const unsigned char *sha1)
+{
+	struct oid_array *array;
+	struct object_id oid;
+	int pos;
+
+	if (!local_loose_cache || !local_loose_cache->loaded[sha1[0]])
+		return;
+	array = &local_loose_cache->subdir[sha1[0]];
+	hashcpy(oid.hash, sha1);
+	if (!array->sorted) {
+		oid_array_append(array, &oid);
+		return;
+	}
+	pos = oid_array_lookup(array, &oid);
+	if (pos >= 0)
+		return;
+	pos = -pos - 1;
+	ALLOC_GROW(array->oid, array->nr + 1, array->alloc);
+	memmove(array->oid + pos + 1, array->oid + pos,
+		(array->nr - pos) * sizeof(*array->oid));
+	oidcpy(&array->oid[pos], &oid);
+	array->nr++;
+}
+
 static int check_and_freshen_local(const unsigned char *sha1, int freshen)
 {
+	if (!freshen && !loose_object_maybe_in(&local_loose_cache,
+					       get_object_directory(), sha1))
+		return 0;
 	return check_and_freshen_file(sha1_file_name(sha1), freshen);
 }
 
@@ -681,7 +804,11 @@ static int check_and_freshen_nonlocal(const unsigned char *sha1, int freshen)
 	struct alternate_object_database *alt;
 	prepare_alt_odb();
 	for (alt = alt_odb_list; alt; alt = alt->next) {
-		const char *path = alt_sha1_path(alt, sha1);
+		const char *path;
+		if (!freshen &&
+		    !loose_object_maybe_in(&alt->loose_cache, alt->path, sha1))
+			continue;
+		path = alt_sha1_path(alt, sha1);
 		if (check_and_freshen_file(path, freshen))
 			return 1;
 	}
@@ -1080,6 +1207,8 @@ void unuse_pack(struct pack_window **w_cursor)
 
 void close_pack_index(struct packed_git *p)
 {
+	/* the positions in the .rev file are meaningless without the .idx */
+	close_pack_revindex(p);
 	if (p->index_data) {
 		munmap((void *)p->index_data, p->index_size);
 		p->index_data = NULL;
@@ -1485,6 +1614,7 @@ static void prepare_packed_git_one(char *objdir, int local)
 		if (ends_with(de->d_name, ".idx") ||
 		    ends_with(de->d_name, ".pack") ||
 		    ends_with(de->d_name, ".bitmap") ||
+		    ends_with(de->d_name, ".rev") ||
 		    ends_with(de->d_name, ".keep"))
 			string_list_append(&garbage, path.buf);
 		else
@@ -1591,13 +1721,23 @@ void prepare_packed_git(void)
 	prepare_packed_git_run_once = 1;
 }
 
-void reprepare_packed_git(void)
+/*
+ * Look for packs that appeared since prepare_packed_git(), for the
+ * lookups below that retry when an object has just been packed.
+ */
+static void rescan_packs(void)
 {
 	approximate_object_count_valid = 0;
 	prepare_packed_git_run_once = 0;
 	prepare_packed_git();
 }
 
+void reprepare_packed_git(void)
+{
+	invalidate_loose_object_cache();
+	rescan_packs();
+}
+
 static void mark_bad_packed_object(struct packed_git *p,
 				   const unsigned char *sha1)
 {
@@ -1713,14 +1853,17 @@ static int stat_sha1_file(const unsigned char *sha1, struct stat *st,
 	struct alternate_object_database *alt;
 
 	*path = sha1_file_name(sha1);
-	if (!lstat(*path, st))
+	if (loose_object_maybe_in(&local_loose_cache, get_object_directory(),
+				  sha1) &&
+	    !lstat(*path, st))
 		return 0;
 
 	prepare_alt_odb();
 	errno = ENOENT;
 	for (alt = alt_odb_list; alt; alt = alt->next) {
 		*path = alt_sha1_path(alt, sha1);
-		if (!lstat(*path, st))
+		if (loose_object_maybe_in(&alt->loose_cache, alt->path, sha1) &&
+		    !lstat(*path, st))
 			return 0;
 	}
 
@@ -1738,13 +1881,19 @@ static int open_sha1_file(const unsigned char *sha1, const char **path)
 	int most_interesting_errno;
 
 	*path = sha1_file_name(sha1);
-	fd = git_open(*path);
-	if (fd >= 0)
-		return fd;
-	most_interesting_errno = errno;
+	if (loose_object_maybe_in(&local_loose_cache, get_object_directory(),
+				  sha1)) {
+		fd = git_open(*path);
+		if (fd >= 0)
+			return fd;
+		most_interesting_errno = errno;
+	} else
+		most_interesting_errno = ENOENT;
 
 	prepare_alt_odb();
 	for (alt = alt_odb_list; alt; alt = alt->next) {
+		if (!loose_object_maybe_in(&alt->loose_cache, alt->path, sha1))
+			continue;
 		*path = alt_sha1_path(alt, sha1);
 		fd = git_open(*path);
 		if (fd >= 0)
@@ -2112,18 +2261,18 @@ static const unsigned char *get_delta_base_sha1(struct packed_git *p,
 		unsigned char *base = use_pack(p, w_curs, curpos, NULL);
 		return base;
 	} else if (type == OBJ_OFS_DELTA) {
-		struct revindex_entry *revidx;
+		int pos;
 		off_t base_offset = get_delta_base(p, w_curs, &curpos,
 						   type, delta_obj_offset);
 
 		if (!base_offset)
 			return NULL;
 
-		revidx = find_pack_revindex(p, base_offset);
-		if (!revidx)
+		pos = find_revindex_position(p, base_offset);
+		if (pos < 0)
 			return NULL;
 
-		return nth_packed_object_sha1(p, revidx->nr);
+		return nth_packed_object_sha1(p, pack_pos_to_index(p, pos));
 	} else
 		return NULL;
 }
@@ -2156,13 +2305,12 @@ int unpack_object_header(struct packed_git *p,
 
 static int retry_bad_packed_offset(struct packed_git *p, off_t obj_offset)
 {
-	int type;
-	struct revindex_entry *revidx;
+	int type, pos;
 	const unsigned char *sha1;
-	revidx = find_pack_revindex(p, obj_offset);
-	if (!revidx)
+	pos = find_revindex_position(p, obj_offset);
+	if (pos < 0)
 		return OBJ_BAD;
-	sha1 = nth_packed_object_sha1(p, revidx->nr);
+	sha1 = nth_packed_object_sha1(p, pack_pos_to_index(p, pos));
 	mark_bad_packed_object(p, sha1);
 	type = sha1_object_info(sha1, NULL);
 	if (type <= OBJ_NONE)
@@ -2273,8 +2421,12 @@ int packed_object_info(struct packed_git *p, off_t obj_offset,
 	}
 
 	if (oi->disk_sizep) {
-		struct revindex_entry *revidx = find_pack_revindex(p, obj_offset);
-		*oi->disk_sizep = revidx[1].offset - obj_offset;
+		int pos = find_revindex_position(p, obj_offset);
+		if (pos < 0) {
+			type = OBJ_BAD;
+			goto out;
+		}
+		*oi->disk_sizep = pack_pos_to_offset(p, pos + 1) - obj_offset;
 	}
 
 	if (oi->typep) {
@@ -2340,11 +2492,34 @@ static void *unpack_compressed_entry(struct packed_git *p,
 	return buffer;
 }
 
+/*
+ * The delta base cache keeps the most recently used bases, up to
+ * core.deltaBaseCacheLimit bytes. Two things temper the plain LRU order:
+ *
+ *  - A base larger than a quarter of the limit is not cached, as it
+ *    would evict everything else to make room for a single object.
+ *
+ *  - A base that took a long delta chain to rebuild is spared once when
+ *    it comes up for eviction, and goes back to the recent end of the
+ *    list; dropping it costs a walk down the whole chain if it is needed
+ *    again, while bases close to the bottom of their chain are cheap to
+ *    rebuild.
+ */
+#define DELTA_BASE_MAX_SIZE(limit) ((limit) / 4)
+#define DELTA_BASE_SPARE_DEPTH 16
+
 static struct hashmap delta_base_cache;
 static size_t delta_base_cached;
 
 static LIST_HEAD(delta_base_cache_lru);
 
+static struct trace_key trace_delta_base_cache = TRACE_KEY_INIT(DELTA_BASE_CACHE);
+
+static struct delta_base_cache_stats {
+	unsigned long hits, misses, evictions, spared, uncached;
+	size_t peak;
+} delta_base_cache_stats;
+
 struct delta_base_cache_key {
 	struct packed_git *p;
 	off_t base_offset;
@@ -2357,6 +2532,9 @@ struct delta_base_cache_entry {
 	void *data;
 	unsigned long size;
 	enum object_type type;
+	/* the number of deltas applied to get this base */
+	unsigned depth;
+	unsigned spared:1;
 };
 
 static unsigned int pack_entry_hash(struct packed_git *p, off_t base_offset)
@@ -2405,6 +2583,46 @@ static int in_delta_base_cache(struct packed_git *p, off_t base_offset)
 	return !!get_delta_base_cache_entry(p, base_offset);
 }
 
+static void report_delta_base_cache(void)
+{
+	struct delta_base_cache_stats *st = &delta_base_cache_stats;
+	struct packed_git *p;
+
+	trace_printf_key(&trace_delta_base_cache,
+			 "delta base cache: %lu hits, %lu misses, "
+			 "%lu evictions, %lu spared, %lu too large, "
+			 "peak %"PRIuMAX" of %"PRIuMAX" bytes\n",
+			 st->hits, st->misses, st->evictions, st->spared,
+			 st->uncached, (uintmax_t)st->peak,
+			 (uintmax_t)delta_base_cache_limit);
+	for (p = packed_git; p; p = p->next) {
+		if (!p->delta_base_hits && !p->delta_base_misses)
+			continue;
+		trace_printf_key(&trace_delta_base_cache,
+				 "delta base cache: %s: %lu hits, %lu misses\n",
+				 p->pack_name, p->delta_base_hits,
+				 p->delta_base_misses);
+	}
+}
+
+static void count_delta_base_lookup(struct packed_git *p, int hit)
+{
+	static int registered;
+
+	if (!registered) {
+		registered = 1;
+		if (trace_want(&trace_delta_base_cache))
+			atexit(report_delta_base_cache);
+	}
+	if (hit) {
+		delta_base_cache_stats.hits++;
+		p->delta_base_hits++;
+	} else {
+		delta_base_cache_stats.misses++;
+		p->delta_base_misses++;
+	}
+}
+
 /*
  * Remove the entry from the cache, but do _not_ free the associated
  * entry data. The caller takes ownership of the "data" buffer, and
@@ -2427,6 +2645,7 @@ static void *cache_or_unpack_entry(struct packed_git *p, off_t base_offset,
 	if (!ent)
 		return unpack_entry(p, base_offset, type, base_size);
 
+	count_delta_base_lookup(p, 1);
 	*type = ent->type;
 	*base_size = ent->size;
 	return xmemdupz(ent->data, ent->size);
@@ -2448,33 +2667,56 @@ void clear_delta_base_cache(void)
 	}
 }
 
-static void add_delta_base_cache(struct packed_git *p, off_t base_offset,
-	void *base, unsigned long base_size, enum object_type type)
+/*
+ * Add "base", which took "depth" deltas to rebuild, to the cache. Return
+ * 0 if it is too large to be cached, in which case the caller keeps
+ * ownership of it.
+ */
+static int add_delta_base_cache(struct packed_git *p, off_t base_offset,
+	void *base, unsigned long base_size, enum object_type type,
+	unsigned depth)
 {
-	struct delta_base_cache_entry *ent = xmalloc(sizeof(*ent));
-	struct list_head *lru, *tmp;
+	struct delta_base_cache_entry *ent;
+
+	if (base_size > DELTA_BASE_MAX_SIZE(delta_base_cache_limit)) {
+		delta_base_cache_stats.uncached++;
+		return 0;
+	}
 
 	delta_base_cached += base_size;
 
-	list_for_each_safe(lru, tmp, &delta_base_cache_lru) {
+	while (delta_base_cached > delta_base_cache_limit) {
 		struct delta_base_cache_entry *f =
-			list_entry(lru, struct delta_base_cache_entry, lru);
-		if (delta_base_cached <= delta_base_cache_limit)
-			break;
+			list_entry(delta_base_cache_lru.next,
+				   struct delta_base_cache_entry, lru);
+		if (f->depth >= DELTA_BASE_SPARE_DEPTH && !f->spared) {
+			f->spared = 1;
+			list_del(&f->lru);
+			list_add_tail(&f->lru, &delta_base_cache_lru);
+			delta_base_cache_stats.spared++;
+			continue;
+		}
 		release_delta_base_cache(f);
+		delta_base_cache_stats.evictions++;
 	}
 
+	ent = xmalloc(sizeof(*ent));
 	ent->key.p = p;
 	ent->key.base_offset = base_offset;
 	ent->type = type;
 	ent->data = base;
 	ent->size = base_size;
+	ent->depth = depth;
+	ent->spared = 0;
 	list_add_tail(&ent->lru, &delta_base_cache_lru);
+	if (delta_base_cache_stats.peak < delta_base_cached)
+		delta_base_cache_stats.peak = delta_base_cached;
 
 	if (!delta_base_cache.cmpfn)
 		hashmap_init(&delta_base_cache, delta_base_cache_hash_cmp, 0);
 	hashmap_entry_init(ent, pack_entry_hash(p, base_offset));
 	hashmap_add(&delta_base_cache, ent);
+	return 1;
 }
 
 static void *read_object(const unsigned char *sha1, enum object_type *type,
@@ -2508,6 +2750,7 @@ void *unpack_entry(struct packed_git *p, off_t obj_offset,
 	struct unpack_entry_stack_ent *delta_stack = small_delta_stack;
 	int delta_stack_nr = 0, delta_stack_alloc = UNPACK_ENTRY_STACK_PREALLOC;
 	int base_from_cache = 0;
+	unsigned depth = 0;
 
 	write_pack_access_log(p, obj_offset);
 
@@ -2519,20 +2762,32 @@ void *unpack_entry(struct packed_git *p, off_t obj_offset,
 
 		ent = get_delta_base_cache_entry(p, curpos);
 		if (ent) {
+			count_delta_base_lookup(p, 1);
 			type = ent->type;
 			data = ent->data;
 			size = ent->size;
+			depth = ent->depth;
 			detach_delta_base_cache_entry(ent);
 			base_from_cache = 1;
 			break;
 		}
+		if (delta_stack_nr)
+			count_delta_base_lookup(p, 0);
 
 		if (do_check_packed_object_crc && p->index_version > 1) {
-			struct revindex_entry *revidx = find_pack_revindex(p, obj_offset);
-			off_t len = revidx[1].offset - obj_offset;
-			if (check_pack_crc(p, &w_curs, obj_offset, len, revidx->nr)) {
+			int pos = find_revindex_position(p, obj_offset);
+			uint32_t nr;
+			off_t len;
+
+			if (pos < 0) {
+				unuse_pack(&w_curs);
+				return NULL;
+			}
+			nr = pack_pos_to_index(p, pos);
+			len = pack_pos_to_offset(p, pos + 1) - obj_offset;
+			if (check_pack_crc(p, &w_curs, obj_offset, len, nr)) {
 				const unsigned char *sha1 =
-					nth_packed_object_sha1(p, revidx->nr);
+					nth_packed_object_sha1(p, nr);
 				error("bad packed object CRC for %s",
 				      sha1_to_hex(sha1));
 				mark_bad_packed_object(p, sha1);
@@ -2607,8 +2862,10 @@ void *unpack_entry(struct packed_git *p, off_t obj_offset,
 
 		data = NULL;
 
-		if (base)
-			add_delta_base_cache(p, obj_offset, base, base_size, type);
+		/* if not cached, free the base once the delta is applied */
+		if (base && !add_delta_base_cache(p, obj_offset, base, base_size,
+						  type, depth))
+			external_base = base;
 
 		if (!base) {
 			/*
@@ -2617,11 +2874,12 @@ void *unpack_entry(struct packed_git *p, off_t obj_offset,
 			 * This is costly but should happen only in the presence
 			 * of a corrupted pack, and is better than failing outright.
 			 */
-			struct revindex_entry *revidx;
+			int pos;
 			const unsigned char *base_sha1;
-			revidx = find_pack_revindex(p, obj_offset);
-			if (revidx) {
-				base_sha1 = nth_packed_object_sha1(p, revidx->nr);
+			pos = find_revindex_position(p, obj_offset);
+			if (pos >= 0) {
+				base_sha1 = nth_packed_object_sha1(p,
+						pack_pos_to_index(p, pos));
 				error("failed to read delta base object %s"
 				      " at offset %"PRIuMAX" from %s",
 				      sha1_to_hex(base_sha1), (uintmax_t)obj_offset,
@@ -2654,6 +2912,7 @@ void *unpack_entry(struct packed_git *p, off_t obj_offset,
 		data = patch_delta(base, base_size,
 				   delta_data, delta_size,
 				   &size);
+		depth++;
 
 		/*
 		 * We could not apply the delta; warn the user, but keep going.
@@ -2987,7 +3246,7 @@ int sha1_object_info_extended(const unsigned char *sha1, struct object_info *oi,
 		}
 
 		/* Not a loose object; someone else may have just packed it. */
-		reprepare_packed_git();
+		rescan_packs();
 		if (!find_pack_entry(real, &e))
 			return -1;
 	}
@@ -3100,7 +3359,7 @@ static void *read_object(const unsigned char *sha1, enum object_type *type,
 		munmap(map, mapsize);
 		return buf;
 	}
-	reprepare_packed_git();
+	rescan_packs();
 	return read_packed_sha1(sha1, type, size);
 }
 
@@ -3144,6 +3403,392 @@ void *read_sha1_file_extended(const unsigned char *sha1,
 	return NULL;
 }
 
+/*
+ * An object of an object_batch, or a delta base on the way to one of
+ * them. "pending" counts the reads still expected from the node: one
+ * if the object itself was asked for, and one for each delta on top of
+ * it that has not been applied yet. Its contents are kept as long as
+ * it is non-zero, so that they are reconstructed only once.
+ */
+struct batch_node {
+	struct hashmap_entry ent;
+	struct delta_base_cache_key key;
+	struct batch_node *base;
+	off_t base_offset;
+	off_t data_pos;
+	unsigned long data_size;
+	enum object_type in_pack_type;
+	unsigned pending;
+	unsigned applied:1;
+	/* the contents, while they are kept */
+	void *data;
+	unsigned long size;
+	enum object_type type;
+};
+
+struct batch_request {
+	struct object_id oid;
+	struct batch_node *node;
+	unsigned read:1;
+};
+
+struct object_batch {
+	struct batch_request *requests;
+	int nr;
+	struct hashmap nodes;
+	size_t kept;
+};
+
+static int batch_node_cmp(const void *va, const void *vb, const void *vkey)
+{
+	const struct batch_node *a = va, *b = vb;
+	const struct delta_base_cache_key *key = vkey;
+	return !delta_base_cache_key_eq(&a->key, key ? key : &b->key);
+}
+
+static struct batch_node *get_batch_node(struct object_batch *batch,
+					 struct packed_git *p, off_t offset,
+					 struct pack_window **w_curs,
+					 int *created)
+{
+	struct batch_node *node;
+	struct hashmap_entry entry;
+	struct delta_base_cache_key key;
+	off_t curpos = offset;
+
+	hashmap_entry_init(&entry, pack_entry_hash(p, offset));
+	key.p = p;
+	key.base_offset = offset;
+	node = hashmap_get(&batch->nodes, &entry, &key);
+	*created = !node;
+	if (node)
+		return node;
+
+	node = xcalloc(1, sizeof(*node));
+	hashmap_entry_init(node, pack_entry_hash(p, offset));
+	node->key = key;
+	node->in_pack_type = unpack_object_header(p, w_curs, &curpos,
+						  &node->data_size);
+	if (node->in_pack_type == OBJ_OFS_DELTA ||
+	    node->in_pack_type == OBJ_REF_DELTA)
+		node->base_offset = get_delta_base(p, w_curs, &curpos,
+						   node->in_pack_type, offset);
+	node->data_pos = curpos;
+	hashmap_add(&batch->nodes, node);
+	return node;
+}
+
+/*
+ * Walk the delta chain of a packed object of the batch, down to the
+ * first entry that is already known because it is shared with the
+ * chain of another object.
+ */
+static void plan_batch_request(struct object_batch *batch,
+			       struct batch_request *req,
+			       struct pack_window **w_curs)
+{
+	const unsigned char *sha1 = req->oid.hash;
+	struct batch_node *node, *delta = NULL;
+	struct pack_entry e;
+	off_t offset;
+	int created;
+
+	/* leave anything unusual to read_sha1_file() */
+	if (find_cached_object(sha1) || lookup_replace_object(sha1) != sha1 ||
+	    !find_pack_entry(sha1, &e))
+		return;
+
+	offset = e.offset;
+	do {
+		node = get_batch_node(batch, e.p, offset, w_curs, &created);
+		node->pending++;
+		if (delta)
+			delta->base = node;
+		else
+			req->node = node;
+		delta = node;
+		offset = node->base_offset;
+	} while (created && offset);
+}
+
+static int cmp_batch_request(const void *va, const void *vb)
+{
+	const struct batch_request *a = va, *b = vb;
+	return oidcmp(&a->oid, &b->oid);
+}
+
+static const unsigned char *batch_request_access(size_t index, void *table)
+{
+	struct batch_request *requests = table;
+	return requests[index].oid.hash;
+}
+
+struct object_batch *prepare_object_batch(const struct oid_array *oids)
+{
+	struct object_batch *batch = xcalloc(1, sizeof(*batch));
+	struct pack_window *w_curs = NULL;
+	int i;
+
+	hashmap_init(&batch->nodes, batch_node_cmp, oids->nr);
+	ALLOC_ARRAY(batch->requests, oids->nr);
+	for (i = 0; i < oids->nr; i++) {
+		oidcpy(&batch->requests[i].oid, &oids->oid[i]);
+		batch->requests[i].node = NULL;
+		batch->requests[i].read = 0;
+	}
+	QSORT(batch->requests, oids->nr, cmp_batch_request);
+	for (i = 0; i < oids->nr; i++)
+		if (!batch->nr || oidcmp(&batch->requests[i].oid,
+					 &batch->requests[batch->nr - 1].oid))
+			batch->requests[batch->nr++] = batch->requests[i];
+
+	/* the CRC of the entries is only checked by unpack_entry() */
+	if (!do_check_packed_object_crc)
+		for (i = 0; i < batch->nr; i++)
+			plan_batch_request(batch, &batch->requests[i], &w_curs);
+	unuse_pack(&w_curs);
+	return batch;
+}
+
+static int keep_batch_node(struct object_batch *batch, struct batch_node *node,
+			   void *data, unsigned long size, enum object_type type)
+{
+	if (batch->kept + size > delta_base_cache_limit)
+		return 0;
+	node->data = data;
+	node->size = size;
+	node->type = type;
+	batch->kept += size;
+	return 1;
+}
+
+static void *detach_batch_node(struct object_batch *batch,
+			       struct batch_node *node)
+{
+	void *data = node->data;
+
+	node->data = NULL;
+	batch->kept -= node->size;
+	return data;
+}
+
+/*
+ * Dispose of the contents of a node once a delta has been applied on
+ * top of them, unless more reads are expected from the node. What the
+ * batch does not keep goes to the delta base cache, like the bases
+ * reconstructed by unpack_entry().
+ */
+static void release_batch_node(struct object_batch *batch,
+			       struct batch_node *node, void *data,
+			       unsigned long size, enum object_type type,
+			       unsigned depth)
+{
+	if (node->data == data) {
+		if (node->pending)
+			return;
+		detach_batch_node(batch, node);
+	} else if (node->pending &&
+		   keep_batch_node(batch, node, data, size, type))
+		return;
+
+	if (in_delta_base_cache(node->key.p, node->key.base_offset) ||
+	    !add_delta_base_cache(node->key.p, node->key.base_offset,
+				  data, size, type, depth))
+		free(data);
+}
+
+static void *unpack_batch_node(struct object_batch *batch,
+			       struct batch_node *node, int first_read,
+			       enum object_type *type, unsigned long *size)
+{
+	struct pack_window *w_curs = NULL;
+	struct batch_node **deltas = NULL, *cur;
+	struct delta_base_cache_entry *ent = NULL;
+	int nr = 0, alloc = 0;
+	unsigned depth = 0;
+	void *data;
+
+	/*
+	 * Find the closest base we have, either kept by the batch or in
+	 * the delta base cache, or else the bottom of the chain.
+	 */
+	for (cur = node; !cur->data; cur = cur->base) {
+		ent = get_delta_base_cache_entry(cur->key.p,
+						 cur->key.base_offset);
+		if (cur != node)
+			count_delta_base_lookup(cur->key.p, !!ent);
+		if (ent || !cur->base)
+			break;
+		ALLOC_GROW(deltas, nr + 1, alloc);
+		deltas[nr++] = cur;
+	}
+
+	if (cur->data) {
+		data = cur->data;
+		*type = cur->type;
+		*size = cur->size;
+	} else if (ent) {
+		data = ent->data;
+		*type = ent->type;
+		*size = ent->size;
+		depth = ent->depth;
+		detach_delta_base_cache_entry(ent);
+	} else if (cur->in_pack_type >= OBJ_COMMIT &&
+		   cur->in_pack_type <= OBJ_TAG) {
+		*type = cur->in_pack_type;
+		*size = cur->data_size;
+		data = unpack_compressed_entry(cur->key.p, &w_curs,
+					       cur->data_pos, *size);
+	} else
+		data = unpack_entry(cur->key.p, cur->key.base_offset,
+				    type, size);
+
+	while (data && nr) {
+		struct batch_node *delta = deltas[--nr];
+		void *delta_data, *result = NULL;
+		unsigned long result_size = 0;
+
+		if (!delta->applied) {
+			delta->applied = 1;
+			if (cur->pending)
+				cur->pending--;
+		}
+		delta_data = unpack_compressed_entry(delta->key.p, &w_curs,
+						     delta->data_pos,
+						     delta->data_size);
+		if (delta_data)
+			result = patch_delta(data, *size, delta_data,
+					     delta->data_size, &result_size);
+		free(delta_data);
+		release_batch_node(batch, cur, data, *size, *type, depth);
+		data = result;
+		*size = result_size;
+		cur = delta;
+		depth++;
+	}
+	unuse_pack(&w_curs);
+	free(deltas);
+	if (!data)
+		return NULL;
+
+	if (first_read && node->pending)
+		node->pending--;
+	if (node->data == data)
+		return node->pending ? xmemdupz(data, *size) :
+				       detach_batch_node(batch, node);
+	if (node->pending && batch->kept + *size <= delta_base_cache_limit)
+		keep_batch_node(batch, node, xmemdupz(data, *size),
+				*size, *type);
+	return data;
+}
+
+void *read_object_batch(struct object_batch *batch, const unsigned char *sha1,
+			enum object_type *type, unsigned long *size)
+{
+	void *data = NULL;
+	int pos;
+
+	if (batch) {
+		pos = sha1_pos(sha1, batch->requests, batch->nr,
+			       batch_request_access);
+		if (pos >= 0 && batch->requests[pos].node) {
+			struct batch_request *req = &batch->requests[pos];
+			data = unpack_batch_node(batch, req->node, !req->read,
+						 type, size);
+			req->read = 1;
+		}
+	}
+	/* this also takes care of any corruption of the packed copy */
+	if (!data)
+		data = read_sha1_file(sha1, type, size);
+	return data;
+}
+
+struct batch_location {
+	struct packed_git *p;
+	off_t offset;
+	const struct object_id *oid;
+};
+
+static int cmp_batch_location(const void *va, const void *vb)
+{
+	const struct batch_location *a = va, *b = vb;
+
+	if (a->p != b->p) {
+		/* objects that are not packed come last, in hash order */
+		if (!a->p || !b->p)
+			return a->p ? -1 : 1;
+		return strcmp(a->p->pack_name, b->p->pack_name);
+	}
+	if (a->offset != b->offset)
+		return a->offset < b->offset ? -1 : 1;
+	return oidcmp(a->oid, b->oid);
+}
+
+int for_each_object_in_batch(struct object_batch *batch,
+			     each_batch_object_fn fn, void *data)
+{
+	struct batch_location *order;
+	int i, ret = 0;
+
+	ALLOC_ARRAY(order, batch->nr);
+	for (i = 0; i < batch->nr; i++) {
+		struct batch_node *node = batch->requests[i].node;
+
+		order[i].p = node ? node->key.p : NULL;
+		order[i].offset = node ? node->key.base_offset : 0;
+		order[i].oid = &batch->requests[i].oid;
+	}
+	QSORT(order, batch->nr, cmp_batch_location);
+	for (i = 0; i < batch->nr && !ret; i++)
+		ret = fn(order[i].oid, data);
+	free(order);
+	return ret;
+}
+
+int for_each_object_in_pack_order(const struct oid_array *oids,
+				  each_batch_object_fn fn, void *data)
+{
+	struct batch_location *order;
+	int i, ret = 0;
+
+	ALLOC_ARRAY(order, oids->nr);
+	for (i = 0; i < oids->nr; i++) {
+		struct pack_entry e;
+
+		if (find_pack_entry(oids->oid[i].hash, &e)) {
+			order[i].p = e.p;
+			order[i].offset = e.offset;
+		} else {
+			order[i].p = NULL;
+			order[i].offset = 0;
+		}
+		order[i].oid = &oids->oid[i];
+	}
+	/* duplicates end up next to each other */
+	QSORT(order, oids->nr, cmp_batch_location);
+	for (i = 0; i < oids->nr && !ret; i++)
+		if (!i || oidcmp(order[i].oid, order[i - 1].oid))
+			ret = fn(order[i].oid, data);
+	free(order);
+	return ret;
+}
+
+void free_object_batch(struct object_batch *batch)
+{
+	struct hashmap_iter iter;
+	struct batch_node *node;
+
+	if (!batch)
+		return;
+	hashmap_iter_init(&batch->nodes, &iter);
+	while ((node = hashmap_iter_next(&iter)))
+		free(node->data);
+	hashmap_free(&batch->nodes, 1);
+	free(batch->requests);
+	free(batch);
+}
+
 void *read_object_with_reference(const unsigned char *sha1,
 				 const char *required_type_name,
 				 unsigned long *size,
@@ -3385,7 +4030,10 @@ static int write_loose_object(const unsigned char *sha1, char *hdr, int hdrlen,
 			warning_errno("failed utime() on %s", tmp_file.buf);
 	}
 
-	return finalize_object_file(tmp_file.buf, filename);
+	if (finalize_object_file(tmp_file.buf, filename))
+		return -1;
+	add_to_loose_object_cache(sha1);
+	return 0;
 }
 
 static int freshen_loose_object(const unsigned char *sha1)
@@ -3489,7 +4137,7 @@ int has_sha1_file_with_flags(const unsigned char *sha1, int flags)
 		return 1;
 	if (flags & HAS_SHA1_QUICK)
 		return 0;
-	reprepare_packed_git();
+	rescan_packs();
 	return find_pack_entry(sha1, &e);
 }
 
@@ -3908,6 +4556,229 @@ int for_each_packed_object(each_packed_object_fn cb, void *data, unsigned flags)
 	return r ? r : pack_errors;
 }
 
+/*
+ * An object of a has_object_files() call, with its index into the caller's
+ * array. We keep a copy of the name so that sorting and walking the batch
+ * do not have to go through the index.
+ */
+struct batch_entry {
+	struct object_id oid;
+	int index;
+};
+
+/* The objects that are still to be found, sorted by object name. */
+struct existence_batch {
+	char *exists;
+	struct batch_entry *todo;
+	int nr;
+};
+
+static int cmp_batch_entry(const void *a_, const void *b_)
+{
+	const struct batch_entry *a = a_, *b = b_;
+
+	return oidcmp(&a->oid, &b->oid);
+}
+
+/*
+ * Sort a large batch by distributing it on the leading bits of the names
+ * and then sorting each bucket, which is much cheaper than comparing the
+ * names all the way through.
+ */
+static void sort_batch(struct batch_entry *entries, int nr)
+{
+	struct batch_entry *sorted;
+	unsigned int *pos, nr_buckets, shift;
+	int i;
+
+	if (nr < 256) {
+		QSORT(entries, nr, cmp_batch_entry);
+		return;
+	}
+	shift = nr < (1 << 14) ? 8 : 0;
+	nr_buckets = 1 << (16 - shift);
+
+	pos = xcalloc(nr_buckets + 1, sizeof(*pos));
+	for (i = 0; i < nr; i++)
+		pos[(get_be16(entries[i].oid.hash) >> shift) + 1]++;
+	for (i = 1; i <= nr_buckets; i++)
+		pos[i] += pos[i - 1];
+
+	ALLOC_ARRAY(sorted, nr);
+	for (i = 0; i < nr; i++)
+		sorted[pos[get_be16(entries[i].oid.hash) >> shift]++] = entries[i];
+
+	/* each bucket now ends where the next one starts */
+	for (i = 0; i < nr_buckets; i++) {
+		unsigned int start = i ? pos[i - 1] : 0;
+		QSORT(sorted + start, pos[i] - start, cmp_batch_entry);
+	}
+	COPY_ARRAY(entries, sorted, nr);
+	free(sorted);
+	free(pos);
+}
+
+/* Drop the objects that have been found from the batch. */
+static void prune_found_objects(struct existence_batch *b)
+{
+	int i, j;
+
+	for (i = j = 0; i < b->nr; i++)
+		if (!b->exists[b->todo[i].index])
+			b->todo[j++] = b->todo[i];
+	b->nr = j;
+}
+
+static int is_bad_pack_object(struct packed_git *p, const unsigned char *sha1)
+{
+	unsigned i;
+
+	for (i = 0; i < p->num_bad_objects; i++)
+		if (!hashcmp(sha1, p->bad_object_sha1 + 20 * i))
+			return 1;
+	return 0;
+}
+
+/*
+ * Return the first position at or after "pos" in the index of "p" whose
+ * object name is not less than "sha1". We probe pos, pos + 1, pos + 3,
+ * pos + 7, ... and then bisect the last step, so that walking a sorted
+ * batch through the index costs O(nr * log(num_objects / nr)): a merge
+ * when the batch is dense, a binary search per object when it is sparse.
+ */
+static uint32_t gallop_pack_index(struct packed_git *p, uint32_t pos,
+				  const unsigned char *sha1)
+{
+	uint32_t lo = pos, hi, step = 1;
+	uint32_t num = p->num_objects;
+
+	for (;;) {
+		hi = num - lo > step - 1 ? lo + step - 1 : num;
+		if (hi == num || hashcmp(nth_packed_object_sha1(p, hi), sha1) >= 0)
+			break;
+		lo = hi + 1;
+		step *= 2;
+	}
+	while (lo < hi) {
+		uint32_t mi = lo + (hi - lo) / 2;
+		if (hashcmp(nth_packed_object_sha1(p, mi), sha1) < 0)
+			lo = mi + 1;
+		else
+			hi = mi;
+	}
+	return lo;
+}
+
+static void find_batch_in_pack(struct existence_batch *b,
+			       struct packed_git *p)
+{
+	uint32_t pos = 0;
+	int i, valid = -1;
+
+	if (open_pack_index(p))
+		return;
+
+	for (i = 0; i < b->nr && pos < p->num_objects; i++) {
+		const unsigned char *sha1 = b->todo[i].oid.hash;
+
+		pos = gallop_pack_index(p, pos, sha1);
+		if (pos == p->num_objects ||
+		    hashcmp(nth_packed_object_sha1(p, pos), sha1) ||
+		    is_bad_pack_object(p, sha1))
+			continue;
+
+		/* see fill_pack_entry() */
+		if (valid < 0)
+			valid = is_pack_valid(p);
+		if (!valid)
+			return;
+		b->exists[b->todo[i].index] = 1;
+	}
+}
+
+static void find_batch_in_packs(struct existence_batch *b)
+{
+	struct packed_git *p;
+
+	for (p = packed_git; p && b->nr; p = p->next) {
+		find_batch_in_pack(b, p);
+		prune_found_objects(b);
+	}
+}
+
+/*
+ * Below this many objects in the same fan-out directory we stat() each
+ * of them rather than read the whole directory. With the loose object
+ * cache, has_loose_object() reads and keeps the listing itself.
+ */
+#define LOOSE_BATCH_READDIR_MIN 4
+
+static void find_batch_loose(struct existence_batch *b)
+{
+	struct oid_array listing = OID_ARRAY_INIT;
+	struct strbuf path = STRBUF_INIT;
+	struct alternate_object_database *alt;
+	int i = 0, end;
+
+	prepare_alt_odb();
+	while (i < b->nr) {
+		int subdir_nr = b->todo[i].oid.hash[0];
+
+		for (end = i + 1; end < b->nr; end++)
+			if (b->todo[end].oid.hash[0] != subdir_nr)
+				break;
+
+		if (end - i < LOOSE_BATCH_READDIR_MIN ||
+		    use_loose_object_cache) {
+			for (; i < end; i++)
+				if (has_loose_object(b->todo[i].oid.hash))
+					b->exists[b->todo[i].index] = 1;
+			continue;
+		}
+
+		oid_array_clear(&listing);
+		list_loose_subdir(subdir_nr, &path, get_object_directory(),
+				  &listing);
+		for (alt = alt_odb_list; alt; alt = alt->next)
+			list_loose_subdir(subdir_nr, &path, alt->path, &listing);
+		for (; i < end; i++)
+			if (oid_array_lookup(&listing, &b->todo[i].oid) >= 0)
+				b->exists[b->todo[i].index] = 1;
+	}
+	oid_array_clear(&listing);
+	strbuf_release(&path);
+	prune_found_objects(b);
+}
+
+void has_object_files(const struct oid_array *oids, char *exists, int flags)
+{
+	struct existence_batch b;
+	int i;
+
+	memset(exists, 0, oids->nr);
+	if (!startup_info->have_repository || !oids->nr)
+		return;
+
+	b.exists = exists;
+	b.nr = oids->nr;
+	ALLOC_ARRAY(b.todo, b.nr);
+	for (i = 0; i < b.nr; i++) {
+		oidcpy(&b.todo[i].oid, &oids->oid[i]);
+		b.todo[i].index = i;
+	}
+	sort_batch(b.todo, b.nr);
+
+	prepare_packed_git();
+	find_batch_in_packs(&b);
+	if (b.nr)
+		find_batch_loose(&b);
+	if (b.nr && !(flags & HAS_SHA1_QUICK)) {
+		rescan_packs();
+		find_batch_in_packs(&b);
+	}
+	free(b.todo);
+}
+
 static int check_stream_sha1(git_zstream *stream,
 			     const char *hdr,
 			     unsigned long size,
@@ -387,6 +387,7 @@ struct trace_key trace_shallow = TRACE_KEY_INIT(SHALLOW);
  */
 void prepare_shallow_info(struct shallow_info *info, struct oid_array *sa)
 {
+	char *exists;
 	int i;
 	trace_printf_key(&trace_shallow, "shallow: prepare_shallow_info\n");
 	memset(info, 0, sizeof(*info));
@@ -395,8 +396,10 @@ void prepare_shallow_info(struct shallow_info *info, struct oid_array *sa)
 		return;
 	ALLOC_ARRAY(info->ours, sa->nr);
 	ALLOC_ARRAY(info->theirs, sa->nr);
+	exists = xmalloc(sa->nr);
+	has_object_files(sa, exists, 0);
 	for (i = 0; i < sa->nr; i++) {
-		if (has_object_file(sa->oid + i)) {
+		if (exists[i]) {
 			struct commit_graft *graft;
 			graft = lookup_commit_graft(sa->oid[i].hash);
 			if (graft && graft->nr_parent < 0)
@@ -405,6 +408,7 @@ void prepare_shallow_info(struct shallow_info *info, struct oid_array *sa)
 		} else
 			info->theirs[info->nr_theirs++] = i;
 	}
+	free(exists);
 }
 
 void clear_shallow_info(struct shallow_info *info)
@@ -417,16 +421,19 @@ void clear_shallow_info(struct shallow_info *info)
 
 void remove_nonexistent_theirs_shallow(struct shallow_info *info)
 {
-	struct object_id *oid = info->shallow->oid;
+	char *exists;
 	int i, dst;
 	trace_printf_key(&trace_shallow, "shallow: remove_nonexistent_theirs_shallow\n");
+	exists = xmalloc(info->shallow->nr);
+	has_object_files(info->shallow, exists, 0);
 	for (i = dst = 0; i < info->nr_theirs; i++) {
 		if (i != dst)
 			info->theirs[dst] = info->theirs[i];
-		if (has_object_file(oid + info->theirs[i]))
+		if (exists[info->theirs[i]])
 			dst++;
 	}
 	info->nr_theirs = dst;
+	free(exists);
 }
 
 define_commit_slab(ref_bitmap, uint32_t *);
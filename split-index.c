@@ -123,7 +123,7 @@ static void replace_entry(size_t pos, void *data)
 	src->ce_flags |= CE_UPDATE_IN_BASE;
 	src->ce_namelen = dst->ce_namelen;
 	copy_cache_entry(dst, src);
-	free(src);
+	free_cache_entry(src);
 	si->nr_replacements++;
 }
 
@@ -300,7 +300,7 @@ void save_or_free_index_entry(struct index_state *istate, struct cache_entry *ce
 	    ce == istate->split_index->base->cache[ce->index - 1])
 		ce->ce_flags |= CE_REMOVE;
 	else
-		free(ce);
+		free_cache_entry(ce);
 }
 
 void replace_index_entry_in_base(struct index_state *istate,
@@ -313,8 +313,9 @@ void replace_index_entry_in_base(struct index_state *istate,
 	    old->index <= istate->split_index->base->cache_nr) {
 		new->index = old->index;
 		if (old != istate->split_index->base->cache[new->index - 1])
-			free(istate->split_index->base->cache[new->index - 1]);
+			free_cache_entry(istate->split_index->base->cache[new->index - 1]);
 		istate->split_index->base->cache[new->index - 1] = new;
+		istate->split_index->base->ce_arena_only = 0;
 	}
 }
 
@@ -0,0 +1,279 @@
+/*
+ * test-bitmap-ops.c: exercise the EWAH operations on the bitmaps
+ * stored in a .bitmap file.
+ *
+ * "verify" checks the decoding of XOR'ed bitmaps and the result of
+ * every operation on each pair of consecutive bitmaps against a plain
+ * word-by-word computation on their uncompressed form.  "perf" times
+ * the operations, repeated <count> times over all the pairs.
+ */
+#include "cache.h"
+#include "pack.h"
+#include "revision.h"
+#include "pack-bitmap.h"
+
+static const char usage_str[] =
+	"test-bitmap-ops (verify | perf [<count>]) <bitmap-file>";
+
+struct bitmap_file {
+	struct ewah_bitmap **stored;
+	struct ewah_bitmap **bitmaps;
+	unsigned char *xor_offset;
+	uint32_t nr;
+};
+
+static struct ewah_bitmap *read_ewah(const unsigned char *map, size_t size,
+				     size_t *pos)
+{
+	struct ewah_bitmap *ewah = ewah_new();
+	int len;
+
+	if (size - *pos < 12)
+		die("truncated bitmap at offset %"PRIuMAX, (uintmax_t)*pos);
+	len = ewah_read_mmap(ewah, map + *pos, size - *pos);
+	if (len < 0 || len > size - *pos)
+		die("corrupt bitmap at offset %"PRIuMAX, (uintmax_t)*pos);
+	*pos += len;
+	return ewah;
+}
+
+static void decode_bitmaps(struct bitmap_file *f)
+{
+	uint32_t i;
+
+	for (i = 0; i < f->nr; i++) {
+		if (!f->xor_offset[i]) {
+			f->bitmaps[i] = f->stored[i];
+			continue;
+		}
+		f->bitmaps[i] = ewah_new();
+		ewah_xor(f->stored[i], f->bitmaps[i - f->xor_offset[i]],
+			 f->bitmaps[i]);
+	}
+}
+
+static void free_decoded(struct bitmap_file *f)
+{
+	uint32_t i;
+
+	for (i = 0; i < f->nr; i++) {
+		if (f->bitmaps[i] != f->stored[i])
+			ewah_free(f->bitmaps[i]);
+		f->bitmaps[i] = NULL;
+	}
+}
+
+static void read_bitmap_file(const char *path, struct bitmap_file *f)
+{
+	struct bitmap_disk_header *header;
+	unsigned char *map;
+	size_t size, pos;
+	struct stat st;
+	uint32_t i;
+	int fd;
+
+	fd = xopen(path, O_RDONLY);
+	if (fstat(fd, &st))
+		die_errno("unable to stat '%s'", path);
+	size = xsize_t(st.st_size);
+	if (size < sizeof(*header))
+		die("'%s' is too small to be a bitmap file", path);
+	map = xmmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	header = (struct bitmap_disk_header *)map;
+	if (memcmp(header->magic, BITMAP_IDX_SIGNATURE,
+		   sizeof(BITMAP_IDX_SIGNATURE)))
+		die("'%s' is not a bitmap file", path);
+
+	f->nr = ntohl(header->entry_count);
+	ALLOC_ARRAY(f->stored, f->nr);
+	ALLOC_ARRAY(f->bitmaps, f->nr);
+	ALLOC_ARRAY(f->xor_offset, f->nr);
+
+	pos = sizeof(*header);
+	/* skip the type index: commits, trees, blobs and tags */
+	for (i = 0; i < 4; i++)
+		ewah_free(read_ewah(map, size, &pos));
+
+	for (i = 0; i < f->nr; i++) {
+		if (size - pos < 6)
+			die("truncated bitmap entry %"PRIu32, i);
+		f->xor_offset[i] = map[pos + 4];
+		if (f->xor_offset[i] > i)
+			die("invalid xor offset in bitmap entry %"PRIu32, i);
+		pos += 6;
+		f->stored[i] = read_ewah(map, size, &pos);
+	}
+
+	munmap(map, size);
+	decode_bitmaps(f);
+}
+
+static eword_t *expand(struct ewah_bitmap *ewah, size_t nr)
+{
+	eword_t *words = xcalloc(nr, sizeof(eword_t));
+	struct ewah_iterator it;
+	size_t i = 0;
+	eword_t word;
+
+	ewah_iterator_init(&it, ewah);
+	while (i < nr && ewah_iterator_next(&word, &it))
+		words[i++] = word;
+	return words;
+}
+
+static eword_t apply_op(int op, eword_t a, eword_t b)
+{
+	switch (op) {
+	case 0:
+		return a | b;
+	case 1:
+		return a & b;
+	case 2:
+		return a & ~b;
+	default:
+		return a ^ b;
+	}
+}
+
+static void (*ewah_ops[])(struct ewah_bitmap *, struct ewah_bitmap *,
+			  struct ewah_bitmap *) = {
+	ewah_or, ewah_and, ewah_and_not, ewah_xor
+};
+
+static const char *op_names[] = { "or", "and", "and-not", "xor" };
+
+static void verify_pair(struct ewah_bitmap *a, struct ewah_bitmap *b)
+{
+	size_t nr = (a->bit_size > b->bit_size ? a->bit_size : b->bit_size);
+	eword_t *wa, *wb, *got;
+	struct bitmap *bitmap;
+	size_t i;
+	int op;
+
+	nr = nr / BITS_IN_EWORD + 1;
+	wa = expand(a, nr);
+	wb = expand(b, nr);
+
+	for (op = 0; op < ARRAY_SIZE(ewah_ops); op++) {
+		struct ewah_bitmap *out = ewah_new();
+
+		ewah_ops[op](a, b, out);
+		got = expand(out, nr);
+		for (i = 0; i < nr; i++)
+			if (got[i] != apply_op(op, wa[i], wb[i]))
+				die("ewah_%s differs at word %"PRIuMAX,
+				    op_names[op], (uintmax_t)i);
+		free(got);
+		ewah_free(out);
+	}
+
+	bitmap = ewah_to_bitmap(a);
+	bitmap_or_ewah(bitmap, b);
+	for (i = 0; i < nr; i++)
+		if ((i < bitmap->word_alloc ? bitmap->words[i] : 0) !=
+		    (wa[i] | wb[i]))
+			die("bitmap_or_ewah differs at word %"PRIuMAX,
+			    (uintmax_t)i);
+	bitmap_free(bitmap);
+
+	free(wa);
+	free(wb);
+}
+
+static void verify_decoding(struct bitmap_file *f, uint32_t i)
+{
+	struct ewah_bitmap *base = f->bitmaps[i - f->xor_offset[i]];
+	size_t nr = f->bitmaps[i]->bit_size / BITS_IN_EWORD + 1;
+	eword_t *got, *stored, *xor_with;
+	size_t k;
+
+	got = expand(f->bitmaps[i], nr);
+	stored = expand(f->stored[i], nr);
+	xor_with = expand(base, nr);
+	for (k = 0; k < nr; k++)
+		if (got[k] != (stored[k] ^ xor_with[k]))
+			die("bitmap entry %"PRIu32" is decoded wrong at word %"PRIuMAX,
+			    i, (uintmax_t)k);
+	free(got);
+	free(stored);
+	free(xor_with);
+}
+
+static void report(const char *name, uint64_t t0, uint32_t nr)
+{
+	printf("%-16s %f s (%"PRIu32" bitmaps)\n", name,
+	       (double)(getnanotime() - t0) / 1000000000, nr);
+}
+
+static void perf(struct bitmap_file *f, int count)
+{
+	struct ewah_bitmap *out = ewah_new();
+	uint64_t t0;
+	uint32_t i;
+	int op, n;
+
+	t0 = getnanotime();
+	for (n = 0; n < count; n++) {
+		free_decoded(f);
+		decode_bitmaps(f);
+	}
+	report("xor-decode", t0, f->nr);
+
+	for (op = 0; op < ARRAY_SIZE(ewah_ops); op++) {
+		t0 = getnanotime();
+		for (n = 0; n < count; n++)
+			for (i = 1; i < f->nr; i++) {
+				ewah_clear(out);
+				ewah_ops[op](f->bitmaps[i - 1], f->bitmaps[i],
+					     out);
+			}
+		report(op_names[op], t0, f->nr);
+	}
+
+	t0 = getnanotime();
+	for (n = 0; n < count; n++) {
+		struct bitmap *bitmap = bitmap_new();
+
+		for (i = 0; i < f->nr; i++)
+			bitmap_or_ewah(bitmap, f->bitmaps[i]);
+		bitmap_free(bitmap);
+	}
+	report("bitmap-or-ewah", t0, f->nr);
+
+	t0 = getnanotime();
+	for (n = 0; n < count; n++)
+		for (i = 0; i < f->nr; i++)
+			bitmap_free(ewah_to_bitmap(f->bitmaps[i]));
+	report("ewah-to-bitmap", t0, f->nr);
+
+	ewah_free(out);
+}
+
+int cmd_main(int argc, const char **argv)
+{
+	struct bitmap_file f;
+	uint32_t i;
+
+	if (argc == 3 && !strcmp(argv[1], "verify")) {
+		read_bitmap_file(argv[2], &f);
+		for (i = 0; i < f.nr; i++)
+			if (f.xor_offset[i])
+				verify_decoding(&f, i);
+		for (i = 1; i < f.nr; i++)
+			verify_pair(f.bitmaps[i - 1], f.bitmaps[i]);
+		printf("ok %"PRIu32" bitmaps\n", f.nr);
+		return 0;
+	}
+
+	if ((argc == 3 || argc == 4) && !strcmp(argv[1], "perf")) {
+		int count = argc == 4 ? strtol(argv[2], NULL, 0) : 1;
+
+		read_bitmap_file(argv[argc - 1], &f);
+		perf(&f, count);
+		return 0;
+	}
+
+	usage(usage_str);
+}
@@ -0,0 +1,78 @@
+/*
+ * test-has-objects: check the existence of the objects named on stdin
+ *
+ * "check" prints each name followed by 1 if has_object_files() finds
+ * the object and 0 otherwise, and dies if has_object_file() disagrees.
+ *
+ * "perf" times has_object_files() against has_object_file() on the
+ * whole list.
+ */
+#include "cache.h"
+#include "sha1-array.h"
+
+static void read_oids(struct oid_array *oids)
+{
+	struct strbuf line = STRBUF_INIT;
+	struct object_id oid;
+
+	while (strbuf_getline(&line, stdin) != EOF) {
+		if (get_oid_hex(line.buf, &oid))
+			die("not an object name: %s", line.buf);
+		oid_array_append(oids, &oid);
+	}
+	strbuf_release(&line);
+}
+
+static void report(const char *what, uint64_t t0, int found)
+{
+	printf("%-8s %f s (%d found)\n", what,
+	       (double)(getnanotime() - t0) / 1000000000, found);
+}
+
+int cmd_main(int argc, const char **argv)
+{
+	struct oid_array oids = OID_ARRAY_INIT;
+	int i, found = 0, quick = 0;
+	uint64_t t0;
+	char *exists;
+
+	setup_git_directory();
+	if (argc > 2 && !strcmp(argv[2], "--quick")) {
+		quick = HAS_SHA1_QUICK;
+		argc--;
+	}
+	if (argc != 2 || (strcmp(argv[1], "check") && strcmp(argv[1], "perf")))
+		usage("test-has-objects (check | perf) [--quick] <object-names");
+
+	read_oids(&oids);
+	exists = xmalloc(oids.nr);
+
+	if (!strcmp(argv[1], "check")) {
+		has_object_files(&oids, exists, quick);
+		for (i = 0; i < oids.nr; i++) {
+			if (!exists[i] != !has_object_file_with_flags(&oids.oid[i], quick))
+				die("has_object_files() is wrong about %s",
+				    oid_to_hex(&oids.oid[i]));
+			printf("%s %d\n", oid_to_hex(&oids.oid[i]), exists[i]);
+		}
+	} else {
+		/* map the pack indexes before timing anything */
+		has_object_files(&oids, exists, quick);
+
+		t0 = getnanotime();
+		has_object_files(&oids, exists, quick);
+		for (i = 0; i < oids.nr; i++)
+			found += exists[i];
+		report("batch", t0, found);
+
+		found = 0;
+		t0 = getnanotime();
+		for (i = 0; i < oids.nr; i++)
+			found += has_object_file_with_flags(&oids.oid[i], quick);
+		report("single", t0, found);
+	}
+
+	free(exists);
+	oid_array_clear(&oids);
+	return 0;
+}
@@ -8,6 +8,17 @@ static int dump;
 static int perf;
 static int analyze;
 static int analyze_step;
+static int threads;
+
+/*
+ * The "try_threaded" argument for test_lazy_init_name_hash() for the
+ * multi-threaded runs: let it pick the number of threads, unless one
+ * was given with --threads.
+ */
+static int multi_threaded(void)
+{
+	return threads > 1 ? threads : 1;
+}
 
 /*
  * Dump the contents of the "dir" and "name" hash tables to stdout.
@@ -25,6 +36,7 @@ static void dump_run(void)
 		struct dir_entry *parent;
 		int nr;
 		unsigned int namelen;
+		int first;
 		char name[FLEX_ARRAY];
 	};
 
@@ -35,7 +47,7 @@ static void dump_run(void)
 	if (single) {
 		test_lazy_init_name_hash(&the_index, 0);
 	} else {
-		int nr_threads_used = test_lazy_init_name_hash(&the_index, 1);
+		int nr_threads_used = test_lazy_init_name_hash(&the_index, multi_threaded());
 		if (!nr_threads_used)
 			die("non-threaded code path used");
 	}
@@ -71,7 +83,8 @@ static uint64_t time_runs(int try_threaded)
 		t0 = getnanotime();
 		read_cache();
 		t1 = getnanotime();
-		nr_threads_used = test_lazy_init_name_hash(&the_index, try_threaded);
+		nr_threads_used = test_lazy_init_name_hash(&the_index,
+			try_threaded ? multi_threaded() : 0);
 		t2 = getnanotime();
 
 		sum += (t2 - t1);
@@ -143,7 +156,7 @@ static void analyze_run(void)
 			read_cache();
 			the_index.cache_nr = nr; /* cheap truncate of index */
 			t1m = getnanotime();
-			nr_threads_used = test_lazy_init_name_hash(&the_index, 1);
+			nr_threads_used = test_lazy_init_name_hash(&the_index, multi_threaded());
 			t2m = getnanotime();
 			sum_multi += (t2m - t1m);
 			the_index.cache_nr = cache_nr_limit;
@@ -187,11 +200,11 @@ static void analyze_run(void)
 int cmd_main(int argc, const char **argv)
 {
 	const char *usage[] = {
-		"test-lazy-init-name-hash -d (-s | -m)",
-		"test-lazy-init-name-hash -p [-c c]",
-		"test-lazy-init-name-hash -a a [--step s] [-c c]",
-		"test-lazy-init-name-hash (-s | -m) [-c c]",
-		"test-lazy-init-name-hash -s -m [-c c]",
+		"test-lazy-init-name-hash -d (-s | -m) [-t t]",
+		"test-lazy-init-name-hash -p [-c c] [-t t]",
+		"test-lazy-init-name-hash -a a [--step s] [-c c] [-t t]",
+		"test-lazy-init-name-hash (-s | -m) [-c c] [-t t]",
+		"test-lazy-init-name-hash -s -m [-c c] [-t t]",
 		NULL
 	};
 	struct option options[] = {
@@ -202,6 +215,7 @@ int cmd_main(int argc, const char **argv)
 		OPT_BOOL('p', "perf", &perf, "compare single vs multi"),
 		OPT_INTEGER('a', "analyze", &analyze, "analyze different multi sizes"),
 		OPT_INTEGER(0, "step", &analyze_step, "analyze step factor"),
+		OPT_INTEGER('t', "threads", &threads, "number of threads for multi"),
 		OPT_END(),
 	};
 	const char *prefix;
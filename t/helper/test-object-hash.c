@@ -0,0 +1,113 @@
+/*
+ * test-object-hash: exercise the object hash table of object.c
+ *
+ * "check <n>" creates <n> objects, and then makes sure that each of
+ * them is found by lookup_object(), that objects never created are not,
+ * and that get_indexed_object() lists every object exactly once.
+ *
+ * "perf <n> <rounds>" creates <n> objects and then looks each of them,
+ * and <n> missing ones, up <rounds> times, printing the time taken by
+ * each phase.
+ */
+#include "cache.h"
+#include "object.h"
+
+static void make_sha1(unsigned char *sha1, unsigned int i)
+{
+	git_SHA_CTX ctx;
+
+	git_SHA1_Init(&ctx);
+	git_SHA1_Update(&ctx, &i, sizeof(i));
+	git_SHA1_Final(sha1, &ctx);
+}
+
+static unsigned char (*make_sha1s(unsigned int first, unsigned int n))[20]
+{
+	unsigned char (*sha1s)[20];
+	unsigned int i;
+
+	ALLOC_ARRAY(sha1s, n);
+	for (i = 0; i < n; i++)
+		make_sha1(sha1s[i], first + i);
+	return sha1s;
+}
+
+static void check(unsigned int n)
+{
+	unsigned char (*present)[20] = make_sha1s(0, n);
+	unsigned char (*missing)[20] = make_sha1s(n, n);
+	unsigned int i, seen = 0;
+
+	for (i = 0; i < n; i++)
+		lookup_unknown_object(present[i])->flags |= 1;
+
+	for (i = 0; i < n; i++) {
+		struct object *obj = lookup_object(present[i]);
+		if (!obj || hashcmp(obj->oid.hash, present[i]))
+			die("object %u not found", i);
+		if (lookup_object(missing[i]))
+			die("missing object %u found", i);
+	}
+
+	for (i = 0; i < get_max_object_index(); i++) {
+		struct object *obj = get_indexed_object(i);
+		if (!obj)
+			continue;
+		if (!(obj->flags & 1))
+			die("object %s listed twice", oid_to_hex(&obj->oid));
+		obj->flags &= ~1;
+		seen++;
+	}
+	if (seen != n)
+		die("listed %u objects out of %u", seen, n);
+
+	printf("ok %u objects\n", n);
+	free(present);
+	free(missing);
+}
+
+static void report(const char *what, uint64_t t0)
+{
+	printf("%-8s %f s\n", what, (double)(getnanotime() - t0) / 1000000000);
+}
+
+static void perf(unsigned int n, unsigned int rounds)
+{
+	unsigned char (*present)[20] = make_sha1s(0, n);
+	unsigned char (*missing)[20] = make_sha1s(n, n);
+	unsigned int i, j, found = 0;
+	uint64_t t0;
+
+	t0 = getnanotime();
+	for (i = 0; i < n; i++)
+		lookup_unknown_object(present[i]);
+	report("create", t0);
+
+	t0 = getnanotime();
+	for (j = 0; j < rounds; j++)
+		for (i = 0; i < n; i++)
+			found += !!lookup_object(present[i]);
+	report("hit", t0);
+
+	t0 = getnanotime();
+	for (j = 0; j < rounds; j++)
+		for (i = 0; i < n; i++)
+			found += !!lookup_object(missing[i]);
+	report("miss", t0);
+
+	if (found != n * rounds)
+		die("found %u objects instead of %u", found, n * rounds);
+	free(present);
+	free(missing);
+}
+
+int cmd_main(int argc, const char **argv)
+{
+	if (argc == 3 && !strcmp(argv[1], "check"))
+		check(strtoul(argv[2], NULL, 10));
+	else if (argc == 4 && !strcmp(argv[1], "perf"))
+		perf(strtoul(argv[2], NULL, 10), strtoul(argv[3], NULL, 10));
+	else
+		usage("test-object-hash (check <n> | perf <n> <rounds>)");
+	return 0;
+}
@@ -14,6 +14,11 @@ test_perf 'rev-list --all --objects' '
 	git rev-list --all --objects >/dev/null
 '
 
+test_expect_success 'peak memory of rev-list --all --objects' '
+	"$GTIME" -f "%M" -o rss git rev-list --all --objects >/dev/null &&
+	say "maximum resident set size: $(cat rss) kB"
+'
+
 test_expect_success 'create new unreferenced commit' '
 	commit=$(git commit-tree HEAD^{tree} -p HEAD) &&
 	test_export commit
@@ -28,4 +28,50 @@ test_perf 'log -S' '
 	git log --raw -Sfoo >/dev/null
 '
 
+# walks the delta chains of the blobs of many versions of the files
+test_perf 'log -p' '
+	git log -p >/dev/null
+'
+
+test_expect_success 'find a file with a long history' '
+	git ls-tree -r --name-only HEAD >files &&
+	git log --format= --name-only -n 1000 |
+	sort | uniq -c | sort -rn |
+	awk "NR == FNR { have[\$1] = 1; next }
+	     \$2 in have { print \$2; exit }" files - >file-to-blame &&
+	test -s file-to-blame
+'
+
+test_perf 'blame' '
+	git blame HEAD -- "$(cat file-to-blame)" >/dev/null
+'
+
+# the same with a cache much smaller than what the history needs, where
+# the eviction policy matters
+test_perf 'log --raw (small cache)' '
+	git -c core.deltaBaseCacheLimit=4m log --raw >/dev/null
+'
+
+test_perf 'log -p (small cache)' '
+	git -c core.deltaBaseCacheLimit=4m log -p >/dev/null
+'
+
+# commands that know the objects to read up front, and read them as a
+# batch, applying each delta only once
+test_perf 'cat-file --batch-all-objects --batch' '
+	git cat-file --batch-all-objects --batch >/dev/null
+'
+
+test_perf 'cat-file --batch-all-objects --batch --unordered' '
+	git cat-file --batch-all-objects --batch --unordered >/dev/null
+'
+
+test_perf 'archive' '
+	git archive HEAD >/dev/null
+'
+
+test_perf 'fast-export' '
+	git fast-export HEAD >/dev/null
+'
+
 test_done
@@ -6,6 +6,10 @@ test_description='Tests multi-threaded lazy_init_name_hash'
 test_perf_large_repo
 test_checkout_worktree
 
+test_lazy_prereq MULTI_CPU '
+	test 1 -lt $($GIT_BUILD_DIR/t/helper/test-online-cpus$X)
+'
+
 test_expect_success 'verify both methods build the same hashmaps' '
 	$GIT_BUILD_DIR/t/helper/test-lazy-init-name-hash$X --dump --single | sort >out.single &&
 	$GIT_BUILD_DIR/t/helper/test-lazy-init-name-hash$X --dump --multi  | sort >out.multi  &&
@@ -16,4 +20,12 @@ test_expect_success 'multithreaded should be faster' '
 	$GIT_BUILD_DIR/t/helper/test-lazy-init-name-hash$X --perf >out.perf
 '
 
+test_perf 'single-threaded' '
+	$GIT_BUILD_DIR/t/helper/test-lazy-init-name-hash$X --single --count=5
+'
+
+test_perf MULTI_CPU 'multi-threaded' '
+	$GIT_BUILD_DIR/t/helper/test-lazy-init-name-hash$X --multi --count=5
+'
+
 test_done
@@ -33,4 +33,49 @@ test_perf 'rebase on top of a lot of unrelated changes' '
 	git rebase --onto base HEAD^
 '
 
+test_expect_success 'setup rebase across a directory rename' '
+	git checkout -f -b rename-base base &&
+	mkdir renamed-dir &&
+	for i in $(seq 200)
+	do
+		seq $i $((1000 + $i)) >renamed-dir/file$i ||
+		break
+	done &&
+	git add renamed-dir &&
+	test_tick &&
+	git commit -q -m "add renamed-dir" &&
+	git checkout -b rename-upstream &&
+	git mv renamed-dir moved-dir &&
+	for i in $(seq 200)
+	do
+		echo upstream >>moved-dir/file$i ||
+		break
+	done &&
+	git add moved-dir &&
+	test_tick &&
+	git commit -q -m "move and touch renamed-dir" &&
+	git checkout -b rename-topic rename-base &&
+	for i in $(seq 20)
+	do
+		{ echo topic && cat renamed-dir/file$i; } >tmp &&
+		mv tmp renamed-dir/file$i &&
+		git add renamed-dir/file$i &&
+		test_tick &&
+		git commit -q -m "topic $i" ||
+		break
+	done &&
+	git tag rename-topic-orig
+'
+
+test_perf 'rebase -i of 20 commits across a directory rename' '
+	git checkout -f -B rename-topic rename-topic-orig &&
+	git -c sequence.editor=: rebase -i rename-upstream
+'
+
+test_perf 'rebase -i across a directory rename (merge.renameCache)' '
+	git checkout -f -B rename-topic rename-topic-orig &&
+	git -c merge.renameCache=true -c sequence.editor=: \
+		rebase -i rename-upstream
+'
+
 test_done
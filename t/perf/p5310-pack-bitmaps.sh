@@ -40,6 +40,18 @@ test_perf 'pack to file (bitmap)' '
 	git pack-objects --use-bitmap-index --all pack1b </dev/null >/dev/null
 '
 
+test_perf 'rev-list count with objects (bitmap)' '
+	git rev-list --use-bitmap-index --count --objects --all >/dev/null
+'
+
+test_perf 'rev-list disk usage (bitmap)' '
+	git rev-list --use-bitmap-index --disk-usage --objects --all >/dev/null
+'
+
+test_perf 'ewah operations on bitmaps' '
+	test-bitmap-ops perf 10 .git/objects/pack/pack-*.bitmap
+'
+
 test_expect_success 'create partial bitmap state' '
 	# pick a commit to represent the repo tip in the past
 	cutoff=$(git rev-list HEAD~100 -1) &&
@@ -0,0 +1,70 @@
+#!/bin/sh
+
+test_description="Comparison of git-grep's regex engines"
+
+. ./perf-lib.sh
+
+test_perf_large_repo
+test_checkout_worktree
+
+for pattern in \
+	'how.to' \
+	'^how to' \
+	'[how] to' \
+	'\(e.t[^ ]*\|v.ry\) rare' \
+	'^\(static\|extern\) [a-z]*_[a-z_]*'
+do
+	for engine in basic extended perl
+	do
+		if test $engine != "basic"
+		then
+			# Poor man's basic -> extended converter.
+			pattern=$(echo "$pattern" | sed 's/\\//g')
+		fi
+		if test $engine = "perl"
+		then
+			prereq="LIBPCRE"
+		else
+			prereq=""
+		fi
+		test_perf $prereq "$engine grep '$pattern'" "
+			git -c grep.patternType=$engine grep -- '$pattern' >'out.$engine' || :
+		"
+		test_perf $prereq "$engine grep -i '$pattern'" "
+			git -c grep.patternType=$engine grep -i -- '$pattern' >'out.$engine.i' || :
+		"
+	done
+
+	test_expect_success "assert that all engines found the same for '$pattern'" "
+		test_cmp out.basic out.extended &&
+		test_cmp out.basic.i out.extended.i &&
+		if test_have_prereq LIBPCRE
+		then
+			test_cmp out.basic out.perl &&
+			test_cmp out.basic.i out.perl.i
+		fi
+	"
+done
+
+for engine in basic extended perl
+do
+	if test $engine = "perl"
+	then
+		prereq="LIBPCRE"
+	else
+		prereq=""
+	fi
+	test_perf $prereq "$engine log --grep" "
+		git -c grep.patternType=$engine log --grep='fix.*crash' --format=%H >'log.$engine'
+	"
+done
+
+test_expect_success 'assert that all engines found the same commits' '
+	test_cmp log.basic log.extended &&
+	if test_have_prereq LIBPCRE
+	then
+		test_cmp log.basic log.perl
+	fi
+'
+
+test_done
@@ -269,6 +269,40 @@ EOF
 	test_line_count = 0 err
 '
 
+test_expect_success 'paths in and out of the same directory' '
+	mkdir -p x/y/z &&
+	cat >.gitattributes <<-\EOF &&
+	* foo=all
+	*.c foo=c
+	/x/*.c foo=xc
+	x/y/z/*.c foo=xyzc
+	y/*.c foo=yc
+	**/z/f foo=zf
+	x/[y]/f foo=bracket
+	EOF
+	cat >x/.gitattributes <<-\EOF &&
+	y/*.c foo=x-yc
+	/f foo=xf
+	EOF
+	cat >expect <<-\EOF &&
+	a.c: foo: c
+	f: foo: all
+	x/a.c: foo: xc
+	x/f: foo: xf
+	x/y/a.c: foo: x-yc
+	x/y/f: foo: bracket
+	x/y/z/a.c: foo: xyzc
+	x/y/z/f: foo: zf
+	x/a.c: foo: xc
+	y/a.c: foo: yc
+	x/y/a.c: foo: x-yc
+	a.c: foo: c
+	EOF
+	git check-attr foo -- a.c f x/a.c x/f x/y/a.c x/y/f \
+		x/y/z/a.c x/y/z/f x/a.c y/a.c x/y/a.c a.c >actual &&
+	test_cmp expect actual
+'
+
 test_expect_success 'using --git-dir and --work-tree' '
 	mkdir unreal real &&
 	git init real &&
@@ -841,4 +841,87 @@ test_expect_success 'info/exclude trumps core.excludesfile' '
 	test_cmp expect actual
 '
 
+test_expect_success 'long .gitignore files are matched like short ones' '
+	mkdir -p long/sub/build long/sub/x long/sub/a/b/deep long/sub/deep \
+		long/doc/generated long/foo/bar long/deep/er &&
+	>long/build &&
+	cat >long/.gitignore <<-\EOF &&
+	*.o
+	!keep.o
+	build/
+	/root-only
+	doc/generated
+	!doc/generated
+	doc/generated/
+	*.tmp
+	!important.tmp
+	cache*
+	!cachet
+	/sub/*.log
+	sub/**/deep
+	Makefile
+	*~
+	!*.o~
+	a?c
+	/build
+	foo/bar/
+	keep.o
+	**/x.txt
+	EOF
+	cat >paths <<-\EOF &&
+	long/a.o
+	long/keep.o
+	long/sub/keep.o
+	long/build
+	long/sub/build
+	long/root-only
+	long/sub/root-only
+	long/doc/generated
+	long/x.tmp
+	long/important.tmp
+	long/cache1
+	long/cachet
+	long/sub/a.log
+	long/sub/x/a.log
+	long/sub/a/b/deep
+	long/sub/deep
+	long/Makefile
+	long/a.c~
+	long/a.o~
+	long/abc
+	long/foo/bar
+	long/x.txt
+	long/deep/er/x.txt
+	long/nothing
+	EOF
+	cat >expect <<-\EOF &&
+	long/.gitignore:1:*.o	long/a.o
+	long/.gitignore:20:keep.o	long/keep.o
+	long/.gitignore:20:keep.o	long/sub/keep.o
+	long/.gitignore:18:/build	long/build
+	long/.gitignore:3:build/	long/sub/build
+	long/.gitignore:4:/root-only	long/root-only
+	::	long/sub/root-only
+	long/.gitignore:7:doc/generated/	long/doc/generated
+	long/.gitignore:8:*.tmp	long/x.tmp
+	long/.gitignore:9:!important.tmp	long/important.tmp
+	long/.gitignore:10:cache*	long/cache1
+	long/.gitignore:11:!cachet	long/cachet
+	long/.gitignore:12:/sub/*.log	long/sub/a.log
+	::	long/sub/x/a.log
+	long/.gitignore:13:sub/**/deep	long/sub/a/b/deep
+	long/.gitignore:13:sub/**/deep	long/sub/deep
+	long/.gitignore:14:Makefile	long/Makefile
+	long/.gitignore:15:*~	long/a.c~
+	long/.gitignore:16:!*.o~	long/a.o~
+	long/.gitignore:17:a?c	long/abc
+	long/.gitignore:19:foo/bar/	long/foo/bar
+	long/.gitignore:21:**/x.txt	long/x.txt
+	long/.gitignore:21:**/x.txt	long/deep/er/x.txt
+	::	long/nothing
+	EOF
+	git check-ignore -v -n --stdin <paths >actual &&
+	test_cmp expect actual
+'
+
 test_done
@@ -30,4 +30,23 @@ do
 
 done
 
+# A file that is modified in the same second as the index is written,
+# and then given back its old mtime (to the nanosecond, where "touch"
+# can do that), must not be trusted to be clean because of that mtime.
+for trial in 0 1 2 3 4
+do
+	rm -f .git/index
+	echo frotz >zork
+	touch -r zork zork.mtime
+	git update-index --add zork
+	echo xyzzy >zork
+	touch -r zork.mtime zork
+
+	files=$(git diff-files -p)
+	test_expect_success \
+	"Racy GIT trial #$trial part C" \
+	'test "" != "$files"'
+
+done
+
 test_done
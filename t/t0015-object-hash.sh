@@ -0,0 +1,18 @@
+#!/bin/sh
+
+test_description='test the object hash table'
+. ./test-lib.sh
+
+test_expect_success 'lookups in a small table' '
+	test-object-hash check 10 >out &&
+	echo "ok 10 objects" >expect &&
+	test_cmp expect out
+'
+
+test_expect_success 'lookups across several resizes' '
+	test-object-hash check 100000 >out &&
+	echo "ok 100000 objects" >expect &&
+	test_cmp expect out
+'
+
+test_done
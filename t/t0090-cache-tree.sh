@@ -52,6 +52,14 @@ test_invalid_cache_tree () {
 	test_cmp expect actual
 }
 
+# Unlike test_cache_tree, this copes with nested directories, but
+# only checks that no node is invalid (test-dump-cache-tree itself
+# fails if a valid node is wrong).
+test_valid_cache_tree () {
+	test-dump-cache-tree >actual &&
+	! grep "^invalid" actual
+}
+
 test_no_cache_tree () {
 	: >expect &&
 	cmp_cache_tree expect
@@ -234,6 +242,30 @@ test_expect_success 'partial commit gives cache-tree' '
 	test_cache_tree
 '
 
+test_expect_success 'checkout carrying changes in subdirectories gives cache-tree' '
+	git reset --hard &&
+	git checkout -b nested current &&
+	mkdir -p deep/a/b deep/c &&
+	echo one >deep/a/b/file &&
+	echo two >deep/a/file &&
+	echo three >deep/c/file &&
+	echo four >deep/file &&
+	git add deep &&
+	git commit -m nested &&
+	echo changed >deep/a/b/file &&
+	git commit -a -m "nested change" &&
+	git checkout HEAD^ &&
+	test_valid_cache_tree &&
+	echo staged >deep/c/file &&
+	>deep/a/b/new &&
+	git add deep &&
+	git checkout nested &&
+	test-dump-cache-tree >actual &&
+	git reset --hard HEAD^ &&
+	test_valid_cache_tree &&
+	test "$(git write-tree)" = "$(git rev-parse HEAD^{tree})"
+'
+
 test_expect_success 'no phantom error when switching trees' '
 	mkdir newdir &&
 	>newdir/one &&
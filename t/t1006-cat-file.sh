@@ -573,4 +573,28 @@ test_expect_success 'cat-file --batch-all-objects shows all objects' '
 	test_cmp expect actual
 '
 
+test_expect_success 'cat-file --unordered shows the same objects' '
+	git -C all-two cat-file --batch-all-objects --unordered \
+				--batch-check="%(objectname)" >actual.unsorted &&
+	sort <actual.unsorted >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'cat-file --batch-check --unordered follows pack order' '
+	idx=$(ls all-one/.git/objects/pack/pack-*.idx) &&
+	git show-index <"$idx" >index &&
+	sort -n index | cut -d" " -f2 >expect.packed &&
+	git -C all-one cat-file --batch-all-objects --unordered \
+				--batch-check="%(objectname)" >actual.packed &&
+	head -n 3 actual.packed >actual &&
+	test_cmp expect.packed actual
+'
+
+test_expect_success 'cat-file --unordered shows the same contents' '
+	git -C all-two cat-file --batch <actual.unsorted >expect &&
+	git -C all-two cat-file --batch-all-objects --unordered \
+				--batch >actual &&
+	test_cmp expect actual
+'
+
 test_done
@@ -0,0 +1,85 @@
+#!/bin/sh
+
+test_description='check the existence of many objects at once'
+. ./test-lib.sh
+
+# write blobs named by prefix and number, printing their object names
+make_blobs () {
+	mkdir -p blobs &&
+	for i in $(test_seq $2)
+	do
+		echo "$1 $i" >blobs/$1-$i || return 1
+	done &&
+	ls blobs/$1-* | git hash-object $3 --stdin-paths &&
+	rm -rf blobs
+}
+
+test_expect_success 'setup' '
+	git init alt &&
+	(
+		cd alt &&
+		make_blobs alt-loose 300 -w >../alt-loose &&
+		make_blobs alt-packed 300 -w >../alt-packed &&
+		git pack-objects .git/objects/pack/pack <../alt-packed &&
+		git prune-packed
+	) &&
+	echo "$(pwd)/alt/.git/objects" >.git/objects/info/alternates &&
+	make_blobs loose 1000 -w >loose &&
+	make_blobs packed 300 -w >packed &&
+	git pack-objects .git/objects/pack/pack <packed &&
+	git prune-packed &&
+	make_blobs missing 1000 >missing &&
+	cat loose packed alt-loose alt-packed >present
+'
+
+check_objects () {
+	test-has-objects check $1 <input >actual &&
+	test_cmp expect actual
+}
+
+test_expect_success 'present objects are found' '
+	sort present >input &&
+	sed "s/\$/ 1/" input >expect &&
+	check_objects &&
+	check_objects --quick
+'
+
+test_expect_success 'missing objects are not found' '
+	sed "s/\$/ 0/" missing >expect &&
+	cp missing input &&
+	check_objects &&
+	check_objects --quick
+'
+
+test_expect_success 'mixed and repeated objects keep their order' '
+	cat missing present loose missing >input &&
+	{
+		sed "s/\$/ 0/" missing &&
+		sed "s/\$/ 1/" present &&
+		sed "s/\$/ 1/" loose &&
+		sed "s/\$/ 0/" missing
+	} >expect &&
+	check_objects
+'
+
+test_expect_success 'a few objects are checked one by one' '
+	{
+		head -n 2 loose &&
+		head -n 1 missing &&
+		head -n 1 alt-loose
+	} >input &&
+	printf "%s 1\n%s 1\n" $(head -n 2 loose) >expect &&
+	printf "%s 0\n" $(head -n 1 missing) >>expect &&
+	printf "%s 1\n" $(head -n 1 alt-loose) >>expect &&
+	check_objects
+'
+
+test_expect_success 'objects moved into another pack are found' '
+	git pack-objects .git/objects/pack/pack <loose &&
+	git prune-packed &&
+	cat loose packed >input &&
+	sed "s/\$/ 1/" input >expect &&
+	check_objects
+'
+
+test_done
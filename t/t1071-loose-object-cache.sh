@@ -0,0 +1,63 @@
+#!/bin/sh
+
+test_description='look up loose objects through core.looseObjectCache'
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	git init alt &&
+	echo alternate | git -C alt hash-object -w --stdin >alt-blob &&
+	echo "$(pwd)/alt/.git/objects" >.git/objects/info/alternates &&
+	test_commit one &&
+	git repack -ad &&
+	test_commit two &&
+	echo missing | git hash-object --stdin >missing-blob &&
+	git config core.looseObjectCache true
+'
+
+test_expect_success 'loose, packed and alternate objects are found' '
+	git cat-file -e two &&
+	git cat-file -e two^{tree} &&
+	git cat-file -e one &&
+	git cat-file blob $(cat alt-blob) >actual &&
+	echo alternate >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'missing objects are not found' '
+	test_must_fail git cat-file -e $(cat missing-blob) &&
+	echo "$(cat missing-blob) missing" >expect &&
+	git cat-file --batch-check <missing-blob >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'objects written by the same process are found' '
+	for i in $(test_seq 100)
+	do
+		test_seq $i 200 >file &&
+		git add file &&
+		git commit -q -m $i || return 1
+	done &&
+	git rev-list --objects --all >objects &&
+	git pack-objects --revs --stdout --all </dev/null >all.pack &&
+	git init unpacked &&
+	git -C unpacked config core.looseObjectCache true &&
+	git -C unpacked unpack-objects <all.pack &&
+	cut -d" " -f1 objects |
+	git -C unpacked cat-file --batch-check="%(objectname)" >actual &&
+	cut -d" " -f1 objects >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'objects written by another process are found' '
+	git init fetched &&
+	git -C fetched config core.looseObjectCache true &&
+	git -C fetched config fetch.unpackLimit 10000 &&
+	git -C fetched fetch .. one:refs/heads/one &&
+	git -C fetched fetch .. master:refs/heads/topic &&
+	git -C fetched rev-parse topic >actual &&
+	git rev-parse master >expect &&
+	test_cmp expect actual &&
+	git -C fetched fsck
+'
+
+test_done
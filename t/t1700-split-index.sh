@@ -370,4 +370,80 @@ test_expect_success 'check splitIndex.sharedIndexExpire set to "never" and "now"
 	test $(ls .git/sharedindex.* | wc -l) -le 2
 '
 
+test_expect_success 'gc moves all entries to a new shared index' '
+	git config splitIndex.maxPercentChange 100 &&
+	: >seventeen &&
+	git update-index --add seventeen &&
+	BASE=$(test-dump-split-index .git/index | grep "^base") &&
+	test-dump-split-index .git/index | sed "/^own/d" >actual &&
+	cat >expect <<-EOF &&
+	$BASE
+	100644 e69de29bb2d1d6434b8b29ae775ad8c2e48c5391 0	seventeen
+	replacements:
+	deletions:
+	EOF
+	test_cmp expect actual &&
+	git ls-files --stage >ls-files.expect &&
+	git gc &&
+	git ls-files --stage >ls-files.actual &&
+	test_cmp ls-files.expect ls-files.actual &&
+	test-dump-split-index .git/index | sed "/^own/d" >actual &&
+	! grep "$BASE" actual &&
+	test_line_count = 3 actual
+'
+
+test_expect_success 'shared index can be rewritten in the background' '
+	git config --unset splitIndex.maxPercentChange &&
+	git config splitIndex.backgroundRewrite true &&
+	BASE=$(test-dump-split-index .git/index | grep "^base") &&
+	for i in 18 19 20 21 22
+	do
+		: >file$i || return 1
+	done &&
+	git update-index --add file18 file19 file20 file21 file22 &&
+	git ls-files --stage >ls-files.expect &&
+	for i in $(test_seq 30)
+	do
+		test-dump-split-index .git/index | sed "/^own/d" >actual &&
+		test_line_count = 3 actual 2>/dev/null &&
+		break
+		sleep 1
+	done &&
+	test_line_count = 3 actual &&
+	! grep "$BASE" actual &&
+	git ls-files --stage >ls-files.actual &&
+	test_cmp ls-files.expect ls-files.actual
+'
+
+test_expect_success 'update-index --rewrite-shared-index' '
+	git config --unset splitIndex.backgroundRewrite &&
+	git config splitIndex.maxPercentChange 100 &&
+	BASE=$(test-dump-split-index .git/index | grep "^base") &&
+	: >file23 &&
+	git update-index --add file23 &&
+	git ls-files --stage >ls-files.expect &&
+	test-dump-split-index .git/index | sed "/^own/d" >actual &&
+	grep "$BASE" actual &&
+	git update-index --rewrite-shared-index &&
+	test-dump-split-index .git/index | sed "/^own/d" >actual &&
+	test_line_count = 3 actual &&
+	! grep "$BASE" actual &&
+	git ls-files --stage >ls-files.actual &&
+	test_cmp ls-files.expect ls-files.actual
+'
+
+test_expect_success 'update-index --rewrite-shared-index with other options' '
+	test_expect_code 129 git update-index -h >usage 2>&1 &&
+	grep -e "--rewrite-shared-index" usage &&
+	BASE=$(test-dump-split-index .git/index | grep "^base") &&
+	: >file24 &&
+	git update-index --add file24 &&
+	: >file25 &&
+	git update-index --rewrite-shared-index --add file25 &&
+	test-dump-split-index .git/index | sed "/^own/d" >actual &&
+	! grep "$BASE" actual &&
+	grep "file25\$" actual &&
+	! grep "file24\$" actual
+'
+
 test_done
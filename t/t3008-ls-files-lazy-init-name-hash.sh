@@ -4,15 +4,13 @@ test_description='Test the lazy init name hash with various folder structures'
 
 . ./test-lib.sh
 
-if test 1 -eq $($GIT_BUILD_DIR/t/helper/test-online-cpus)
-then
-	skip_all='skipping lazy-init tests, single cpu'
-	test_done
-fi
+test_lazy_prereq MULTI_CPU '
+	test 1 -lt $($GIT_BUILD_DIR/t/helper/test-online-cpus)
+'
 
 LAZY_THREAD_COST=2000
 
-test_expect_success 'no buffer overflow in lazy_init_name_hash' '
+test_expect_success MULTI_CPU 'no buffer overflow in lazy_init_name_hash' '
 	(
 	    test_seq $LAZY_THREAD_COST | sed "s/^/a_/"
 	    echo b/b/b
@@ -24,4 +22,65 @@ test_expect_success 'no buffer overflow in lazy_init_name_hash' '
 	test-lazy-init-name-hash -m
 '
 
+test_expect_success 'threaded hash tables match the single-threaded ones' '
+	for d in A b/C b/d/E f
+	do
+		test_seq 200 | sed "s|^|$d/|"
+	done |
+	sed "s/^/100644 $EMPTY_BLOB	/" |
+	git update-index --index-info &&
+	test-lazy-init-name-hash -d -s | sort >single &&
+	for t in 2 3 8
+	do
+		test-lazy-init-name-hash -d -m -t $t | sort >multi &&
+		test_cmp single multi || return 1
+	done
+'
+
+test_expect_success 'threaded hash tables keep mixed-case names in index order' '
+	rm -f .git/index &&
+	for d in FOO Foo foo FOO/BAR Foo/bar foo/Bar
+	do
+		test_seq 200 | sed "s|^|$d/|"
+	done |
+	sed "s/^/100644 $EMPTY_BLOB	/" |
+	git update-index --index-info &&
+	test-lazy-init-name-hash -d -s >single &&
+	grep "^dir" single | sort >single-dirs &&
+	grep "^name" single >single-names &&
+	grep "^dir [0-9a-f]* *[0-9]* FOO/BAR\$" single-dirs &&
+	for t in 2 3 4 8
+	do
+		test-lazy-init-name-hash -d -m -t $t >multi &&
+		grep "^dir" multi | sort >multi-dirs &&
+		grep "^name" multi >multi-names &&
+		test_cmp single-dirs multi-dirs &&
+		test_cmp single-names multi-names || return 1
+	done
+'
+
+test_expect_success 'mixed-case directories with core.ignorecase and core.preloadindex' '
+	rm -f .git/index &&
+	for d in FOO Foo foo
+	do
+		test_seq $LAZY_THREAD_COST | sed "s|^|$d/|"
+	done |
+	sed "s/^/100644 $EMPTY_BLOB	/" |
+	git update-index --index-info &&
+	mkdir -p FOO foo &&
+	>FOO/1 &&
+	>foo/new &&
+	git -c core.ignorecase=true -c core.preloadindex=true \
+		status --porcelain -uall >status &&
+	grep -i "foo/" status >expect &&
+	grep "^?? foo/new\$" expect &&
+	for i in 1 2 3 4 5
+	do
+		git -c core.ignorecase=true -c core.preloadindex=true \
+			status --porcelain -uall >status &&
+		grep -i "foo/" status >actual &&
+		test_cmp expect actual || return 1
+	done
+'
+
 test_done
@@ -0,0 +1,150 @@
+#!/bin/sh
+
+test_description='rebase -i and cherry-pick remember renames between picks'
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	git config merge.renameCache true &&
+	mkdir old &&
+	for i in 1 2 3 4 5
+	do
+		test_seq $i $((100 + $i)) >old/file$i || return 1
+	done &&
+	git add old &&
+	test_tick &&
+	git commit -m base &&
+	git tag base &&
+
+	git mv old new &&
+	for i in 1 2 3 4 5
+	do
+		echo "upstream $i" >>new/file$i || return 1
+	done &&
+	git add new &&
+	test_tick &&
+	git commit -m "move old/ to new/" &&
+	git tag upstream &&
+
+	git checkout -b topic base &&
+	for i in 1 2 3
+	do
+		sed -e "s/^5\$/topic $i/" old/file$i >tmp &&
+		mv tmp old/file$i &&
+		git add old/file$i &&
+		test_tick &&
+		git commit -m "topic $i" || return 1
+	done &&
+	git tag topic-orig &&
+
+	git checkout -b expect topic-orig &&
+	git rebase -m upstream &&
+	git checkout topic
+'
+
+test_expect_success 'rebase -i keeps renames in a rename cache' '
+	git -c sequence.editor=: rebase -i \
+		--exec "test -f \"\$(git rev-parse --git-dir)/rebase-merge/rename-cache\"" \
+		upstream &&
+	test_path_is_missing .git/rebase-merge &&
+	git diff --exit-code expect HEAD &&
+	test_path_is_missing old &&
+	grep "topic 3" new/file3
+'
+
+test_expect_success 'cherry-pick of a range keeps renames in a rename cache' '
+	git checkout -b picked upstream &&
+	git cherry-pick base..topic-orig &&
+	test_path_is_missing .git/sequencer &&
+	git diff --exit-code expect HEAD
+'
+
+test_expect_success 'a corrupt rename cache is ignored' '
+	git checkout -B topic topic-orig &&
+	test_when_finished "rm -f stopped" &&
+	test_must_fail git -c sequence.editor=: rebase -i \
+		--exec "test -f stopped || { >stopped && false; }" upstream &&
+	echo garbage >.git/rebase-merge/rename-cache &&
+	git rebase --continue 2>err &&
+	git diff --exit-code expect HEAD &&
+	test_i18ngrep "ignoring corrupt rename cache" err
+'
+
+test_expect_success 'a cached rename does not beat a better match' '
+	git checkout -b compete-base upstream &&
+	test_seq 1 20 >orig &&
+	git add orig &&
+	test_tick &&
+	git commit -m "add orig" &&
+	git checkout -b compete-ours &&
+	sed -e "s/^1[5-9]\$/x&/" -e "s/^20\$/x&/" orig >far &&
+	git rm orig &&
+	git add far &&
+	test_tick &&
+	git commit -m "move orig far away" &&
+	git checkout -b compete-theirs compete-base &&
+	git rm orig &&
+	git show compete-ours:far >far &&
+	test_seq 1 19 >near &&
+	echo 21 >>near &&
+	git add far near &&
+	test_tick &&
+	git commit -m "add far and near" &&
+
+	git checkout -b compete-nocache compete-ours &&
+	test_must_fail git -c merge.renameCache=false \
+		cherry-pick compete-theirs >expect &&
+	test_i18ngrep "rename/rename" expect &&
+	git reset --hard &&
+	git checkout -b compete-cache compete-ours &&
+	test_must_fail git cherry-pick compete-theirs >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'a cached rename whose source is taken by another file' '
+	git reset --hard &&
+	git checkout -b taken-base upstream &&
+	mkdir a b &&
+	for i in 1 2 3 4 5 6 7 8 9 10
+	do
+		echo "common $i" || return 1
+	done >common.txt &&
+	{ cat common.txt && echo o1 && echo o2 && echo o3 && echo o4; } >a/orig &&
+	cp a/orig b/orig &&
+	{ cat common.txt && echo t1 && echo t2 && echo t3 && echo t4; } >b/other &&
+	{ cat common.txt && echo o1 && echo o2 && echo o3 && echo t1; } >near.txt &&
+	git add a b &&
+	test_tick &&
+	git commit -m "add orig and other" &&
+
+	git checkout -b taken-x &&
+	git mv a/orig a/near &&
+	cp near.txt a/near &&
+	git add a/near &&
+	test_tick &&
+	git commit -m "move orig to near" &&
+
+	git checkout -b taken-y taken-base &&
+	git mv b/orig b/twin &&
+	git mv b/other b/near &&
+	cp near.txt b/near &&
+	git add b/near &&
+	test_tick &&
+	git commit -m "move orig to twin and other to near" &&
+
+	git checkout -b taken-up taken-base &&
+	{ echo upstream && cat b/other; } >tmp &&
+	mv tmp b/other &&
+	git add b/other &&
+	test_tick &&
+	git commit -m "edit other" &&
+
+	git checkout -b taken-nocache taken-up &&
+	git -c merge.renameCache=false cherry-pick taken-x taken-y &&
+	grep upstream b/near &&
+	git checkout -b taken-cache taken-up &&
+	git cherry-pick taken-x taken-y &&
+	git diff --exit-code taken-nocache taken-cache
+'
+
+test_done
@@ -0,0 +1,83 @@
+#!/bin/sh
+
+test_description='git log with log.diffCache'
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	test_seq 1 100 >original &&
+	test_seq 1 10 >other &&
+	git add original other &&
+	test_tick &&
+	git commit -m initial &&
+	git mv original renamed &&
+	echo 101 >>renamed &&
+	echo 11 >>other &&
+	git add renamed other &&
+	test_tick &&
+	git commit -m "rename with changes" &&
+	cp renamed copied &&
+	echo 102 >>copied &&
+	git add copied &&
+	test_tick &&
+	git commit -m copy
+'
+
+while read -r opts
+do
+	test_expect_success "log $opts is the same with the cache" "
+		git log $opts >expect &&
+		git -c log.diffCache=true log $opts >actual.first &&
+		git -c log.diffCache=true log $opts >actual.second &&
+		test_cmp expect actual.first &&
+		test_cmp expect actual.second
+	"
+done <<\EOF
+--stat -M
+--numstat -M
+--name-status -M
+-p -M
+--name-status -C -C
+--name-status -B -M
+--name-status --diff-filter=R -M
+--raw --abbrev=40 -M -R
+--stat
+EOF
+
+test_expect_success 'cache is stored as notes' '
+	git rev-parse --verify refs/notes/tree-diff &&
+	git log -1 --format=%s refs/notes/tree-diff >actual &&
+	echo "tree-diff-cache v1" >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'cached renames do not need the blobs' '
+	git -c log.diffCache=true log --name-status -M >expect &&
+	blob=$(git rev-parse HEAD~2:original) &&
+	blob_file=.git/objects/$(echo $blob | sed -e "s|^..|&/|") &&
+	mv $blob_file blob.obj &&
+	test_when_finished "mv blob.obj $blob_file" &&
+	git -c log.diffCache=true log --name-status -M >actual &&
+	test_cmp expect actual &&
+	test_must_fail git -c log.diffCache=false log --name-status -M
+'
+
+test_expect_success 'pathspec-limited diffs are not cached' '
+	git update-ref -d refs/notes/tree-diff &&
+	git -c log.diffCache=true log --name-status -M -- renamed &&
+	test_must_fail git rev-parse --verify refs/notes/tree-diff
+'
+
+test_expect_success 'corrupt cache entries are ignored' '
+	git update-ref -d refs/notes/tree-diff &&
+	git -c log.diffCache=true log --name-status -M >expect &&
+	git notes --ref=tree-diff list >notes &&
+	while read blob key
+	do
+		echo garbage | git notes --ref=tree-diff add -f -F - $key || return 1
+	done <notes &&
+	git -c log.diffCache=true log --name-status -M >actual &&
+	test_cmp expect actual
+'
+
+test_done
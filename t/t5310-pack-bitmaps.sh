@@ -78,6 +78,55 @@ rev_list_tests() {
 		test_cmp expect actual
 	'
 
+	test_expect_success "counting commits with skip ($state)" '
+		git rev-list --count --skip=3 HEAD >expect &&
+		git rev-list --use-bitmap-index --count --skip=3 HEAD >actual &&
+		test_cmp expect actual
+	'
+
+	test_expect_success "counting commits with --ancestry-path ($state)" '
+		git rev-list --count --ancestry-path side-5..master >expect &&
+		git rev-list --use-bitmap-index --count --ancestry-path \
+			side-5..master >actual &&
+		test_cmp expect actual &&
+		git rev-list --count --objects --ancestry-path \
+			side-5..master >expect &&
+		git rev-list --use-bitmap-index --count --objects \
+			--ancestry-path side-5..master >actual &&
+		test_cmp expect actual
+	'
+
+	test_expect_success "counting commits with --bisect ($state)" '
+		git rev-list --count --bisect HEAD~5..HEAD >expect &&
+		git rev-list --use-bitmap-index --count --bisect \
+			HEAD~5..HEAD >actual &&
+		test_cmp expect actual
+	'
+
+	test_expect_success "counting objects via bitmap ($state)" '
+		git rev-list --count --objects HEAD >expect &&
+		git rev-list --use-bitmap-index --count --objects HEAD >actual &&
+		test_cmp expect actual
+	'
+
+	test_expect_success "counting partial objects via bitmap ($state)" '
+		git rev-list --count --objects HEAD~5..HEAD >expect &&
+		git rev-list --use-bitmap-index --count --objects \
+			HEAD~5..HEAD >actual &&
+		test_cmp expect actual
+	'
+
+	test_expect_success "disk usage via bitmap ($state)" '
+		git rev-list --disk-usage other...master >expect &&
+		git rev-list --use-bitmap-index --disk-usage \
+			other...master >actual &&
+		test_cmp expect actual &&
+		git rev-list --disk-usage --objects HEAD >expect &&
+		git rev-list --use-bitmap-index --disk-usage --objects \
+			HEAD >actual &&
+		test_cmp expect actual
+	'
+
 	test_expect_success "enumerate --objects ($state)" '
 		git rev-list --objects --use-bitmap-index HEAD >tmp &&
 		cut -d" " -f1 <tmp >tmp2 &&
@@ -96,6 +145,27 @@ rev_list_tests() {
 
 rev_list_tests 'full bitmap'
 
+test_expect_success 'ewah operations agree with uncompressed bitmaps' '
+	test-bitmap-ops verify .git/objects/pack/pack-*.bitmap >out &&
+	grep "^ok [1-9][0-9]* bitmaps" out
+'
+
+test_expect_success 'full repack writes a bitmap lookup table' '
+	git -c pack.writeBitmapLookupTable=true repack -adb &&
+	git rev-list --test-bitmap HEAD
+'
+
+rev_list_tests 'full bitmap with lookup table'
+
+test_expect_success 'bitmaps are the same without reading the lookup table' '
+	git rev-list --use-bitmap-index --objects HEAD >expect.raw &&
+	GIT_TEST_BITMAP_LOOKUP_TABLE=0 \
+		git rev-list --use-bitmap-index --objects HEAD >actual.raw &&
+	sort expect.raw >expect &&
+	sort actual.raw >actual &&
+	test_cmp expect actual
+'
+
 test_expect_success 'clone from bitmapped repository' '
 	git clone --no-local --bare . clone.git &&
 	git rev-parse HEAD >expect &&
@@ -109,6 +179,13 @@ test_expect_success 'setup further non-bitmapped commits' '
 	done
 '
 
+rev_list_tests 'partial bitmap with lookup table'
+
+# Until the next full repack writes bitmaps without a lookup table, read
+# them the default way, without the table.
+GIT_TEST_BITMAP_LOOKUP_TABLE=0
+export GIT_TEST_BITMAP_LOOKUP_TABLE
+
 rev_list_tests 'partial bitmap'
 
 test_expect_success 'fetch (partial bitmap)' '
@@ -212,6 +289,8 @@ test_expect_success 'full repack, reusing previous bitmaps' '
 	test_line_count = 1 output
 '
 
+sane_unset GIT_TEST_BITMAP_LOOKUP_TABLE
+
 test_expect_success 'fetch (full bitmap)' '
 	git --git-dir=clone.git fetch origin master:master &&
 	git rev-parse HEAD >expect &&
@@ -0,0 +1,77 @@
+#!/bin/sh
+
+test_description='on-disk reverse indexes of packs'
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	test_commit one &&
+	test_commit two &&
+	test_commit three &&
+	git repack -ad &&
+	git cat-file --batch-all-objects \
+		--batch-check="%(objectname) %(objectsize:disk)" >expect
+'
+
+test_expect_success 'repack does not write .rev files by default' '
+	ls .git/objects/pack >files &&
+	! grep "\.rev$" files
+'
+
+test_expect_success 'repack writes a .rev file with pack.writeReverseIndex' '
+	git -c pack.writeReverseIndex=true repack -ad &&
+	pack=$(ls .git/objects/pack/*.pack) &&
+	test_path_is_file ${pack%.pack}.rev
+'
+
+test_expect_success 'objects are found by their offset with a .rev file' '
+	git cat-file --batch-all-objects \
+		--batch-check="%(objectname) %(objectsize:disk)" >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'index-pack --rev-index writes the same .rev file' '
+	cp $pack tmp.pack &&
+	git index-pack --rev-index tmp.pack &&
+	test_cmp_bin ${pack%.pack}.rev tmp.rev &&
+	rm -f tmp.idx tmp.rev &&
+	git -c pack.writeReverseIndex=true index-pack --no-rev-index tmp.pack &&
+	test_path_is_missing tmp.rev
+'
+
+test_expect_success 'index-pack -o puts the .rev file next to the pack' '
+	ls .git/objects/pack >files.before &&
+	cp $pack other.pack &&
+	git index-pack --rev-index -o other-index other.pack &&
+	test_path_is_file other-index &&
+	test_cmp_bin ${pack%.pack}.rev other.rev &&
+	ls .git/objects/pack >files.after &&
+	test_cmp files.before files.after
+'
+
+test_expect_success 'index-pack --stdin stores the .rev file with the pack' '
+	git init --bare stdin.git &&
+	git -C stdin.git -c pack.writeReverseIndex=true \
+		index-pack --stdin <$pack &&
+	ls stdin.git/objects/pack/*.rev >revs &&
+	test_line_count = 1 revs
+'
+
+test_expect_success 'a .rev file that does not match the pack is ignored' '
+	rev=${pack%.pack}.rev &&
+	mv $rev rev.backup &&
+	test_when_finished "mv rev.backup $rev" &&
+	printf "RIDX" >$rev &&
+	git cat-file --batch-all-objects \
+		--batch-check="%(objectname) %(objectsize:disk)" >actual 2>err &&
+	test_cmp expect actual &&
+	test_i18ngrep "reverse index" err
+'
+
+test_expect_success 'repack removes the .rev files of old packs' '
+	test_commit four &&
+	git -c pack.writeReverseIndex=false repack -ad &&
+	ls .git/objects/pack >files &&
+	! grep "\.rev$" files
+'
+
+test_done
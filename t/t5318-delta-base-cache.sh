@@ -0,0 +1,74 @@
+#!/bin/sh
+
+test_description='reading long delta chains through the delta base cache'
+. ./test-lib.sh
+
+test_expect_success 'create a pack with long delta chains' '
+	test-genrandom foo 8192 | od -An -tx1 | head -n 120 >content &&
+	for i in $(test_seq 60)
+	do
+		# each version changes one more line, so that it is closest
+		# to its neighbours and the versions form a chain
+		awk -v n=$i "{ print } NR % 2 == 0 {
+			print (NR / 2 <= n ? \"changed \" : \"orig \") NR / 2
+		}" content >file &&
+		git add file &&
+		git commit -q -m $i || return 1
+	done &&
+	git repack -adf --depth=50 --window=100 &&
+	git verify-pack -s .git/objects/pack/*.idx >stats &&
+	grep "chain length = 20" stats
+'
+
+test_expect_success 'objects read the same with any cache size' '
+	git cat-file --batch-all-objects --batch >expect &&
+	for limit in 1 20k 64k 1m
+	do
+		git -c core.deltaBaseCacheLimit=$limit \
+			cat-file --batch-all-objects --batch >actual &&
+		test_cmp expect actual || return 1
+	done
+'
+
+test_expect_success 'objects read as a batch are the same with any cache size' '
+	git cat-file --batch-all-objects --unordered \
+		--batch-check="%(objectname)" >order &&
+	git cat-file --batch <order >expect &&
+	for limit in 1 20k 64k 1m
+	do
+		git -c core.deltaBaseCacheLimit=$limit cat-file \
+			--batch-all-objects --unordered --batch >actual &&
+		test_cmp expect actual || return 1
+	done
+'
+
+test_expect_success 'fast-export and archive are the same with a small cache' '
+	git fast-export HEAD >expect &&
+	git -c core.deltaBaseCacheLimit=20k fast-export HEAD >actual &&
+	test_cmp expect actual &&
+	git archive HEAD >expect.tar &&
+	git -c core.deltaBaseCacheLimit=20k archive HEAD >actual.tar &&
+	test_cmp expect.tar actual.tar
+'
+
+test_expect_success 'log -p is the same with a small cache' '
+	git log -p >expect &&
+	git -c core.deltaBaseCacheLimit=64k log -p >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'GIT_TRACE_DELTA_BASE_CACHE reports the use of the cache' '
+	GIT_TRACE_DELTA_BASE_CACHE="$(pwd)/trace" \
+		git -c core.deltaBaseCacheLimit=64k log -p >/dev/null &&
+	grep "delta base cache: [0-9]* hits, [0-9]* misses, [1-9][0-9]* evictions" trace &&
+	pack=$(echo .git/objects/pack/*.pack) &&
+	grep "delta base cache: $pack: [1-9][0-9]* hits" trace
+'
+
+test_expect_success 'bases larger than a quarter of the cache are not kept' '
+	GIT_TRACE_DELTA_BASE_CACHE="$(pwd)/trace" \
+		git -c core.deltaBaseCacheLimit=20k log -p >/dev/null &&
+	grep "delta base cache: [0-9]* hits, [0-9]* misses, 0 evictions, 0 spared, [1-9][0-9]* too large" trace
+'
+
+test_done
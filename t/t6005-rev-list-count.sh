@@ -48,4 +48,15 @@ test_expect_success '--skip --max-count' '
     test $(git rev-list HEAD --skip=10 --max-count=10 | wc -l) = 0
 '
 
+test_expect_success '--count --objects' '
+    git rev-list --objects HEAD >objects &&
+    test_line_count = $(git rev-list --count --objects HEAD) objects &&
+    git rev-list --objects HEAD~2..HEAD >objects &&
+    test_line_count = $(git rev-list --count --objects HEAD~2..HEAD) objects
+'
+
+test_expect_success '--count --objects does not take --left-right' '
+    test_must_fail git rev-list --count --objects --left-right HEAD~2...HEAD
+'
+
 test_done
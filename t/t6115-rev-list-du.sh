@@ -0,0 +1,59 @@
+#!/bin/sh
+
+test_description='basic tests of rev-list --disk-usage'
+. ./test-lib.sh
+
+# we want a mix of reachable and unreachable, as well as
+# objects in the bitmapped pack and some outside of it
+test_expect_success 'set up repository' '
+	test_commit one &&
+	test_commit two &&
+	git repack -adb &&
+	git reset --hard HEAD^ &&
+	test_commit three &&
+	test_commit four &&
+	git reset --hard HEAD^
+'
+
+# We don't test the exact output, since the on-disk sizes are not
+# stable; instead we compare against what cat-file reports, which
+# has its own tests.
+disk_usage_slow () {
+	git rev-list "$@" |
+	cut -d" " -f1 |
+	git cat-file --batch-check="%(objectsize:disk)" |
+	awk "{ total += \$1 } END { print total }"
+}
+
+# check behavior with given rev-list options; note that
+# whitespace is not preserved in args
+check_du () {
+	args=$*
+
+	test_expect_success "generate expected size ($args)" "
+		disk_usage_slow $args >expect
+	"
+
+	test_expect_success "rev-list --disk-usage without bitmaps ($args)" "
+		git rev-list --disk-usage $args >actual &&
+		test_cmp expect actual
+	"
+
+	test_expect_success "rev-list --disk-usage with bitmaps ($args)" "
+		git rev-list --disk-usage --use-bitmap-index $args >actual &&
+		test_cmp expect actual
+	"
+}
+
+check_du HEAD
+check_du --objects HEAD
+check_du --objects HEAD^..HEAD
+check_du --all
+check_du --objects --all
+
+test_expect_success 'rev-list --disk-usage cannot be combined with --count' '
+	test_must_fail git rev-list --count --disk-usage HEAD &&
+	test_must_fail git rev-list --count --disk-usage --use-bitmap-index HEAD
+'
+
+test_done
@@ -253,4 +253,33 @@ test_expect_success 'status --porcelain=bogus' '
 	test_must_fail git status --porcelain=bogus
 '
 
+test_expect_success 'status with preloaded index' '
+	git init preload &&
+	(
+		cd preload &&
+		for d in a b c d
+		do
+			mkdir $d &&
+			for i in $(test_seq 400)
+			do
+				echo $i >$d/$i || exit 1
+			done
+		done &&
+		git add . &&
+		git commit -q -m files &&
+		echo changed >a/7 &&
+		echo changed >c/400 &&
+		rm d/123 &&
+		cat >expect <<-\EOF &&
+		 M a/7
+		 M c/400
+		 D d/123
+		EOF
+		git -c core.preloadIndex=true status --porcelain -uno >actual &&
+		test_cmp expect actual &&
+		git -c core.preloadIndex=false status --porcelain -uno >actual &&
+		test_cmp expect actual
+	)
+'
+
 test_done
@@ -0,0 +1,61 @@
+#!/bin/sh
+
+test_description='git status and ls-files -o with threaded directory scan'
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	cat >.gitignore <<-\EOF &&
+	*.o
+	/expect*
+	/actual*
+	EOF
+	for d in a b c d e
+	do
+		mkdir -p $d/sub/deeper $d/ignored $d/empty &&
+		echo "ignored/" >$d/.gitignore &&
+		echo "!keep.o" >$d/sub/.gitignore &&
+		>$d/tracked &&
+		>$d/untracked &&
+		>$d/file.o &&
+		>$d/sub/keep.o &&
+		>$d/sub/other.o &&
+		>$d/sub/deeper/untracked &&
+		>$d/ignored/file || return 1
+	done &&
+	git add .gitignore */.gitignore */sub/.gitignore */tracked &&
+	git commit -m initial &&
+	git init e/nested &&
+	test_commit -C e/nested nested &&
+	mkdir untracked-dir &&
+	>untracked-dir/file &&
+	>top
+'
+
+for args in "status --porcelain" \
+	    "status --porcelain -uall" \
+	    "status --porcelain --ignored" \
+	    "status --porcelain --ignored -uall" \
+	    "ls-files -o --exclude-standard" \
+	    "ls-files -o --exclude-standard --directory" \
+	    "ls-files -o -i --exclude-standard" \
+	    "clean -n -d" \
+	    "clean -n -d -x"
+do
+	test_expect_success "$args with and without threads" "
+		git -c core.untrackedThreads=1 $args >expect &&
+		git -c core.untrackedThreads=4 $args >actual &&
+		test_cmp expect actual &&
+		git -c core.untrackedThreads=4 -C a $args >actual &&
+		git -c core.untrackedThreads=1 -C a $args >expect &&
+		test_cmp expect actual
+	"
+done
+
+test_expect_success 'threaded scan of a pathspec' '
+	git -c core.untrackedThreads=1 status --porcelain -uall b c >expect &&
+	git -c core.untrackedThreads=4 status --porcelain -uall b c >actual &&
+	test_cmp expect actual
+'
+
+test_done
@@ -1247,6 +1247,79 @@ test_expect_success 'grep -E pattern with grep.patternType=fixed' '
 	test_cmp expected actual
 '
 
+test_expect_success 'setup regexp semantics tests' '
+	{
+		echo "a^b and a\$b" &&
+		echo "*star" &&
+		echo "xabcdx" &&
+		echo "aab" &&
+		echo "ab" &&
+		echo "cd"
+	} >semantics &&
+	git add semantics
+'
+
+test_expect_success 'grep -G treats misplaced anchors and leading star literally' '
+	echo "semantics:a^b and a\$b" >expected &&
+	git grep -G "a^b" semantics >actual &&
+	test_cmp expected actual &&
+	git grep -G "a\$b" semantics >actual &&
+	test_cmp expected actual &&
+	echo "semantics:*star" >expected &&
+	git grep -G "*star" semantics >actual &&
+	test_cmp expected actual &&
+	git grep -G "^*st" semantics >actual &&
+	test_cmp expected actual
+'
+
+test_expect_success 'grep -G and -E intervals and groups' '
+	echo "semantics:aab" >expected &&
+	git grep -G "a\{2\}b" semantics >actual &&
+	test_cmp expected actual &&
+	git grep -E "^a{2,}b" semantics >actual &&
+	test_cmp expected actual &&
+	git grep -G "^\(a\)\1b" semantics >actual &&
+	test_cmp expected actual &&
+	git grep -E "^(a|x){2}b$" semantics >actual &&
+	test_cmp expected actual
+'
+
+test_expect_success 'grep -E does not match newlines with [^...]' '
+	test_must_fail git grep -E "^ab[^x]*cd$" semantics &&
+	test_must_fail git grep -E "^ab.cd" semantics
+'
+
+test_expect_success 'grep does not let . match NUL' '
+	test_when_finished "rm -f nul" &&
+	printf "a\\000b\\naxb\\n" >nul &&
+	echo "nul:1" >expected &&
+	git grep --no-index -a -c "a.b" nul >actual &&
+	test_cmp expected actual &&
+	git grep --no-index -a -c -E "a.?.b|axb" nul >actual &&
+	test_cmp expected actual &&
+	printf "a\\000b\\n" >nul &&
+	test_must_fail git grep --no-index "a.b" nul
+'
+
+test_expect_success 'grep --color shows the longest leftmost match' '
+	echo "semantics<CYAN>:<RESET>x<BOLD;RED>abcd<RESET>x" >expected &&
+	git grep --color=always -E "(a|ab)(c|bcd)" semantics |
+		test_decode_color >actual &&
+	test_cmp expected actual &&
+	git grep --color=always -G "\(a\|ab\)\(c\|bcd\)" semantics |
+		test_decode_color >actual &&
+	test_cmp expected actual
+'
+
+test_expect_success 'grep -w with -E alternation' '
+	{
+		echo "semantics:aab" &&
+		echo "semantics:ab"
+	} >expected &&
+	git grep -w -E "a+b|ab" semantics >actual &&
+	test_cmp expected actual
+'
+
 cat >expected <<EOF
 hello.c<RED>:<RESET>int main(int argc, const char **argv)
 hello.c<RED>-<RESET>{
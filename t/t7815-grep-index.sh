@@ -0,0 +1,111 @@
+#!/bin/sh
+
+test_description='git grep with trigram indexes of trees'
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	mkdir dir &&
+	test_write_lines "the needle is here" "and a Needle there" >needle &&
+	test_write_lines "only hay" "more hay" >hay &&
+	test_write_lines "NEEDLEWORK in capitals" "foo(bar) = 1;" >dir/shout &&
+	test_write_lines "nothing to find" "in this file" >dir/nothing &&
+	git add . &&
+	test_tick &&
+	git commit -m initial &&
+	tree=$(git rev-parse HEAD^{tree})
+'
+
+test_expect_success 'grep --build-index writes an index for HEAD' '
+	git grep --build-index &&
+	test_path_is_file .git/grep-index/$tree.gti
+'
+
+test_expect_success 'grep --build-index accepts trees and commits' '
+	rm -rf .git/grep-index &&
+	git grep --build-index HEAD $tree &&
+	test_path_is_file .git/grep-index/$tree.gti
+'
+
+while read -r opts
+do
+	test_expect_success "grep $opts with and without index" "
+		rm -rf .git/grep-index &&
+		test_might_fail git grep $opts HEAD >expect &&
+		git grep --build-index &&
+		test_might_fail git grep $opts HEAD >actual &&
+		test_cmp expect actual
+	"
+done <<\EOF
+needle
+-i needle
+-F needle
+-i -F NEEDLE
+-w needle
+-e needle -e nothing
+-l needle
+-c needle
+-v needle
+-L needle
+-e needle --and -e here
+nee.*
+needles*
+-E needle+
+-E '(needle|hay)'
+-F 'foo(bar)'
+-E 'NEEDLE[A-Z]'
+'needle\|hay'
+zzzzzz
+ne
+EOF
+
+test_expect_success 'indexed grep does not read blobs that cannot match' '
+	git grep --build-index &&
+	hay=$(git rev-parse HEAD:hay) &&
+	hay_file=.git/objects/$(echo $hay | sed -e "s|^..|&/|") &&
+	mv $hay_file hay.obj &&
+	test_when_finished "mv hay.obj $hay_file" &&
+	git grep -l needle HEAD >actual &&
+	echo HEAD:needle >expect &&
+	test_cmp expect actual &&
+	test_must_fail git grep -l hay HEAD
+'
+
+test_expect_success 'corrupt index is ignored' '
+	echo garbage >.git/grep-index/$tree.gti &&
+	git grep -l needle HEAD >actual 2>err &&
+	echo HEAD:needle >expect &&
+	test_cmp expect actual &&
+	test_i18ngrep "trigram index" err
+'
+
+test_expect_success 'index with a bad checksum is ignored' '
+	rm -rf .git/grep-index &&
+	git grep --build-index &&
+	size=$(wc -c <.git/grep-index/$tree.gti) &&
+	# damage the last posting list, right before the trailer
+	printf "\377" |
+	dd of=.git/grep-index/$tree.gti bs=1 seek=$(($size - 21)) \
+		conv=notrunc 2>/dev/null &&
+	git grep -l needle HEAD >actual 2>err &&
+	echo HEAD:needle >expect &&
+	test_cmp expect actual &&
+	test_i18ngrep "bad checksum" err
+'
+
+test_expect_success 'gc removes the indexes of trees that are gone' '
+	git grep --build-index &&
+	echo gone >gone &&
+	git add gone &&
+	gone_tree=$(git write-tree) &&
+	git grep --build-index $gone_tree &&
+	git reset &&
+	rm gone &&
+	>.git/grep-index/junk &&
+	git gc --prune=now &&
+	test_path_is_file .git/grep-index/$tree.gti &&
+	test_path_is_missing .git/grep-index/$gone_tree.gti &&
+	test_path_is_missing .git/grep-index/junk
+'
+
+test_done
@@ -244,6 +244,32 @@ test_expect_success 'setup file with CRLF newlines' '
 	printf "testcase\r\n" >crlffile
 '
 
+test_expect_success 'setup file with many copied fragments' '
+	test_seq 1 60 | sed -e "s/.*/line & of the copy source/" >copysrc &&
+	git add copysrc &&
+	git commit -m "add copy source" &&
+	for i in $(test_seq 20)
+	do
+		sed -n -e "$((3 * $i))p" copysrc &&
+		echo "interleaved line $i" || return 1
+	done >copydst &&
+	git add copydst &&
+	git commit -m "scatter fragments"
+'
+
+test_expect_success 'blame -C -C -C output does not depend on --threads' '
+	git blame --threads=1 -C -C -C1 copydst >expect &&
+	git blame --threads=4 -C -C -C1 copydst >actual &&
+	test_cmp expect actual &&
+	grep copysrc actual
+'
+
+test_expect_success 'blame -M output does not depend on blame.threads' '
+	git -c blame.threads=1 blame -M1 copydst >expect &&
+	git -c blame.threads=4 blame -M1 copydst >actual &&
+	test_cmp expect actual
+'
+
 test_expect_success 'blame file with CRLF core.autocrlf true' '
 	git config core.autocrlf true &&
 	git blame crlffile >actual &&
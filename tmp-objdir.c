@@ -270,6 +270,7 @@ int tmp_objdir_migrate(struct tmp_objdir *t)
 	strbuf_addstr(&dst, get_object_directory());
 
 	ret = migrate_paths(&src, &dst);
+	invalidate_loose_object_cache();
 
 	strbuf_release(&src);
 	strbuf_release(&dst);
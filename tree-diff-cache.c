@@ -0,0 +1,202 @@
+#include "cache.h"
+#include "diff.h"
+#include "diffcore.h"
+#include "notes-cache.h"
+#include "tree-diff-cache.h"
+
+/* Bump when the meaning of the key or the format of the entries changes */
+#define TREE_DIFF_CACHE_VALIDITY "tree-diff-cache v1"
+
+/* The flags that change what ends up in the diff queue */
+#define TREE_DIFF_CACHE_FLAGS (DIFF_OPT_RECURSIVE | \
+			       DIFF_OPT_TREE_IN_RECURSIVE | \
+			       DIFF_OPT_FIND_COPIES_HARDER | \
+			       DIFF_OPT_RENAME_EMPTY | \
+			       DIFF_OPT_REVERSE_DIFF | \
+			       DIFF_OPT_RELATIVE_NAME | \
+			       DIFF_OPT_IGNORE_SUBMODULES)
+
+#define PAIR_BROKEN	01
+#define PAIR_RENAMED	02
+#define PAIR_UNMERGED	04
+#define ONE_OID_VALID	010
+#define TWO_OID_VALID	020
+
+struct notes_cache *init_tree_diff_cache(void)
+{
+	struct notes_cache *c = xmalloc(sizeof(*c));
+
+	notes_cache_init(c, "tree-diff", TREE_DIFF_CACHE_VALIDITY);
+	return c;
+}
+
+int tree_diff_cache_usable(const struct diff_options *opt)
+{
+	/*
+	 * Pathspecs (and --follow, which rewrites them) limit the
+	 * tree walk, pickaxe and --diff-order work on file contents,
+	 * and --quick stops at the first change; none of these are
+	 * worth encoding in the key.
+	 */
+	return !opt->pathspec.nr &&
+		!opt->pickaxe &&
+		!opt->orderfile &&
+		!DIFF_OPT_TST(opt, FOLLOW_RENAMES) &&
+		!DIFF_OPT_TST(opt, QUICK);
+}
+
+static void tree_diff_cache_key(const struct object_id *old_oid,
+				const struct object_id *new_oid,
+				const struct diff_options *opt,
+				unsigned char *key)
+{
+	struct strbuf sb = STRBUF_INIT;
+
+	strbuf_addf(&sb, "%s %s\n", oid_to_hex(old_oid), oid_to_hex(new_oid));
+	strbuf_addf(&sb, "flags %x\n", opt->flags & TREE_DIFF_CACHE_FLAGS);
+	strbuf_addf(&sb, "rename %d %d %d\n", opt->detect_rename,
+		    opt->rename_score, opt->rename_limit);
+	strbuf_addf(&sb, "break %d\n", opt->break_opt);
+	strbuf_addf(&sb, "filter %x\n", opt->filter);
+	if (DIFF_OPT_TST(opt, RELATIVE_NAME) && opt->prefix)
+		strbuf_addf(&sb, "prefix %s\n", opt->prefix);
+	hash_sha1_file(sb.buf, sb.len, "blob", key);
+	strbuf_release(&sb);
+}
+
+static void add_pair(struct strbuf *sb, const struct diff_filepair *p)
+{
+	unsigned flags = 0;
+
+	if (p->broken_pair)
+		flags |= PAIR_BROKEN;
+	if (p->renamed_pair)
+		flags |= PAIR_RENAMED;
+	if (p->is_unmerged)
+		flags |= PAIR_UNMERGED;
+	if (p->one->oid_valid)
+		flags |= ONE_OID_VALID;
+	if (p->two->oid_valid)
+		flags |= TWO_OID_VALID;
+
+	strbuf_addf(sb, "%c %u %o %o %o %s", p->status, p->score, flags,
+		    p->one->mode, p->two->mode, oid_to_hex(&p->one->oid));
+	strbuf_addf(sb, " %s", oid_to_hex(&p->two->oid));
+	strbuf_addch(sb, '\0');
+	strbuf_add(sb, p->one->path, strlen(p->one->path) + 1);
+	strbuf_add(sb, p->two->path, strlen(p->two->path) + 1);
+}
+
+static const char *parse_number(const char *p, int base, unsigned long *v)
+{
+	char *end;
+
+	if (!isxdigit(*p))
+		return NULL;
+	*v = strtoul(p, &end, base);
+	return *end == ' ' ? end + 1 : NULL;
+}
+
+/*
+ * Parse one entry, as written by add_pair(), from buf and append it
+ * to the queue.  Returns the number of bytes consumed, or 0 if the
+ * entry is malformed.
+ */
+static size_t parse_pair(const char *buf, size_t len,
+			 struct diff_queue_struct *q)
+{
+	const char *end = buf + len, *p, *path_one, *path_two;
+	unsigned long score, flags, mode_one, mode_two;
+	struct object_id oid_one, oid_two;
+	struct diff_filespec *one, *two;
+	struct diff_filepair *dp;
+
+	if (!(path_one = memchr(buf, '\0', len)) || ++path_one >= end ||
+	    !(path_two = memchr(path_one, '\0', end - path_one)) ||
+	    ++path_two >= end ||
+	    !(p = memchr(path_two, '\0', end - path_two)))
+		return 0;
+
+	if (len < 2 || buf[1] != ' ' ||
+	    !(p = parse_number(buf + 2, 10, &score)) ||
+	    !(p = parse_number(p, 8, &flags)) ||
+	    !(p = parse_number(p, 8, &mode_one)) ||
+	    !(p = parse_number(p, 8, &mode_two)) ||
+	    get_oid_hex(p, &oid_one) || p[GIT_SHA1_HEXSZ] != ' ' ||
+	    get_oid_hex(p + GIT_SHA1_HEXSZ + 1, &oid_two) ||
+	    p[2 * GIT_SHA1_HEXSZ + 1] != '\0')
+		return 0;
+
+	one = alloc_filespec(path_one);
+	two = alloc_filespec(path_two);
+	fill_filespec(one, oid_one.hash, !!(flags & ONE_OID_VALID), mode_one);
+	fill_filespec(two, oid_two.hash, !!(flags & TWO_OID_VALID), mode_two);
+	dp = diff_queue(q, one, two);
+	dp->status = buf[0];
+	dp->score = score;
+	dp->broken_pair = !!(flags & PAIR_BROKEN);
+	dp->renamed_pair = !!(flags & PAIR_RENAMED);
+	dp->is_unmerged = !!(flags & PAIR_UNMERGED);
+
+	return path_two + strlen(path_two) + 1 - buf;
+}
+
+int tree_diff_cache_get(struct notes_cache *c,
+			const struct object_id *old_oid,
+			const struct object_id *new_oid,
+			struct diff_options *opt)
+{
+	struct diff_queue_struct q;
+	unsigned char key[20];
+	char *buf;
+	size_t len, pos = 0;
+
+	tree_diff_cache_key(old_oid, new_oid, opt, key);
+	buf = notes_cache_get(c, key, &len);
+	if (!buf)
+		return -1;
+
+	DIFF_QUEUE_CLEAR(&q);
+	while (pos < len) {
+		size_t consumed = parse_pair(buf + pos, len - pos, &q);
+
+		if (!consumed) {
+			int i;
+
+			for (i = 0; i < q.nr; i++)
+				diff_free_filepair(q.queue[i]);
+			free(q.queue);
+			free(buf);
+			return -1;
+		}
+		pos += consumed;
+	}
+	free(buf);
+
+	free(diff_queued_diff.queue);
+	diff_queued_diff = q;
+
+	/* See the end of diffcore_std() */
+	if (diff_queued_diff.nr && !DIFF_OPT_TST(opt, DIFF_FROM_CONTENTS))
+		DIFF_OPT_SET(opt, HAS_CHANGES);
+	else
+		DIFF_OPT_CLR(opt, HAS_CHANGES);
+	opt->found_follow = 0;
+	return 0;
+}
+
+void tree_diff_cache_put(struct notes_cache *c,
+			 const struct object_id *old_oid,
+			 const struct object_id *new_oid,
+			 const struct diff_options *opt)
+{
+	struct strbuf sb = STRBUF_INIT;
+	unsigned char key[20];
+	int i;
+
+	for (i = 0; i < diff_queued_diff.nr; i++)
+		add_pair(&sb, diff_queued_diff.queue[i]);
+	tree_diff_cache_key(old_oid, new_oid, opt, key);
+	notes_cache_put(c, key, sb.buf, sb.len);
+	strbuf_release(&sb);
+}
@@ -0,0 +1,42 @@
+#ifndef TREE_DIFF_CACHE_H
+#define TREE_DIFF_CACHE_H
+
+struct notes_cache;
+struct diff_options;
+
+/*
+ * The tree diff cache remembers the filepairs left in the diff queue
+ * after diffing two trees and running diffcore_std() on the result,
+ * so that rename and copy detection need not be redone the next time
+ * the same pair of trees is diffed with the same options.  Entries
+ * are stored in refs/notes/tree-diff, keyed by a hash of both tree
+ * names and the options that affect the result.
+ */
+struct notes_cache *init_tree_diff_cache(void);
+
+/*
+ * Returns 1 if the result of diffing trees with these options can be
+ * cached, i.e. does not depend on anything but the trees themselves.
+ */
+int tree_diff_cache_usable(const struct diff_options *opt);
+
+/*
+ * Fill the diff queue from the cache.  Returns 0 on success, or -1 if
+ * the trees have not been diffed with these options before, in which
+ * case the diff queue is left untouched.
+ */
+int tree_diff_cache_get(struct notes_cache *c,
+			const struct object_id *old_oid,
+			const struct object_id *new_oid,
+			struct diff_options *opt);
+
+/*
+ * Remember the contents of the diff queue, which must be the result
+ * of diffing the trees and calling diffcore_std().
+ */
+void tree_diff_cache_put(struct notes_cache *c,
+			 const struct object_id *old_oid,
+			 const struct object_id *new_oid,
+			 const struct diff_options *opt);
+
+#endif
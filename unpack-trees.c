@@ -175,6 +175,22 @@ void setup_unpack_trees_porcelain(struct unpack_trees_options *opts,
 		opts->unpack_rejects[i].strdup_strings = 1;
 }
 
+/*
+ * Which of the trees the result is going to match when nothing gets
+ * in the way, or -1.  The cache-tree of the directories taken from
+ * that tree unchanged is filled in while unpacking.
+ */
+static int cache_tree_target(struct unpack_trees_options *o)
+{
+	if (!o->dst_index || o->prefix || !o->skip_sparse_checkout)
+		return -1;
+	if (o->fn == oneway_merge)
+		return 0;
+	if (o->fn == twoway_merge)
+		return 1;
+	return -1;
+}
+
 static int do_add_entry(struct unpack_trees_options *o, struct cache_entry *ce,
 			 unsigned int set, unsigned int clear)
 {
@@ -609,12 +625,93 @@ static inline int are_same_oid(struct name_entry *name_j, struct name_entry *nam
 	return name_j->oid && name_k->oid && !oidcmp(name_j->oid, name_k->oid);
 }
 
+/*
+ * Once the entries of the directory "path" (pathlen bytes, including
+ * the trailing slash) have been unpacked, check whether the result
+ * holds exactly what "desc", the tree the result is to end up with,
+ * records for it.  If so, that tree is what writing out the result
+ * would produce, so record it in the cache-tree and spare the caller
+ * from hashing the directory all over again.  Anything added to the
+ * directory later on invalidates the node again.
+ */
+static void prime_cache_subtree(struct unpack_trees_options *o,
+				struct tree_desc desc,
+				const struct object_id *oid,
+				const char *path, int pathlen)
+{
+	struct index_state *istate = &o->result;
+	struct cache_tree *it;
+	struct name_entry entry;
+	int pos, count = 0;
+
+	pos = index_name_pos(istate, path, pathlen);
+	if (0 <= pos)
+		return;
+	pos = -pos - 1;
+
+	while (tree_entry(&desc, &entry)) {
+		int len = tree_entry_len(&entry);
+		const struct cache_entry *ce;
+
+		while (pos < istate->cache_nr &&
+		       (istate->cache[pos]->ce_flags & CE_REMOVE))
+			pos++;
+		if (pos >= istate->cache_nr)
+			return;
+		ce = istate->cache[pos];
+		if (ce_namelen(ce) < pathlen + len ||
+		    memcmp(ce->name, path, pathlen) ||
+		    memcmp(ce->name + pathlen, entry.path, len))
+			return;
+
+		if (S_ISDIR(entry.mode)) {
+			int i;
+
+			if (ce->name[pathlen + len] != '/')
+				return;
+			it = cache_tree_path(istate->cache_tree, ce->name,
+					     pathlen + len, 0);
+			if (!it || it->entry_count < 0 ||
+			    hashcmp(it->sha1, entry.oid->hash))
+				return;
+			for (i = 0; i < it->entry_count; pos++) {
+				if (pos >= istate->cache_nr)
+					return;
+				if (!(istate->cache[pos]->ce_flags & CE_REMOVE))
+					i++;
+			}
+			count += it->entry_count;
+		} else {
+			if (ce_namelen(ce) != pathlen + len ||
+			    ce_stage(ce) || ce_intent_to_add(ce) ||
+			    ce->ce_mode != entry.mode ||
+			    oidcmp(&ce->oid, entry.oid))
+				return;
+			pos++;
+			count++;
+		}
+	}
+
+	while (pos < istate->cache_nr &&
+	       (istate->cache[pos]->ce_flags & CE_REMOVE))
+		pos++;
+	if (pos < istate->cache_nr &&
+	    !strncmp(istate->cache[pos]->name, path, pathlen))
+		return;
+
+	it = cache_tree_path(istate->cache_tree, path, pathlen - 1, 1);
+	it->entry_count = count;
+	hashcpy(it->sha1, oid->hash);
+}
+
 static int traverse_trees_recursive(int n, unsigned long dirmask,
 				    unsigned long df_conflicts,
 				    struct name_entry *names,
 				    struct traverse_info *info)
 {
-	int i, ret, bottom;
+	struct unpack_trees_options *o = info->data;
+	unsigned long dirmask_in = dirmask;
+	int i, ret, bottom, target;
 	int nr_buf = 0;
 	struct tree_desc t[MAX_UNPACK_TREES];
 	void *buf[MAX_UNPACK_TREES];
@@ -665,6 +762,17 @@ static int traverse_trees_recursive(int n, unsigned long dirmask,
 	ret = traverse_trees(n, t, &newinfo);
 	restore_cache_bottom(&newinfo, bottom);
 
+	target = o->cache_tree_target;
+	if (!ret && 0 <= target && (dirmask_in & (1ul << target))) {
+		char *path = xmallocz(newinfo.pathlen);
+
+		make_traverse_path(path, info, p);
+		path[newinfo.pathlen - 1] = '/';
+		prime_cache_subtree(o, t[target], names[target].oid,
+				    path, newinfo.pathlen);
+		free(path);
+	}
+
 	for (i = 0; i < nr_buf; i++)
 		free(buf[i]);
 
@@ -1260,6 +1368,9 @@ int unpack_trees(unsigned len, struct tree_desc *t, struct unpack_trees_options
 
 	memset(&o->result, 0, sizeof(o->result));
 	o->result.initialized = 1;
+	o->cache_tree_target = cache_tree_target(o);
+	if (0 <= o->cache_tree_target)
+		o->result.cache_tree = cache_tree();
 	o->result.timestamp.sec = o->src_index->timestamp.sec;
 	o->result.timestamp.nsec = o->src_index->timestamp.nsec;
 	o->result.version = o->src_index->version;
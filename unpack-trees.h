@@ -73,6 +73,7 @@ struct unpack_trees_options {
 	struct index_state result;
 
 	struct exclude_list *el; /* for internal use */
+	int cache_tree_target; /* for internal use */
 };
 
 extern int unpack_trees(unsigned n, struct tree_desc *t,